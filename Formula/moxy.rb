@@ -19,7 +19,7 @@ class Moxy < Formula
            "-DYAML_VERSION_MAJOR=0", "-DYAML_VERSION_MINOR=2",
            "-DYAML_VERSION_PATCH=5", '-DYAML_VERSION_STRING="0.2.5"',
            *Dir["src/*.c"], *goose_src, *goose_cmd, *yaml_src,
-           "-o", "moxy"
+           "-o", "moxy", "-lpthread"
     bin.install "moxy"
   end
 
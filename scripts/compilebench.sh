@@ -0,0 +1,100 @@
+#!/bin/sh
+# Compiler throughput benchmark: generates a large program with
+# scripts/genprogram.c (enums, matches, lambdas, list and map instantiations
+# and a chain of includes), transpiles it with --time-passes-json and reports
+# lines/s and allocations per phase and peak RSS. The generated C is then
+# compiled and run, so a dropped or truncated declaration fails the run.
+# Usage: sh scripts/compilebench.sh [units] [include depth] [rounds]
+# MOXY is the binary to measure (default build/debug/moxy) and OUT the
+# results file. With BASELINE set to an earlier OUT, any phase whose lines/s
+# fell by more than THRESHOLD percent (default 20) fails the run.
+set -e
+
+UNITS="${1:-2000}"
+DEPTH="${2:-64}"
+ROUNDS="${3:-3}"
+CC="${CC:-cc}"
+CFLAGS="${CFLAGS:--O2}"
+MOXY="${MOXY:-./build/debug/moxy}"
+THRESHOLD="${THRESHOLD:-20}"
+TMP="${TMPDIR:-/tmp}/moxy_compilebench"
+OUT="${OUT:-$TMP/results.json}"
+PHASES="preprocess lex parse codegen"
+
+rm -rf "$TMP/prog"
+mkdir -p "$TMP"
+$CC $CFLAGS -std=c11 scripts/genprogram.c -o "$TMP/genprogram"
+"$TMP/genprogram" "$TMP/prog" "$UNITS" "$DEPTH"
+lines=$(cat "$TMP/prog/main.mxy" "$TMP"/prog/inc/*.mxy | wc -l | tr -d ' ')
+
+# the first match is the totals line, which comes before the records
+field() {
+    sed -n "s/.*\"$2\": \([0-9.]*\).*/\1/p" "$1" | head -n 1
+}
+
+best=""
+for r in $(seq "$ROUNDS"); do
+    "$MOXY" --time-passes-json "$TMP/passes.json" "$TMP/prog/main.mxy" > "$TMP/prog.c"
+    total=0
+    for p in $PHASES; do
+        total=$(awk -v a="$total" -v b="$(field "$TMP/passes.json" "${p}_ms")" 'BEGIN { print a + b }')
+    done
+    if [ -z "$best" ] || awk -v a="$total" -v b="$best" 'BEGIN { exit !(a < b) }'; then
+        best=$total
+        cp "$TMP/passes.json" "$TMP/best.json"
+    fi
+done
+
+rss=$(field "$TMP/best.json" peak_rss_kb)
+echo "$lines lines, $UNITS units, include depth $DEPTH, best of $ROUNDS"
+printf '  %-12s %10s %14s %10s\n' phase ms lines/s alloc
+{
+    echo "{"
+    echo "  \"lines\": $lines,"
+    echo "  \"units\": $UNITS,"
+    echo "  \"depth\": $DEPTH,"
+    echo "  \"peak_rss_kb\": $rss,"
+    echo "  \"phases\": {"
+} > "$OUT"
+sep=","
+for p in $PHASES total; do
+    if [ "$p" = total ]; then
+        ms=$best
+        bytes=0
+        for q in $PHASES; do
+            bytes=$((bytes + $(field "$TMP/best.json" "${q}_bytes")))
+        done
+        sep=""
+    else
+        ms=$(field "$TMP/best.json" "${p}_ms")
+        bytes=$(field "$TMP/best.json" "${p}_bytes")
+    fi
+    lps=$(awk -v n="$lines" -v ms="$ms" 'BEGIN { printf "%.0f", (ms > 0 ? n / (ms / 1000) : 0) }')
+    printf '  %-12s %10.2f %14s %8.1fMB\n' "$p" "$ms" "$lps" "$(awk -v b="$bytes" 'BEGIN { print b / 1048576 }')"
+    echo "    \"$p\": {\"ms\": $ms, \"lines_per_sec\": $lps, \"bytes\": $bytes}$sep" >> "$OUT"
+done
+printf '  %-12s %8.1fMB\n' "peak RSS" "$(awk -v k="$rss" 'BEGIN { print k / 1024 }')"
+printf '  }\n}\n' >> "$OUT"
+echo "results in $OUT"
+
+# everything generated has to reach the C compiler intact
+$CC -std=c11 -w "$TMP/prog.c" -o "$TMP/prog.bin"
+"$TMP/prog.bin"
+echo "generated program compiled and ran"
+
+if [ -n "$BASELINE" ]; then
+    failed=0
+    for p in $PHASES total; do
+        base=$(sed -n "s/.*\"$p\": {\"ms\": [0-9.]*, \"lines_per_sec\": \([0-9]*\).*/\1/p" "$BASELINE")
+        cur=$(sed -n "s/.*\"$p\": {\"ms\": [0-9.]*, \"lines_per_sec\": \([0-9]*\).*/\1/p" "$OUT")
+        [ -n "$base" ] && [ "$base" -gt 0 ] || continue
+        change=$(awk -v a="$cur" -v b="$base" 'BEGIN { printf "%+.1f", (a - b) / b * 100 }')
+        if awk -v c="$change" -v t="$THRESHOLD" 'BEGIN { exit !(c < -t) }'; then
+            echo "  $p: $change% lines/s against $BASELINE — REGRESSED"
+            failed=1
+        else
+            echo "  $p: $change% lines/s against $BASELINE"
+        fi
+    done
+    exit $failed
+fi
@@ -0,0 +1,96 @@
+/* synthetic large program for compiler throughput: writes main.mxy and a
+   chain of includes under outdir. Each unit is an enum matched on, a
+   function taking lambdas, and list and map instantiations of one of a
+   rotation of element types; main calls every unit and asserts their sum.
+   built and driven by scripts/compilebench.sh */
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+static const char *list_types[] = { "int", "float", "double", "char", "bool" };
+static const char *map_types[] = {
+    "map[int,int]", "map[int,long]", "map[string,int]", "map[string,double]", "map[long,int]"
+};
+#define NTYPES 5
+
+static FILE *open_out(const char *path) {
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        fprintf(stderr, "genprogram: cannot write '%s'\n", path);
+        exit(1);
+    }
+    return f;
+}
+
+/* what unit i adds to main's total */
+static long unit_value(int i) {
+    int k = i % 7;
+    return i + (2 + k) + 3 + 1;
+}
+
+static void write_unit(FILE *f, int i) {
+    int k = i % 7, t = i % NTYPES;
+
+    fprintf(f, "enum E%d {\n  A%d(int v),\n  B%d,\n  C%d\n}\n\n", i, i, i, i);
+    fprintf(f, "int e%d_value(E%d e) {\n  int out = 0;\n  match e {\n", i, i);
+    fprintf(f, "    E%d::A%d(v) => { out = v; },\n", i, i);
+    fprintf(f, "    E%d::B%d => { out = 2; },\n", i, i);
+    fprintf(f, "    E%d::C%d => { out = 3; },\n  }\n  return out;\n}\n\n", i, i);
+
+    fprintf(f, "int apply%d(int x, int fn(int)) {\n  return fn(x);\n}\n\n", i);
+    fprintf(f, "int lam%d(int x) {\n", i);
+    fprintf(f, "  int a = apply%d(x, (int n) => n + %d);\n", i, k);
+    fprintf(f, "  return apply%d(a, (int n) => {\n    int m = n * 2;\n    return m - %d;\n  });\n}\n\n",
+            i, k);
+
+    fprintf(f, "int list%d(int n) {\n  %s[] xs = [];\n", i, list_types[t]);
+    fprintf(f, "  for (int k = 0; k < n; k++) {\n    xs.push(k);\n  }\n  return xs.len;\n}\n\n");
+
+    /* keyed by int or by one of a few strings; either way one entry */
+    const char *key = map_types[t][4] == 's' ? "\"key\"" : "7";
+    fprintf(f, "int map%d(int n) {\n  %s m = {};\n", i, map_types[t]);
+    fprintf(f, "  for (int k = 0; k < n; k++) {\n    m.set(%s, k);\n  }\n  return m.len;\n}\n\n", key);
+
+    fprintf(f, "int unit%d() {\n  E%d e = E%d::A%d(%d);\n", i, i, i, i, i);
+    fprintf(f, "  return e%d_value(e) + lam%d(1) + list%d(3) + map%d(3);\n}\n\n", i, i, i, i);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: genprogram <outdir> [units] [include depth]\n");
+        return 1;
+    }
+    const char *dir = argv[1];
+    int units = argc > 2 ? atoi(argv[2]) : 1000;
+    int depth = argc > 3 ? atoi(argv[3]) : 32;
+    if (units < 1) units = 1;
+    if (depth < 1) depth = 1;
+
+    char path[4096];
+    mkdir(dir, 0755);
+    snprintf(path, sizeof(path), "%s/inc", dir);
+    mkdir(path, 0755);
+
+    /* part_d includes part_d+1, so the deepest part is `depth` levels in */
+    int per_part = (units + depth - 1) / depth;
+    for (int d = 0; d < depth; d++) {
+        snprintf(path, sizeof(path), "%s/inc/part_%d.mxy", dir, d);
+        FILE *f = open_out(path);
+        if (d + 1 < depth) fprintf(f, "#include \"part_%d.mxy\"\n\n", d + 1);
+        for (int i = d * per_part; i < (d + 1) * per_part && i < units; i++)
+            write_unit(f, i);
+        fclose(f);
+    }
+
+    snprintf(path, sizeof(path), "%s/main.mxy", dir);
+    FILE *f = open_out(path);
+    fprintf(f, "#include \"inc/part_0.mxy\"\n\nvoid main() {\n  long total = 0;\n");
+    long expected = 0;
+    for (int i = 0; i < units; i++) {
+        fprintf(f, "  total += unit%d();\n", i);
+        expected += unit_value(i);
+    }
+    fprintf(f, "  assert(total == %ld);\n}\n", expected);
+    fclose(f);
+    return 0;
+}
@@ -0,0 +1,54 @@
+/* lexer throughput: lexes a corpus repeatedly and reports MB/s.
+   built and driven by scripts/lexbench.sh */
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "lexer.h"
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: lexbench <corpus.mxy> [rounds]\n");
+        return 1;
+    }
+    int rounds = argc > 2 ? atoi(argv[2]) : 5;
+
+    FILE *f = fopen(argv[1], "rb");
+    if (!f) {
+        fprintf(stderr, "lexbench: cannot open '%s'\n", argv[1]);
+        return 1;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *src = malloc(size + 1);
+    if (fread(src, 1, size, f) != (size_t)size) {
+        fprintf(stderr, "lexbench: short read\n");
+        return 1;
+    }
+    src[size] = '\0';
+    fclose(f);
+
+    TokenList tl = {0};
+    double best = 0;
+    for (int r = 0; r < rounds; r++) {
+        Lexer lexer;
+        lexer_init(&lexer, src);
+        double t0 = now();
+        lexer_lex_all(&lexer, &tl);
+        double secs = now() - t0;
+        if (r == 0 || secs < best) best = secs;
+    }
+
+    printf("%.1f MB, %d tokens, best of %d: %.1f ms, %.1f MB/s\n",
+           size / 1e6, tl.count, rounds, best * 1e3, size / 1e6 / best);
+    token_list_free(&tl);
+    free(src);
+    return 0;
+}
@@ -0,0 +1,24 @@
+#!/bin/sh
+# Lexer throughput benchmark: builds scripts/lexbench.c against src/lexer.c
+# and lexes a synthetic corpus made by repeating the repo's .mxy sources.
+# Usage: sh scripts/lexbench.sh [size_mb] [rounds]
+set -e
+
+SIZE_MB="${1:-64}"
+ROUNDS="${2:-5}"
+CC="${CC:-cc}"
+CFLAGS="${CFLAGS:--O2}"
+TMP="${TMPDIR:-/tmp}/moxy_lexbench"
+
+mkdir -p "$TMP"
+$CC $CFLAGS -std=c11 -Isrc scripts/lexbench.c src/lexer.c src/intern.c -o "$TMP/lexbench"
+
+corpus="$TMP/corpus.mxy"
+: > "$corpus"
+cat examples/*.mxy examples/*/src/*.mxy examples/*/lib/*.mxy tests/*.mxy std/*.mxy > "$TMP/seed.mxy"
+limit=$((SIZE_MB * 1000000))
+while [ "$(wc -c < "$corpus")" -lt "$limit" ]; do
+    cat "$TMP/seed.mxy" "$TMP/seed.mxy" "$TMP/seed.mxy" "$TMP/seed.mxy" >> "$corpus"
+done
+
+"$TMP/lexbench" "$corpus" "$ROUNDS"
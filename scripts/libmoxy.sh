@@ -0,0 +1,26 @@
+#!/bin/sh
+# Builds libmoxy, the transpiler without the CLI, as build/lib/libmoxy.a and
+# build/lib/libmoxy.so. The API is src/moxy.h; link with -lpthread.
+# Usage: sh scripts/libmoxy.sh
+set -e
+
+CC="${CC:-cc}"
+CFLAGS="${CFLAGS:--O2}"
+AR="${AR:-ar}"
+OUT="build/lib"
+OBJ="$OUT/obj"
+
+SRCS="libmoxy preprocess lexer parser codegen ast diag intern flags mxystdlib"
+
+mkdir -p "$OBJ"
+objs=""
+for s in $SRCS; do
+    $CC $CFLAGS -std=c11 -fPIC -Isrc -c "src/$s.c" -o "$OBJ/$s.o"
+    objs="$objs $OBJ/$s.o"
+done
+
+rm -f "$OUT/libmoxy.a"
+$AR rcs "$OUT/libmoxy.a" $objs
+$CC -shared -o "$OUT/libmoxy.so" $objs -lpthread
+cp src/moxy.h "$OUT/moxy.h"
+echo "built $OUT/libmoxy.a $OUT/libmoxy.so"
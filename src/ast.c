@@ -1,9 +1,111 @@
 #include "ast.h"
+#include "flags.h"
 #include <stdlib.h>
 #include <string.h>
 
-Node *node_new(NodeKind kind) {
-    Node *n = calloc(1, sizeof(Node));
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+struct ArenaBlock {
+    ArenaBlock *next;
+    size_t cap;
+    size_t used;
+    _Alignas(max_align_t) char data[];
+};
+
+void *arena_alloc(Arena *a, size_t size) {
+    size = (size + _Alignof(max_align_t) - 1) & ~(_Alignof(max_align_t) - 1);
+    ArenaBlock *b = a->head;
+    if (!b || b->cap - b->used < size) {
+        size_t cap = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+        b = calloc(1, sizeof(ArenaBlock) + cap);
+        if (!b) abort();
+        moxy_alloc_bytes += sizeof(ArenaBlock) + cap;
+        b->cap = cap;
+        b->next = a->head;
+        a->head = b;
+    }
+    void *p = b->data + b->used;
+    b->used += size;
+    a->used += size;
+    return p;
+}
+
+char *arena_strndup(Arena *a, const char *s, int len) {
+    char *p = arena_alloc(a, len + 1);
+    memcpy(p, s, len);
+    p[len] = '\0';
+    return p;
+}
+
+void arena_free(Arena *a) {
+    ArenaBlock *b = a->head;
+    while (b) {
+        ArenaBlock *next = b->next;
+        free(b);
+        b = next;
+    }
+    a->head = NULL;
+    a->used = 0;
+}
+
+void *ast_grow(Arena *a, void *items, int count, size_t elem) {
+    if (count > 0 && (count < 4 || (count & (count - 1)) != 0)) return items;
+    int cap = count < 4 ? 4 : count * 2;
+    void *grown = arena_alloc(a, cap * elem);
+    if (count > 0) memcpy(grown, items, count * elem);
+    return grown;
+}
+
+#define NODE_SIZE(member) (offsetof(Node, member) + sizeof(((Node *)0)->member))
+
+static size_t node_size(NodeKind kind) {
+    switch (kind) {
+    case NODE_PROGRAM:       return NODE_SIZE(program);
+    case NODE_VAR_DECL:      return NODE_SIZE(var_decl);
+    case NODE_ENUM_DECL:     return NODE_SIZE(enum_decl);
+    case NODE_FUNC_DECL:     return NODE_SIZE(func_decl);
+    case NODE_PRINT_STMT:    return NODE_SIZE(print_stmt);
+    case NODE_ASSERT_STMT:   return NODE_SIZE(assert_stmt);
+    case NODE_MATCH_STMT:    return NODE_SIZE(match_stmt);
+    case NODE_EXPR_STMT:     return NODE_SIZE(expr_stmt);
+    case NODE_IF_STMT:       return NODE_SIZE(if_stmt);
+    case NODE_WHILE_STMT:    return NODE_SIZE(while_stmt);
+    case NODE_FOR_STMT:      return NODE_SIZE(for_stmt);
+    case NODE_RETURN_STMT:   return NODE_SIZE(return_stmt);
+    case NODE_BLOCK:         return NODE_SIZE(block);
+    case NODE_ASSIGN:        return NODE_SIZE(assign);
+    case NODE_EXPR_IDENT:    return NODE_SIZE(ident);
+    case NODE_EXPR_INTLIT:   return NODE_SIZE(intlit);
+    case NODE_EXPR_FLOATLIT: return NODE_SIZE(floatlit);
+    case NODE_EXPR_STRLIT:   return NODE_SIZE(strlit);
+    case NODE_EXPR_CHARLIT:  return NODE_SIZE(charlit);
+    case NODE_EXPR_BOOLLIT:  return NODE_SIZE(boollit);
+    case NODE_EXPR_NULL:     return offsetof(Node, program);
+    case NODE_EXPR_ENUM_INIT: return NODE_SIZE(enum_init);
+    case NODE_EXPR_LIST_LIT: return NODE_SIZE(list_lit);
+    case NODE_EXPR_OK:       return NODE_SIZE(ok_expr);
+    case NODE_EXPR_ERR:      return NODE_SIZE(err_expr);
+    case NODE_EXPR_METHOD:   return NODE_SIZE(method);
+    case NODE_EXPR_FIELD:    return NODE_SIZE(field);
+    case NODE_EXPR_INDEX:    return NODE_SIZE(index);
+    case NODE_EXPR_EMPTY:    return offsetof(Node, program);
+    case NODE_EXPR_CALL:     return NODE_SIZE(call);
+    case NODE_EXPR_BINOP:    return NODE_SIZE(binop);
+    case NODE_EXPR_UNARY:    return NODE_SIZE(unary);
+    case NODE_EXPR_PAREN:    return NODE_SIZE(paren);
+    case NODE_RAW:           return NODE_SIZE(raw);
+    case NODE_EXPR_TERNARY:  return NODE_SIZE(ternary);
+    case NODE_EXPR_CAST:     return NODE_SIZE(cast);
+    case NODE_FOR_IN_STMT:   return NODE_SIZE(for_in_stmt);
+    case NODE_EXPR_RANGE:    return NODE_SIZE(range);
+    case NODE_EXPR_AWAIT:    return NODE_SIZE(await_expr);
+    case NODE_EXPR_LAMBDA:   return NODE_SIZE(lambda);
+    }
+    return sizeof(Node);
+}
+
+Node *node_new(Arena *a, NodeKind kind) {
+    Node *n = arena_alloc(a, node_size(kind));
     n->kind = kind;
     return n;
 }
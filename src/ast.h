@@ -1,6 +1,8 @@
 #ifndef MOXY_AST_H
 #define MOXY_AST_H
 
+#include <stddef.h>
+
 typedef enum {
     NODE_PROGRAM,
     NODE_VAR_DECL,
@@ -53,7 +55,7 @@ typedef struct {
 
 typedef struct {
     char name[64];
-    Field fields[8];
+    Field *fields;
     int nfields;
 } Variant;
 
@@ -78,47 +80,61 @@ struct Node {
     int line;
     int col;
     union {
-        struct { Node *decls[256]; int ndecls; } program;
+        struct { Node **decls; int ndecls; } program;
         struct { char type[64]; char name[64]; Node *value; } var_decl;
-        struct { char name[64]; Variant variants[16]; int nvariants; } enum_decl;
-        struct { char ret[64]; char name[64]; Param params[16]; int nparams; Node *body[256]; int nbody; } func_decl;
+        struct { char name[64]; Variant *variants; int nvariants; } enum_decl;
+        struct { char ret[64]; char name[64]; Param *params; int nparams; Node **body; int nbody; } func_decl;
         struct { Node *arg; } print_stmt;
         struct { Node *arg; int line; } assert_stmt;
-        struct { char target[64]; MatchArm arms[16]; int narms; } match_stmt;
+        struct { char target[64]; MatchArm *arms; int narms; } match_stmt;
         struct { Node *expr; } expr_stmt;
         struct { Node *cond; Node *then_body; int nthen; Node *else_body; int nelse; } if_stmt;
-        struct { Node *cond; Node *body[256]; int nbody; } while_stmt;
-        struct { Node *init; Node *cond; Node *step; Node *body[256]; int nbody; } for_stmt;
+        struct { Node *cond; Node **body; int nbody; } while_stmt;
+        struct { Node *init; Node *cond; Node *step; Node **body; int nbody; } for_stmt;
         struct { Node *value; } return_stmt;
-        struct { Node *stmts[256]; int nstmts; } block;
+        struct { Node **stmts; int nstmts; } block;
         struct { Node *target; char op[4]; Node *value; } assign;
-        struct { char name[64]; } ident;
+        struct { char name[64]; int atom; } ident;
         struct { int value; char text[64]; } intlit;
         struct { char value[64]; } floatlit;
-        struct { char value[256]; } strlit;
+        struct { char *value; } strlit;
         struct { char value[8]; } charlit;
         struct { int value; } boollit;
-        struct { char ename[64]; char vname[64]; Node *args[8]; int nargs; } enum_init;
-        struct { Node *items[64]; int nitems; } list_lit;
+        struct { char ename[64]; char vname[64]; Node **args; int nargs; } enum_init;
+        struct { Node **items; int nitems; } list_lit;
         struct { Node *inner; } ok_expr;
         struct { Node *inner; } err_expr;
-        struct { Node *target; char name[64]; Node *args[8]; int nargs; int is_arrow; } method;
+        struct { Node *target; char name[64]; Node **args; int nargs; int is_arrow; } method;
         struct { Node *target; char name[64]; int is_arrow; } field;
         struct { Node *target; Node *idx; } index;
-        struct { char name[64]; Node *args[16]; int nargs; } call;
+        struct { char name[64]; int atom; Node **args; int nargs; } call;
         struct { char op[4]; Node *left; Node *right; } binop;
         struct { char op[4]; Node *operand; } unary;
         struct { Node *inner; } paren;
         struct { char *text; } raw;
         struct { Node *cond; Node *then_expr; Node *else_expr; } ternary;
         struct { char type_text[128]; Node *operand; } cast;
-        struct { char var1[64]; char var2[64]; Node *iter; Node *body[256]; int nbody; } for_in_stmt;
+        struct { char var1[64]; char var2[64]; Node *iter; Node **body; int nbody; } for_in_stmt;
         struct { Node *start; Node *end; } range;
         struct { Node *inner; } await_expr;
-        struct { Param params[16]; int nparams; Node *body; int is_expr; int id; } lambda;
+        struct { Param *params; int nparams; Node *body; int is_expr; int id; } lambda;
     };
 };
 
-Node *node_new(NodeKind kind);
+/* every node, child array and string of one compilation is carved out of
+   an arena and released in one go once codegen is done */
+typedef struct ArenaBlock ArenaBlock;
+typedef struct { ArenaBlock *head; size_t used; } Arena;
+
+void *arena_alloc(Arena *a, size_t size);
+char *arena_strndup(Arena *a, const char *s, int len);
+void arena_free(Arena *a);
+
+/* child arrays grow in place as the parser appends; capacity follows from
+   the count (4, 8, 16, ...), so nodes only carry the count */
+void *ast_grow(Arena *a, void *items, int count, size_t elem);
+
+/* allocates just the header plus the union member used by kind */
+Node *node_new(Arena *a, NodeKind kind);
 
 #endif
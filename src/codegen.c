@@ -1,86 +1,275 @@
 #include "codegen.h"
 #include "flags.h"
+#include "intern.h"
+#include "diag.h"
 #include <stdio.h>
 #include <stdarg.h>
+#include <ctype.h>
 #include <string.h>
 #include <stdlib.h>
 
-static char out[262144];
-static int outpos;
-static int indent;
-
-typedef struct { char name[64]; char type[64]; } Sym;
-static Sym syms[256];
-static int nsyms;
-
-typedef struct { char name[64]; Variant variants[16]; int nvariants; int simple; } EnumStore;
-static EnumStore enums[16];
-static int nenums;
-
-static char type_insts[32][64];
-static int ninsts;
-static int in_main;
-
-static char user_includes[64][256];
-static int nuser_includes;
-
-static char user_directives[128][512];
-static int nuser_directives;
-
-static int forin_counter;
-static int async_counter;
-static int has_futures;
-
-static Node *lambdas[64];
-static int nlambdas;
+/* all codegen state is per thread and reset by codegen_run (includes and
+   directives by codegen_reset_includes), so threads can generate separate
+   compilations at once */
+
+/* output sink: a growable buffer, or a fixed window that is flushed to
+   out_fp as it fills when streaming */
+#define OUT_CHUNK (64 * 1024)
+static _Thread_local char *out;
+static _Thread_local size_t outlen;
+static _Thread_local size_t outcap;
+static _Thread_local FILE *out_fp;
+static _Thread_local int indent;
+
+/* scoped symbol table: bindings form a stack of interned (name, type)
+   pairs, and a hash from name to its innermost binding keeps lookups O(1);
+   popping a scope restores whatever each name shadowed */
+typedef struct { int name; int type; int shadowed; } Sym;
+static _Thread_local Sym *syms;
+static _Thread_local int nsyms;
+static _Thread_local int syms_cap;
+
+typedef struct { int name; int top; } SymSlot;
+static _Thread_local SymSlot *sym_slots;
+static _Thread_local int nsym_slots;
+static _Thread_local int nsym_keys;
+
+static _Thread_local int *sym_scopes;
+static _Thread_local int nsym_scopes;
+static _Thread_local int sym_scopes_cap;
+
+typedef struct { int atom; Variant *variants; int nvariants; int simple; } EnumStore;
+static _Thread_local EnumStore *enums;
+static _Thread_local int nenums;
+static _Thread_local int enums_cap;
+
+static _Thread_local int *type_insts;
+static _Thread_local int ninsts;
+static _Thread_local int insts_cap;
+static _Thread_local int in_main;
+
+static _Thread_local char user_includes[64][256];
+static _Thread_local int nuser_includes;
+
+static _Thread_local char user_directives[128][512];
+static _Thread_local int nuser_directives;
+
+/* the shared runtime: under moxy_shared_rt, instantiations every file
+   could share are left to moxyrt.h and named here for the caller; rt_part
+   says how emit_list_type and emit_map_type write their functions */
+static _Thread_local char rt_types[64][128];
+static _Thread_local int nrt_types;
+enum { RT_STATIC, RT_DECL, RT_DEF };
+static _Thread_local int rt_part;
+
+static _Thread_local int forin_counter;
+static _Thread_local int async_counter;
+static _Thread_local int uses_slices;
+/* the declared T[..] a slice expression initializes, for targets such as
+   C arrays whose element type codegen cannot see */
+static _Thread_local const char *slice_hint;
+static _Thread_local int has_futures;
+
+static _Thread_local Node **lambdas;
+static _Thread_local int nlambdas;
+static _Thread_local int lambdas_cap;
 
 typedef struct { char name[64]; char type[64]; } ArcVar;
 typedef struct { ArcVar vars[32]; int nvars; } ArcScope;
-static ArcScope arc_scopes[16];
-static int arc_depth;
+static _Thread_local ArcScope arc_scopes[16];
+static _Thread_local int arc_depth;
+
+/* make room for n more bytes plus a terminating NUL */
+static void out_reserve(size_t n) {
+    if (outlen + n + 1 <= outcap) return;
+    if (out_fp && outlen > 0) {
+        fwrite(out, 1, outlen, out_fp);
+        outlen = 0;
+        if (n + 1 <= outcap) return;
+    }
+    size_t cap = outcap ? outcap : OUT_CHUNK;
+    while (cap < outlen + n + 1) cap *= 2;
+    out = realloc(out, cap);
+    if (!out) diag_fatal("out of memory");
+    moxy_alloc_bytes += cap;
+    outcap = cap;
+}
+
+static void emit_vfmt(const char *fmt, va_list ap) {
+    va_list again;
+    va_copy(again, ap);
+    size_t room = outcap - outlen;
+    int n = vsnprintf(out + outlen, room, fmt, ap);
+    if (n >= 0 && (size_t)n >= room) {
+        out_reserve(n);
+        vsnprintf(out + outlen, outcap - outlen, fmt, again);
+    }
+    va_end(again);
+    if (n > 0) outlen += n;
+}
 
 static void emit(const char *fmt, ...) {
     va_list ap;
     va_start(ap, fmt);
-    outpos += vsnprintf(out + outpos, sizeof(out) - outpos, fmt, ap);
+    emit_vfmt(fmt, ap);
     va_end(ap);
 }
 
+/* literal text skips the formatter */
+static void emit_str(const char *s) {
+    size_t n = strlen(s);
+    out_reserve(n);
+    memcpy(out + outlen, s, n + 1);
+    outlen += n;
+}
+
 static void emit_indent(void) {
-    for (int i = 0; i < indent; i++) emit("    ");
+    static const char spaces[] = "                                ";
+    size_t n = (size_t)indent * 4;
+    out_reserve(n);
+    for (size_t left = n; left > 0; ) {
+        size_t k = left < sizeof(spaces) - 1 ? left : sizeof(spaces) - 1;
+        memcpy(out + outlen, spaces, k);
+        outlen += k;
+        left -= k;
+    }
+    out[outlen] = '\0';
 }
 
 static void emitln(const char *fmt, ...) {
     emit_indent();
     va_list ap;
     va_start(ap, fmt);
-    outpos += vsnprintf(out + outpos, sizeof(out) - outpos, fmt, ap);
+    emit_vfmt(fmt, ap);
     va_end(ap);
-    emit("\n");
+    emit_str("\n");
+}
+
+static unsigned sym_hash(int name) {
+    return ((unsigned)name * 2654435761u) & (nsym_slots - 1);
+}
+
+static SymSlot *sym_find(int name) {
+    if (!nsym_slots) return NULL;
+    unsigned i = sym_hash(name);
+    while (sym_slots[i].name) {
+        if (sym_slots[i].name == name) return &sym_slots[i];
+        i = (i + 1) & (nsym_slots - 1);
+    }
+    return NULL;
+}
+
+static void sym_rehash(void) {
+    SymSlot *old = sym_slots;
+    int nold = nsym_slots;
+    nsym_slots = nsym_slots ? nsym_slots * 2 : 256;
+    sym_slots = calloc(nsym_slots, sizeof(SymSlot));
+    moxy_alloc_bytes += nsym_slots * sizeof(SymSlot);
+    for (int j = 0; j < nold; j++) {
+        if (!old[j].name) continue;
+        unsigned i = sym_hash(old[j].name);
+        while (sym_slots[i].name) i = (i + 1) & (nsym_slots - 1);
+        sym_slots[i] = old[j];
+    }
+    free(old);
+}
+
+static SymSlot *sym_slot(int name) {
+    SymSlot *s = sym_find(name);
+    if (s) return s;
+    if ((nsym_keys + 1) * 2 > nsym_slots) sym_rehash();
+    unsigned i = sym_hash(name);
+    while (sym_slots[i].name) i = (i + 1) & (nsym_slots - 1);
+    sym_slots[i].name = name;
+    sym_slots[i].top = -1;
+    nsym_keys++;
+    return &sym_slots[i];
 }
 
 static void sym_add(const char *name, const char *type) {
-    if (nsyms >= 256) return;
-    strncpy(syms[nsyms].name, name, 63);
-    syms[nsyms].name[63] = '\0';
-    strncpy(syms[nsyms].type, type, 63);
-    syms[nsyms].type[63] = '\0';
-    nsyms++;
+    int atom = intern_cstr(name);
+    SymSlot *s = sym_slot(atom);
+    if (nsyms >= syms_cap) {
+        syms_cap = syms_cap ? syms_cap * 2 : 256;
+        syms = realloc(syms, syms_cap * sizeof(Sym));
+        moxy_alloc_bytes += syms_cap * sizeof(Sym);
+    }
+    syms[nsyms].name = atom;
+    syms[nsyms].type = intern_cstr(type);
+    syms[nsyms].shadowed = s->top;
+    s->top = nsyms++;
+}
+
+static const char *sym_lookup(int name) {
+    SymSlot *s = sym_find(name);
+    if (!s || s->top < 0) return NULL;
+    return intern_text(syms[s->top].type);
+}
+
+static void sym_unwind(int mark) {
+    while (nsyms > mark) {
+        nsyms--;
+        sym_find(syms[nsyms].name)->top = syms[nsyms].shadowed;
+    }
+}
+
+static void sym_push_scope(void) {
+    if (nsym_scopes >= sym_scopes_cap) {
+        sym_scopes_cap = sym_scopes_cap ? sym_scopes_cap * 2 : 16;
+        sym_scopes = realloc(sym_scopes, sym_scopes_cap * sizeof(int));
+    }
+    sym_scopes[nsym_scopes++] = nsyms;
+}
+
+static void sym_pop_scope(void) {
+    if (nsym_scopes > 0) sym_unwind(sym_scopes[--nsym_scopes]);
 }
 
 static const char *sym_type(const char *name) {
-    for (int i = nsyms - 1; i >= 0; i--)
-        if (strcmp(syms[i].name, name) == 0) return syms[i].type;
-    return NULL;
+    return sym_lookup(intern_cstr(name));
+}
+
+/* a raw C declaration like "int arr[5] = {...};" records arr as int[5],
+   so arr[a..] can end at sizeof(arr); pointers and anything fancier are
+   left unrecorded */
+static void sym_add_raw_array(const char *text) {
+    const char *start = NULL, *name = NULL, *name_end = NULL, *p = text;
+    int words = 0;
+    for (;;) {
+        while (*p == ' ' || *p == '\t') p++;
+        if (!isalpha((unsigned char)*p) && *p != '_') break;
+        name = p;
+        if (!start) start = p;
+        while (isalnum((unsigned char)*p) || *p == '_') p++;
+        name_end = p;
+        words++;
+    }
+    const char *close = *p == '[' ? strchr(p, ']') : NULL;
+    if (words < 2 || !close || close == p + 1 || close[1] == '[') return;
+    int tlen = (int)(name - start);
+    while (tlen > 0 && (start[tlen - 1] == ' ' || start[tlen - 1] == '\t')) tlen--;
+    char nm[64], type[128];
+    snprintf(nm, sizeof(nm), "%.*s", (int)(name_end - name), name);
+    snprintf(type, sizeof(type), "%.*s%.*s", tlen, start, (int)(close - p + 1), p);
+    sym_add(nm, type);
 }
 
 static void inst_add(const char *type) {
+    int atom = intern_cstr(type);
     for (int i = 0; i < ninsts; i++)
-        if (strcmp(type_insts[i], type) == 0) return;
-    if (ninsts >= 32) return;
-    strncpy(type_insts[ninsts], type, 63);
-    type_insts[ninsts][63] = '\0';
-    ninsts++;
+        if (type_insts[i] == atom) return;
+    if (ninsts >= insts_cap) {
+        insts_cap = insts_cap ? insts_cap * 2 : 32;
+        type_insts = realloc(type_insts, insts_cap * sizeof(int));
+    }
+    type_insts[ninsts++] = atom;
+}
+
+static int inst_has(const char *type) {
+    int atom = intern_cstr(type);
+    for (int i = 0; i < ninsts; i++)
+        if (type_insts[i] == atom) return 1;
+    return 0;
 }
 
 void codegen_add_include(const char *line) {
@@ -104,6 +293,30 @@ void codegen_reset_includes(void) {
     nuser_directives = 0;
 }
 
+void codegen_release(void) {
+    free(out);
+    out = NULL;
+    outlen = outcap = 0;
+    free(syms);
+    syms = NULL;
+    nsyms = syms_cap = 0;
+    free(sym_slots);
+    sym_slots = NULL;
+    nsym_slots = nsym_keys = 0;
+    free(sym_scopes);
+    sym_scopes = NULL;
+    nsym_scopes = sym_scopes_cap = 0;
+    free(type_insts);
+    type_insts = NULL;
+    ninsts = insts_cap = 0;
+    free(enums);
+    enums = NULL;
+    nenums = enums_cap = 0;
+    free(lambdas);
+    lambdas = NULL;
+    nlambdas = lambdas_cap = 0;
+}
+
 static int is_list_type(const char *t) {
     int len = (int)strlen(t);
     return len >= 3 && t[len-2] == '[' && t[len-1] == ']';
@@ -121,6 +334,21 @@ static int is_future_type(const char *t) {
     return strncmp(t, "Future<", 7) == 0;
 }
 
+static int is_slice_type(const char *t) {
+    int len = (int)strlen(t);
+    return len >= 5 && strcmp(t + len - 4, "[..]") == 0;
+}
+
+/* a C array from a raw declaration, kept as T[N] (see sym_add_raw_array) */
+static int is_array_type(const char *t) {
+    int len = (int)strlen(t);
+    return len >= 4 && t[len-1] == ']' && t[len-2] != '[' && !is_slice_type(t);
+}
+
+static int is_slice_expr(Node *n) {
+    return n->kind == NODE_EXPR_INDEX && n->index.idx->kind == NODE_EXPR_RANGE;
+}
+
 static void future_inner(const char *t, char *buf) {
     int end = (int)strlen(t) - 1;
     strncpy(buf, t + 7, end - 7);
@@ -133,6 +361,12 @@ static void list_elem(const char *t, char *buf) {
     buf[len - 2] = '\0';
 }
 
+static void slice_elem(const char *t, char *buf) {
+    int len = (int)strlen(t);
+    memcpy(buf, t, len - 4);
+    buf[len - 4] = '\0';
+}
+
 static void result_inner(const char *t, char *buf) {
     int end = (int)strlen(t) - 1;
     strncpy(buf, t + 7, end - 7);
@@ -169,7 +403,7 @@ static const char *c_type_simple(const char *mxy) {
     return mxy;
 }
 
-static void c_type_buf(const char *mxy, char *buf) {
+static void c_type_compute(const char *mxy, char *buf) {
     if (strstr(mxy, "(*)")) {
         strcpy(buf, mxy);
         return;
@@ -180,6 +414,12 @@ static void c_type_buf(const char *mxy, char *buf) {
         snprintf(buf, 128, "list_%s", elem);
         return;
     }
+    if (is_slice_type(mxy)) {
+        char elem[64];
+        slice_elem(mxy, elem);
+        snprintf(buf, 128, "slice_%s", elem);
+        return;
+    }
     if (is_result_type(mxy)) {
         char inner[64];
         result_inner(mxy, inner);
@@ -220,6 +460,17 @@ static void c_type_buf(const char *mxy, char *buf) {
     strcpy(buf, c_type_simple(mxy));
 }
 
+/* the C spelling of a type never changes, so it is worked out once per
+   interned type */
+static void c_type_buf(const char *mxy, char *buf) {
+    AtomInfo *info = intern_info(intern_cstr(mxy));
+    if (!info->ctype) {
+        c_type_compute(mxy, buf);
+        info->ctype = intern_text(intern_cstr(buf));
+    }
+    strcpy(buf, info->ctype);
+}
+
 static const char *fmt_for_type(const char *t) {
     if (!t) return "%d";
     if (strcmp(t, "string") == 0) return "%s";
@@ -299,32 +550,58 @@ static const char *infer_type(Node *n) {
     case NODE_EXPR_STRLIT: return "string";
     case NODE_EXPR_CHARLIT: return "char";
     case NODE_EXPR_BOOLLIT: return "bool";
-    case NODE_EXPR_IDENT: return sym_type(n->ident.name);
+    case NODE_EXPR_IDENT: return sym_lookup(n->ident.atom);
     case NODE_EXPR_FIELD:
         if (strcmp(n->field.name, "len") == 0) return "int";
         return NULL;
     case NODE_EXPR_INDEX: {
         const char *tt = infer_type(n->index.target);
+        static _Thread_local char elem[64];
+        if (is_slice_expr(n)) {
+            if (tt && is_list_type(tt)) list_elem(tt, elem);
+            else if (tt && is_slice_type(tt)) slice_elem(tt, elem);
+            else if (tt && strcmp(tt, "string") == 0) strcpy(elem, "char");
+            else return slice_hint;
+            strcat(elem, "[..]");
+            return elem;
+        }
         if (tt && is_list_type(tt)) {
-            static char elem[64];
             list_elem(tt, elem);
             return elem;
         }
+        if (tt && is_slice_type(tt)) {
+            slice_elem(tt, elem);
+            return elem;
+        }
         return NULL;
     }
     case NODE_EXPR_METHOD: {
         const char *tt = infer_type(n->method.target);
+        if (tt && is_list_type(tt)) {
+            if (strcmp(n->method.name, "pop") == 0 || strcmp(n->method.name, "remove") == 0) {
+                static _Thread_local char elem[64];
+                list_elem(tt, elem);
+                return elem;
+            }
+        }
         if (tt && is_map_type(tt)) {
-            if (strcmp(n->method.name, "get") == 0) {
-                static char val[64];
+            const char *name = n->method.name;
+            static _Thread_local char val[64];
+            if (strcmp(name, "get") == 0 || strcmp(name, "get_or") == 0 ||
+                strcmp(name, "update") == 0) {
+                map_val(tt, val);
+                return val;
+            }
+            if (strcmp(name, "get_ptr") == 0 || strcmp(name, "entry") == 0) {
                 map_val(tt, val);
+                strcat(val, "*");
                 return val;
             }
-            if (strcmp(n->method.name, "has") == 0) return "bool";
+            if (strcmp(name, "has") == 0 || strcmp(name, "remove") == 0) return "bool";
         }
         return NULL;
     }
-    case NODE_EXPR_CALL: return sym_type(n->call.name);
+    case NODE_EXPR_CALL: return sym_lookup(n->call.atom);
     case NODE_EXPR_BINOP: {
         const char *op = n->binop.op;
         if (strcmp(op, "==") == 0 || strcmp(op, "!=") == 0 ||
@@ -335,12 +612,22 @@ static const char *infer_type(Node *n) {
         return infer_type(n->binop.left);
     }
     case NODE_EXPR_PAREN: return infer_type(n->paren.inner);
-    case NODE_EXPR_UNARY: return infer_type(n->unary.operand);
+    case NODE_EXPR_UNARY: {
+        const char *t = infer_type(n->unary.operand);
+        size_t len = t ? strlen(t) : 0;
+        if (strcmp(n->unary.op, "*") == 0 && len > 1 && len < 64 && t[len - 1] == '*') {
+            static _Thread_local char deref[64];
+            memcpy(deref, t, len - 1);
+            deref[len - 1] = '\0';
+            return deref;
+        }
+        return t;
+    }
     case NODE_EXPR_TERNARY: return infer_type(n->ternary.then_expr);
     case NODE_EXPR_AWAIT: {
         const char *ft = infer_type(n->await_expr.inner);
         if (ft && is_future_type(ft)) {
-            static char awbuf[64];
+            static _Thread_local char awbuf[64];
             future_inner(ft, awbuf);
             return awbuf;
         }
@@ -358,84 +645,222 @@ static const char *infer_type(Node *n) {
     }
 }
 
+/* the enum's atom remembers its slot; the slot is only trusted if it
+   still holds that atom, so stale slots from an earlier file are ignored */
+static EnumStore *enum_find(const char *ename) {
+    int atom = intern_cstr(ename);
+    int slot = intern_info(atom)->enum_slot - 1;
+    if (slot >= 0 && slot < nenums && enums[slot].atom == atom) return &enums[slot];
+    return NULL;
+}
+
+static Variant *enum_variant(const char *ename, const char *vname) {
+    EnumStore *e = enum_find(ename);
+    if (!e) return NULL;
+    for (int j = 0; j < e->nvariants; j++)
+        if (strcmp(e->variants[j].name, vname) == 0) return &e->variants[j];
+    return NULL;
+}
+
 static int is_simple_enum(const char *ename) {
-    for (int i = 0; i < nenums; i++)
-        if (strcmp(enums[i].name, ename) == 0) return enums[i].simple;
-    return 0;
+    EnumStore *e = enum_find(ename);
+    return e ? e->simple : 0;
 }
 
 static const char *enum_field_type(const char *ename, const char *vname, int idx) {
-    for (int i = 0; i < nenums; i++) {
-        if (strcmp(enums[i].name, ename) != 0) continue;
-        for (int j = 0; j < enums[i].nvariants; j++) {
-            if (strcmp(enums[i].variants[j].name, vname) != 0) continue;
-            if (idx < enums[i].variants[j].nfields)
-                return enums[i].variants[j].fields[idx].type;
-        }
-    }
+    Variant *v = enum_variant(ename, vname);
+    if (v && idx < v->nfields) return v->fields[idx].type;
     return "int";
 }
 
 static const char *enum_field_name(const char *ename, const char *vname, int idx) {
-    for (int i = 0; i < nenums; i++) {
-        if (strcmp(enums[i].name, ename) != 0) continue;
-        for (int j = 0; j < enums[i].nvariants; j++) {
-            if (strcmp(enums[i].variants[j].name, vname) != 0) continue;
-            if (idx < enums[i].variants[j].nfields)
-                return enums[i].variants[j].fields[idx].name;
-        }
-    }
+    Variant *v = enum_variant(ename, vname);
+    if (v && idx < v->nfields) return v->fields[idx].name;
     return "unknown";
 }
 
+static int is_builtin_type(const char *t) {
+    static const char *const names[] = {
+        "int", "float", "double", "char", "bool", "long", "short", "string", NULL
+    };
+    for (int i = 0; names[i]; i++)
+        if (strcmp(t, names[i]) == 0) return 1;
+    return 0;
+}
+
+/* lists and maps of builtins mean the same in every file. Project builds
+   turn ARC on for any file that uses them, so moxyrt holds the ARC layout;
+   a file without ARC keeps its own. */
+static int is_shared_type(const char *t) {
+    if (!moxy_shared_rt || !moxy_arc_enabled) return 0;
+    char a[64], b[64];
+    if (is_list_type(t)) {
+        list_elem(t, a);
+        return is_builtin_type(a);
+    }
+    if (is_map_type(t)) {
+        map_key(t, a);
+        map_val(t, b);
+        return is_builtin_type(a) && is_builtin_type(b);
+    }
+    return 0;
+}
+
+/* starts a collection function: a static definition in a generated file,
+   a prototype or an external definition in the shared runtime. Returns 0
+   when no body follows; the caller opens it. */
+static int rt_func(const char *fmt, ...) {
+    if (rt_part == RT_STATIC) emit_str("static ");
+    else if (rt_part == RT_DEF) emit_str("MOXYRT_FN ");
+    va_list ap;
+    va_start(ap, fmt);
+    emit_vfmt(fmt, ap);
+    va_end(ap);
+    if (rt_part == RT_DECL) {
+        emit_str(";\n");
+        return 0;
+    }
+    return 1;
+}
+
+/* An ARC list is only reached through its pointer, so its header keeps up
+   to 64 bytes of elements inline (at least one) and data points there until
+   the list outgrows them: a small list costs one malloc. A list without ARC
+   is a value that is copied around, so it cannot point into itself;
+   instead an empty one allocates nothing and a literal exactly its length. */
 static void emit_list_type(const char *mxy_type) {
     char elem[64], celem[64], tname[128];
     list_elem(mxy_type, elem);
     c_type_buf(elem, celem);
     c_type_buf(mxy_type, tname);
 
-    emit("typedef struct {\n");
-    if (moxy_arc_enabled) emit("    int _rc;\n");
-    emit("    %s *data;\n", celem);
-    emit("    int len;\n");
-    emit("    int cap;\n");
-    emit("} %s;\n\n", tname);
+    if (rt_part != RT_DEF) {
+        emit_str("typedef struct {\n");
+        if (moxy_arc_enabled) emit_str("    int _rc;\n");
+        emit("    %s *data;\n", celem);
+        emit_str("    int len;\n");
+        emit_str("    int cap;\n");
+        if (moxy_arc_enabled)
+            emit("    %s inl[sizeof(%s) < 64 ? 64 / sizeof(%s) : 1];\n", celem, celem, celem);
+        emit("} %s;\n\n", tname);
+    }
 
     if (moxy_arc_enabled) {
-        emit("static %s *%s_make(%s *init, int n) {\n", tname, tname, celem);
-        emit("    %s *l = (%s *)malloc(sizeof(%s));\n", tname, tname, tname);
-        emit("    l->_rc = 1;\n");
-        emit("    l->cap = n < 8 ? 8 : n;\n");
-        emit("    l->data = (%s*)malloc(l->cap * sizeof(%s));\n", celem, celem);
-        emit("    l->len = n;\n");
-        emit("    if (n > 0) memcpy(l->data, init, n * sizeof(%s));\n", celem);
-        emit("    return l;\n");
-        emit("}\n\n");
-    } else {
-        emit("static %s %s_make(%s *init, int n) {\n", tname, tname, celem);
+        if (rt_func("%s *%s_make(%s *init, int n)", tname, tname, celem)) {
+            emit_str(" {\n");
+            emit("    %s *l = (%s *)malloc(sizeof(%s));\n", tname, tname, tname);
+            emit_str("    l->_rc = 1;\n");
+            emit_str("    l->cap = (int)(sizeof(l->inl) / sizeof(l->inl[0]));\n");
+            emit_str("    l->data = l->inl;\n");
+            emit_str("    if (n > l->cap) {\n");
+            emit_str("        l->cap = n;\n");
+            emit("        l->data = (%s*)malloc(n * sizeof(%s));\n", celem, celem);
+            emit_str("    }\n");
+            emit_str("    l->len = n;\n");
+            emit("    if (n > 0) memcpy(l->data, init, n * sizeof(%s));\n", celem);
+            emit_str("    return l;\n");
+            emit_str("}\n\n");
+        }
+    } else if (rt_func("%s %s_make(%s *init, int n)", tname, tname, celem)) {
+        emit_str(" {\n");
         emit("    %s l;\n", tname);
-        emit("    l.cap = n < 8 ? 8 : n;\n");
-        emit("    l.data = (%s*)malloc(l.cap * sizeof(%s));\n", celem, celem);
-        emit("    l.len = n;\n");
+        emit_str("    l.cap = n;\n");
+        emit("    l.data = n > 0 ? (%s*)malloc(n * sizeof(%s)) : NULL;\n", celem, celem);
+        emit_str("    l.len = n;\n");
         emit("    if (n > 0) memcpy(l.data, init, n * sizeof(%s));\n", celem);
-        emit("    return l;\n");
-        emit("}\n\n");
+        emit_str("    return l;\n");
+        emit_str("}\n\n");
+    }
+
+    /* moves the elements to a buffer of cap elements, cap >= len */
+    if (rt_func("void %s_resize(%s *l, int cap)", tname, tname)) {
+        emit_str(" {\n");
+        if (moxy_arc_enabled) {
+            emit_str("    if (l->data == l->inl) {\n");
+            emit("        l->data = (%s*)malloc(cap * sizeof(%s));\n", celem, celem);
+            emit("        memcpy(l->data, l->inl, l->len * sizeof(%s));\n", celem);
+            emit_str("    } else {\n");
+            emit("        l->data = (%s*)realloc(l->data, cap * sizeof(%s));\n", celem, celem);
+            emit_str("    }\n");
+        } else {
+            emit("    l->data = (%s*)realloc(l->data, cap * sizeof(%s));\n", celem, celem);
+        }
+        emit_str("    l->cap = cap;\n");
+        emit_str("}\n\n");
+    }
+
+    if (rt_func("void %s_push(%s *l, %s val)", tname, tname, celem)) {
+        emit_str(" {\n");
+        emit("    if (l->len >= l->cap) %s_resize(l, l->cap < 8 ? 8 : l->cap * 2);\n", tname);
+        emit_str("    l->data[l->len++] = val;\n");
+        emit_str("}\n\n");
+    }
+
+    if (rt_func("void %s_reserve(%s *l, int n)", tname, tname)) {
+        emit_str(" {\n");
+        emit("    if (n > l->cap) %s_resize(l, n);\n", tname);
+        emit_str("}\n\n");
+    }
+
+    /* other may be l itself, whose buffer the resize can move */
+    const char *arrow = moxy_arc_enabled ? "->" : ".";
+    if (rt_func("void %s_extend(%s *l, %s %sother)", tname, tname, tname, moxy_arc_enabled ? "*" : "")) {
+        emit_str(" {\n");
+        emit("    int n = other%slen;\n", arrow);
+        emit("    %s *src = other%sdata;\n", celem, arrow);
+        emit_str("    int self = src == l->data;\n");
+        emit_str("    if (l->len + n > l->cap)\n");
+        emit("        %s_resize(l, l->len + n > l->cap * 2 ? l->len + n : l->cap * 2);\n", tname);
+        emit_str("    if (self) src = l->data;\n");
+        emit("    if (n > 0) memcpy(l->data + l->len, src, n * sizeof(%s));\n", celem);
+        emit_str("    l->len += n;\n");
+        emit_str("}\n\n");
+    }
+
+    if (rt_func("%s %s_pop(%s *l)", celem, tname, tname)) {
+        emit_str(" {\n");
+        emit("    return l->len > 0 ? l->data[--l->len] : (%s){0};\n", celem);
+        emit_str("}\n\n");
+    }
+
+    if (rt_func("void %s_insert(%s *l, int i, %s val)", tname, tname, celem)) {
+        emit_str(" {\n");
+        emit("    if (l->len >= l->cap) %s_resize(l, l->cap < 8 ? 8 : l->cap * 2);\n", tname);
+        emit("    memmove(l->data + i + 1, l->data + i, (l->len - i) * sizeof(%s));\n", celem);
+        emit_str("    l->data[i] = val;\n");
+        emit_str("    l->len++;\n");
+        emit_str("}\n\n");
+    }
+
+    if (rt_func("%s %s_remove(%s *l, int i)", celem, tname, tname)) {
+        emit_str(" {\n");
+        emit("    %s val = l->data[i];\n", celem);
+        emit("    memmove(l->data + i, l->data + i + 1, (l->len - i - 1) * sizeof(%s));\n", celem);
+        emit_str("    l->len--;\n");
+        emit_str("    return val;\n");
+        emit_str("}\n\n");
     }
 
-    emit("static void %s_push(%s *l, %s val) {\n", tname, tname, celem);
-    emit("    if (l->len >= l->cap) {\n");
-    emit("        l->cap = l->cap < 8 ? 8 : l->cap * 2;\n");
-    emit("        l->data = (%s*)realloc(l->data, l->cap * sizeof(%s));\n", celem, celem);
-    emit("    }\n");
-    emit("    l->data[l->len++] = val;\n");
-    emit("}\n\n");
+    if (rt_func("void %s_clear(%s *l)", tname, tname))
+        emit_str(" { l->len = 0; }\n");
+
+    if (rt_func("void %s_truncate(%s *l, int n)", tname, tname))
+        emit_str(" { if (n >= 0 && n < l->len) l->len = n; }\n");
+    if (rt_part != RT_DECL) emit_str("\n");
 
     if (moxy_arc_enabled) {
-        emit("static void %s_retain(%s *l) { if (l) l->_rc++; }\n", tname, tname);
-        emit("static void %s_release(%s *l) {\n", tname, tname);
-        emit("    if (l && --l->_rc == 0) { free(l->data); free(l); }\n");
-        emit("}\n\n");
+        if (rt_func("void %s_retain(%s *l)", tname, tname))
+            emit_str(" { if (l) l->_rc++; }\n");
+        if (rt_func("void %s_release(%s *l)", tname, tname)) {
+            emit_str(" {\n");
+            emit_str("    if (l && --l->_rc == 0) {\n");
+            emit_str("        if (l->data != l->inl) free(l->data);\n");
+            emit_str("        free(l);\n");
+            emit_str("    }\n");
+            emit_str("}\n\n");
+        }
     }
+    if (rt_part == RT_DECL) emit_str("\n");
 }
 
 static void emit_result_type(const char *mxy_type) {
@@ -447,24 +872,55 @@ static void emit_result_type(const char *mxy_type) {
     int inner_arc = is_arc_type(inner);
 
     emit("typedef enum { %s_Ok, %s_Err } %s_Tag;\n", tname, tname, tname);
-    emit("typedef struct {\n");
+    emit_str("typedef struct {\n");
     emit("    %s_Tag tag;\n", tname);
-    emit("    union {\n");
+    emit_str("    union {\n");
     if (inner_arc)
         emit("        %s *ok;\n", cinner);
     else
         emit("        %s ok;\n", cinner);
-    emit("        const char* err;\n");
-    emit("    };\n");
+    emit_str("        const char* err;\n");
+    emit_str("    };\n");
     emit("} %s;\n\n", tname);
 
     if (inner_arc) {
         emit("static void %s_cleanup(%s *r) {\n", tname, tname);
         emit("    if (r->tag == %s_Ok && r->ok) %s_release(r->ok);\n", tname, cinner);
-        emit("}\n\n");
+        emit_str("}\n\n");
     }
 }
 
+/* the body of a map's _hash function for key type k: FNV-1a for strings,
+   a 64-bit mix of the bits for floats (0.0 and -0.0 hash alike) and of the
+   value for everything else, folded to 32 bits */
+static void emit_map_hash(const char *k) {
+    if (strcmp(k, "string") == 0) {
+        emit_str("    unsigned h = 2166136261u;\n");
+        emit_str("    for (const char *p = key; *p; p++) h = (h ^ (unsigned char)*p) * 16777619u;\n");
+        emit_str("    return h ^ (h >> 16);\n");
+        return;
+    }
+    if (strcmp(k, "float") == 0 || strcmp(k, "double") == 0) {
+        emit_str("    unsigned long long x = 0;\n");
+        emit_str("    if (key != 0) memcpy(&x, &key, sizeof(key));\n");
+    } else {
+        emit_str("    unsigned long long x = (unsigned long long)key;\n");
+    }
+    emit_str("    x ^= x >> 33;\n");
+    emit_str("    x *= 0xff51afd7ed558ccdULL;\n");
+    emit_str("    x ^= x >> 33;\n");
+    emit_str("    return (unsigned)x;\n");
+}
+
+/* A map keeps its entries dense, which is what for-in and .len see. They
+   are in insertion order until the first remove, which fills the hole
+   with the last entry; after that the order is unspecified. An
+   open-addressing table of (hash, entry + 1) slots probed Robin Hood
+   style indexes them. A lookup compares
+   cached hashes before keys and stops at the first slot closer to its
+   home than the key would be. The table stays under 3/4 full. Lookups
+   go through _find and anything that may add a key through _upsert, so
+   each method probes once (remove twice, to re-point the moved entry). */
 static void emit_map_type(const char *mxy_type) {
     char k[64], v[64], ck[64], cv[64], tname[128];
     map_key(mxy_type, k);
@@ -475,65 +931,206 @@ static void emit_map_type(const char *mxy_type) {
 
     int key_is_str = (strcmp(k, "string") == 0);
 
-    emit("typedef struct {\n");
-    if (moxy_arc_enabled) emit("    int _rc;\n");
-    emit("    struct { %s key; %s val; } *entries;\n", ck, cv);
-    emit("    int len;\n");
-    emit("    int cap;\n");
-    emit("} %s;\n\n", tname);
+    if (rt_part != RT_DEF) {
+        emit_str("typedef struct {\n");
+        if (moxy_arc_enabled) emit_str("    int _rc;\n");
+        emit("    struct { %s key; %s val; } *entries;\n", ck, cv);
+        emit("    struct %s_slot { unsigned hash; int idx; } *slots;\n", tname);
+        emit_str("    int len;\n");
+        emit_str("    int cap;\n");
+        emit_str("    int nslots;\n");
+        emit("} %s;\n\n", tname);
+    }
 
     if (moxy_arc_enabled) {
-        emit("static %s *%s_make(void) {\n", tname, tname);
-        emit("    %s *m = (%s *)malloc(sizeof(%s));\n", tname, tname, tname);
-        emit("    m->_rc = 1;\n");
-        emit("    m->cap = 8;\n");
-        emit("    m->entries = malloc(m->cap * sizeof(*m->entries));\n");
-        emit("    m->len = 0;\n");
-        emit("    return m;\n");
-        emit("}\n\n");
-    } else {
-        emit("static %s %s_make(void) {\n", tname, tname);
+        if (rt_func("%s *%s_make(void)", tname, tname)) {
+            emit_str(" {\n");
+            emit("    %s *m = (%s *)malloc(sizeof(%s));\n", tname, tname, tname);
+            emit_str("    m->_rc = 1;\n");
+            emit_str("    m->cap = 8;\n");
+            emit_str("    m->entries = malloc(m->cap * sizeof(*m->entries));\n");
+            emit_str("    m->nslots = 16;\n");
+            emit_str("    m->slots = calloc(m->nslots, sizeof(*m->slots));\n");
+            emit_str("    m->len = 0;\n");
+            emit_str("    return m;\n");
+            emit_str("}\n\n");
+        }
+    } else if (rt_func("%s %s_make(void)", tname, tname)) {
+        emit_str(" {\n");
         emit("    %s m;\n", tname);
-        emit("    m.cap = 8;\n");
-        emit("    m.entries = malloc(m.cap * sizeof(*m.entries));\n");
-        emit("    m.len = 0;\n");
-        emit("    return m;\n");
-        emit("}\n\n");
-    }
-
-    const char *cmp = key_is_str ? "strcmp(m->entries[i].key, key) == 0" : "m->entries[i].key == key";
-
-    emit("static void %s_set(%s *m, %s key, %s val) {\n", tname, tname, ck, cv);
-    emit("    for (int i = 0; i < m->len; i++) {\n");
-    emit("        if (%s) { m->entries[i].val = val; return; }\n", cmp);
-    emit("    }\n");
-    emit("    if (m->len >= m->cap) {\n");
-    emit("        m->cap *= 2;\n");
-    emit("        m->entries = realloc(m->entries, m->cap * sizeof(*m->entries));\n");
-    emit("    }\n");
-    emit("    m->entries[m->len].key = key;\n");
-    emit("    m->entries[m->len].val = val;\n");
-    emit("    m->len++;\n");
-    emit("}\n\n");
-
-    emit("static %s %s_get(%s *m, %s key) {\n", cv, tname, tname, ck);
-    emit("    for (int i = 0; i < m->len; i++)\n");
-    emit("        if (%s) return m->entries[i].val;\n", cmp);
-    emit("    return (%s){0};\n", cv);
-    emit("}\n\n");
-
-    emit("static bool %s_has(%s *m, %s key) {\n", tname, tname, ck);
-    emit("    for (int i = 0; i < m->len; i++)\n");
-    emit("        if (%s) return true;\n", cmp);
-    emit("    return false;\n");
-    emit("}\n\n");
+        emit_str("    m.cap = 8;\n");
+        emit_str("    m.entries = malloc(m.cap * sizeof(*m.entries));\n");
+        emit_str("    m.nslots = 16;\n");
+        emit_str("    m.slots = calloc(m.nslots, sizeof(*m.slots));\n");
+        emit_str("    m.len = 0;\n");
+        emit_str("    return m;\n");
+        emit_str("}\n\n");
+    }
+
+    if (rt_func("unsigned %s_hash(%s key)", tname, ck)) {
+        emit_str(" {\n");
+        emit_map_hash(k);
+        emit_str("}\n\n");
+    }
+
+    const char *eq = key_is_str ? "strcmp(m->entries[m->slots[i].idx - 1].key, key) == 0"
+                                : "m->entries[m->slots[i].idx - 1].key == key";
+
+    /* the slot holding key, or -1 */
+    if (rt_func("int %s_find(%s *m, %s key, unsigned h)", tname, tname, ck)) {
+        emit_str(" {\n");
+        emit_str("    unsigned mask = m->nslots - 1;\n");
+        emit_str("    for (unsigned i = h & mask, d = 0; m->slots[i].idx; i = (i + 1) & mask, d++) {\n");
+        emit_str("        if (((i - m->slots[i].hash) & mask) < d) break;\n");
+        emit("        if (m->slots[i].hash == h && %s) return (int)i;\n", eq);
+        emit_str("    }\n");
+        emit_str("    return -1;\n");
+        emit_str("}\n\n");
+    }
+
+    /* puts (h, idx) at slot i, d steps from its home, and moves the
+       entries it displaces further along */
+    if (rt_func("void %s_place(%s *m, unsigned i, unsigned d, unsigned h, int idx)", tname, tname)) {
+        emit_str(" {\n");
+        emit_str("    unsigned mask = m->nslots - 1;\n");
+        emit_str("    for (;; i = (i + 1) & mask, d++) {\n");
+        emit_str("        if (!m->slots[i].idx) {\n");
+        emit_str("            m->slots[i].hash = h;\n");
+        emit_str("            m->slots[i].idx = idx;\n");
+        emit_str("            return;\n");
+        emit_str("        }\n");
+        emit_str("        unsigned sd = (i - m->slots[i].hash) & mask;\n");
+        emit_str("        if (sd < d) {\n");
+        emit_str("            unsigned th = m->slots[i].hash;\n");
+        emit_str("            int ti = m->slots[i].idx;\n");
+        emit_str("            m->slots[i].hash = h;\n");
+        emit_str("            m->slots[i].idx = idx;\n");
+        emit_str("            h = th;\n");
+        emit_str("            idx = ti;\n");
+        emit_str("            d = sd;\n");
+        emit_str("        }\n");
+        emit_str("    }\n");
+        emit_str("}\n\n");
+    }
+
+    if (rt_func("void %s_grow(%s *m)", tname, tname)) {
+        emit_str(" {\n");
+        emit("    struct %s_slot *old = m->slots;\n", tname);
+        emit_str("    int n = m->nslots;\n");
+        emit_str("    m->nslots = n * 2;\n");
+        emit_str("    m->slots = calloc(m->nslots, sizeof(*m->slots));\n");
+        emit_str("    for (int i = 0; i < n; i++)\n");
+        emit("        if (old[i].idx) %s_place(m, old[i].hash & (m->nslots - 1), 0, old[i].hash, old[i].idx);\n",
+             tname);
+        emit_str("    free(old);\n");
+        emit_str("}\n\n");
+    }
+
+    /* the entry of key, added with a zero value if missing. One probe
+       finds the key or the slot a new entry belongs in. */
+    if (rt_func("int %s_upsert(%s *m, %s key, unsigned h)", tname, tname, ck)) {
+        emit_str(" {\n");
+        emit("    if ((m->len + 1) * 4 > m->nslots * 3) %s_grow(m);\n", tname);
+        emit_str("    unsigned mask = m->nslots - 1;\n");
+        emit_str("    unsigned i = h & mask, d = 0;\n");
+        emit_str("    for (; m->slots[i].idx; i = (i + 1) & mask, d++) {\n");
+        emit_str("        if (((i - m->slots[i].hash) & mask) < d) break;\n");
+        emit("        if (m->slots[i].hash == h && %s) return m->slots[i].idx - 1;\n", eq);
+        emit_str("    }\n");
+        emit_str("    if (m->len >= m->cap) {\n");
+        emit_str("        m->cap *= 2;\n");
+        emit_str("        m->entries = realloc(m->entries, m->cap * sizeof(*m->entries));\n");
+        emit_str("    }\n");
+        emit_str("    int e = m->len++;\n");
+        emit_str("    m->entries[e].key = key;\n");
+        emit("    m->entries[e].val = (%s){0};\n", cv);
+        emit("    %s_place(m, i, d, h, e + 1);\n", tname);
+        emit_str("    return e;\n");
+        emit_str("}\n\n");
+    }
+
+    if (rt_func("void %s_set(%s *m, %s key, %s val)", tname, tname, ck, cv)) {
+        emit_str(" {\n");
+        emit("    int e = %s_upsert(m, key, %s_hash(key));\n", tname, tname);
+        emit_str("    m->entries[e].val = val;\n");
+        emit_str("}\n\n");
+    }
+
+    if (rt_func("%s %s_get(%s *m, %s key)", cv, tname, tname, ck)) {
+        emit_str(" {\n");
+        emit("    int s = %s_find(m, key, %s_hash(key));\n", tname, tname);
+        emit("    return s >= 0 ? m->entries[m->slots[s].idx - 1].val : (%s){0};\n", cv);
+        emit_str("}\n\n");
+    }
+
+    if (rt_func("bool %s_has(%s *m, %s key)", tname, tname, ck)) {
+        emit_str(" {\n");
+        emit("    return %s_find(m, key, %s_hash(key)) >= 0;\n", tname, tname);
+        emit_str("}\n\n");
+    }
+
+    if (rt_func("%s %s_get_or(%s *m, %s key, %s dflt)", cv, tname, tname, ck, cv)) {
+        emit_str(" {\n");
+        emit("    int s = %s_find(m, key, %s_hash(key));\n", tname, tname);
+        emit_str("    return s >= 0 ? m->entries[m->slots[s].idx - 1].val : dflt;\n");
+        emit_str("}\n\n");
+    }
+
+    /* points into the entries array, so only valid until the map next grows */
+    if (rt_func("%s *%s_get_ptr(%s *m, %s key)", cv, tname, tname, ck)) {
+        emit_str(" {\n");
+        emit("    int s = %s_find(m, key, %s_hash(key));\n", tname, tname);
+        emit_str("    return s >= 0 ? &m->entries[m->slots[s].idx - 1].val : NULL;\n");
+        emit_str("}\n\n");
+    }
+
+    if (rt_func("%s *%s_entry(%s *m, %s key)", cv, tname, tname, ck)) {
+        emit_str(" {\n");
+        emit("    int e = %s_upsert(m, key, %s_hash(key));\n", tname, tname);
+        emit_str("    return &m->entries[e].val;\n");
+        emit_str("}\n\n");
+    }
+
+    if (rt_func("%s %s_update(%s *m, %s key, %s (*fn)(%s))", cv, tname, tname, ck, cv, cv)) {
+        emit_str(" {\n");
+        emit("    int e = %s_upsert(m, key, %s_hash(key));\n", tname, tname);
+        emit_str("    return m->entries[e].val = fn(m->entries[e].val);\n");
+        emit_str("}\n\n");
+    }
+
+    /* shifts the probe run back over the freed slot and moves the last
+       entry into the freed entry, so entries stay dense */
+    if (rt_func("bool %s_remove(%s *m, %s key)", tname, tname, ck)) {
+        emit_str(" {\n");
+        emit("    int s = %s_find(m, key, %s_hash(key));\n", tname, tname);
+        emit_str("    if (s < 0) return false;\n");
+        emit_str("    unsigned mask = m->nslots - 1;\n");
+        emit_str("    int e = m->slots[s].idx - 1;\n");
+        emit_str("    unsigned i = (unsigned)s;\n");
+        emit_str("    for (unsigned j = (i + 1) & mask; m->slots[j].idx && ((j - m->slots[j].hash) & mask);\n");
+        emit_str("         i = j, j = (j + 1) & mask)\n");
+        emit_str("        m->slots[i] = m->slots[j];\n");
+        emit_str("    m->slots[i].idx = 0;\n");
+        emit_str("    int last = --m->len;\n");
+        emit_str("    if (e != last) {\n");
+        emit("        int t = %s_find(m, m->entries[last].key, %s_hash(m->entries[last].key));\n", tname, tname);
+        emit_str("        m->slots[t].idx = e + 1;\n");
+        emit_str("        m->entries[e] = m->entries[last];\n");
+        emit_str("    }\n");
+        emit_str("    return true;\n");
+        emit_str("}\n\n");
+    }
 
     if (moxy_arc_enabled) {
-        emit("static void %s_retain(%s *m) { if (m) m->_rc++; }\n", tname, tname);
-        emit("static void %s_release(%s *m) {\n", tname, tname);
-        emit("    if (m && --m->_rc == 0) { free(m->entries); free(m); }\n");
-        emit("}\n\n");
+        if (rt_func("void %s_retain(%s *m)", tname, tname))
+            emit_str(" { if (m) m->_rc++; }\n");
+        if (rt_func("void %s_release(%s *m)", tname, tname)) {
+            emit_str(" {\n");
+            emit_str("    if (m && --m->_rc == 0) { free(m->entries); free(m->slots); free(m); }\n");
+            emit_str("}\n\n");
+        }
     }
+    if (rt_part == RT_DECL) emit_str("\n");
 }
 
 static void emit_future_type(const char *mxy_type) {
@@ -546,9 +1143,104 @@ static void emit_future_type(const char *mxy_type) {
          strcmp(inner, "void") == 0 ? "int" : cinner, tname);
 }
 
+/* a slice is a view: a pointer into elements someone else owns and a
+   length. It is copied by value and never retained or freed. */
+static void emit_slice_type(const char *mxy_type) {
+    char elem[64], celem[64], tname[128];
+    slice_elem(mxy_type, elem);
+    c_type_buf(elem, celem);
+    c_type_buf(mxy_type, tname);
+
+    emit_str("typedef struct {\n");
+    emit("    %s *data;\n", celem);
+    emit_str("    int len;\n");
+    emit("} %s;\n\n", tname);
+    emit("static %s %s_of(%s *data, int a, int b) {\n", tname, tname, celem);
+    emit("    return (%s){ data + a, b > a ? b - a : 0 };\n", tname);
+    emit_str("}\n\n");
+
+    /* x[a..] takes its end from x, so x is passed whole and evaluated once */
+    emit("static %s %s_from(%s s, int a) {\n", tname, tname, tname);
+    emit("    return %s_of(s.data, a, s.len);\n", tname);
+    emit_str("}\n\n");
+    char list[72], clist[128];
+    snprintf(list, sizeof(list), "%s[]", elem);
+    if (inst_has(list)) {
+        const char *ref = is_arc_type(list) ? " *" : " ";
+        const char *dot = is_arc_type(list) ? "->" : ".";
+        c_type_buf(list, clist);
+        emit("static %s %s_from_list(%s%sl, int a) {\n", tname, tname, clist, ref);
+        emit("    return %s_of(l%sdata, a, l%slen);\n", tname, dot, dot);
+        emit_str("}\n\n");
+    }
+    if (strcmp(elem, "char") == 0) {
+        emit("static %s %s_from_str(const char *s, int a) {\n", tname, tname);
+        emit("    return %s_of((char *)s, a, (int)strlen(s));\n", tname);
+        emit_str("}\n\n");
+    }
+}
+
 static void gen_expr(Node *n);
 static void gen_stmt(Node *n);
 
+/* x[a..b] views x's elements from a up to b; a left-out bound is the
+   start or the end. x is a list, a slice, a string or, given slice_hint,
+   a C array or pointer; a pointer has no end to leave out. Like x[i], the
+   bounds are not checked. */
+static void gen_slice(Node *n) {
+    Node *target = n->index.target;
+    Node *range = n->index.idx;
+    const char *st = infer_type(n);
+    if (!st) {
+        diag_error(n->line, n->col, "cannot tell what this slices");
+        diag_hint("declare the slice with its type, as in: int[..] s = arr[1..4];");
+        diag_bail();
+    }
+    char tname[128];
+    c_type_buf(st, tname);
+    const char *tt = infer_type(target);
+    int list = tt && is_list_type(tt);
+    int coll = list || (tt && is_slice_type(tt));
+    int str = tt && strcmp(tt, "string") == 0;
+    int array = tt && is_array_type(tt);
+    const char *dot = tt && is_arc_type(tt) ? "->" : ".";
+
+    if (!range->range.end && (coll || str)) {
+        emit("%s_from%s(", tname, list ? "_list" : str ? "_str" : "");
+        gen_expr(target);
+        emit_str(", ");
+        if (range->range.start) gen_expr(range->range.start);
+        else emit_str("0");
+        emit_str(")");
+        return;
+    }
+    if (!range->range.end && !array) {
+        diag_error(n->line, n->col, "cannot tell where this slice ends");
+        diag_hint("only lists, slices, strings and C arrays know their length; give the end, as in: p[1..n]");
+        diag_bail();
+    }
+
+    emit("%s_of(", tname);
+    if (str) emit_str("(char *)");
+    gen_expr(target);
+    if (coll) emit("%sdata", dot);
+    emit_str(", ");
+    if (range->range.start) gen_expr(range->range.start);
+    else emit_str("0");
+    emit_str(", ");
+    if (range->range.end) {
+        gen_expr(range->range.end);
+    } else {
+        /* sizeof does not evaluate its operand */
+        emit_str("(int)(sizeof(");
+        gen_expr(target);
+        emit_str(") / sizeof((");
+        gen_expr(target);
+        emit_str(")[0]))");
+    }
+    emit_str(")");
+}
+
 static void gen_expr(Node *n) {
     switch (n->kind) {
     case NODE_EXPR_STRLIT:
@@ -567,15 +1259,15 @@ static void gen_expr(Node *n) {
         emit("%s", n->boollit.value ? "true" : "false");
         break;
     case NODE_EXPR_NULL:
-        emit("NULL");
+        emit_str("NULL");
         break;
     case NODE_EXPR_IDENT:
         emit("%s", n->ident.name);
         break;
     case NODE_EXPR_PAREN:
-        emit("(");
+        emit_str("(");
         gen_expr(n->paren.inner);
-        emit(")");
+        emit_str(")");
         break;
     case NODE_EXPR_BINOP:
         gen_expr(n->binop.left);
@@ -585,10 +1277,10 @@ static void gen_expr(Node *n) {
     case NODE_EXPR_UNARY:
         if (strcmp(n->unary.op, "p++") == 0) {
             gen_expr(n->unary.operand);
-            emit("++");
+            emit_str("++");
         } else if (strcmp(n->unary.op, "p--") == 0) {
             gen_expr(n->unary.operand);
-            emit("--");
+            emit_str("--");
         } else {
             emit("%s", n->unary.op);
             gen_expr(n->unary.operand);
@@ -601,23 +1293,17 @@ static void gen_expr(Node *n) {
             emit("%s_%s", en, vn);
         } else {
             emit("(%s){ .tag = %s_%s", en, en, vn);
-            for (int i = 0; i < nenums; i++) {
-                if (strcmp(enums[i].name, en) != 0) continue;
-                for (int j = 0; j < enums[i].nvariants; j++) {
-                    if (strcmp(enums[i].variants[j].name, vn) != 0) continue;
-                    Variant *v = &enums[i].variants[j];
-                    if (v->nfields > 0) {
-                        emit(", .%s = { ", vn);
-                        for (int k = 0; k < v->nfields && k < n->enum_init.nargs; k++) {
-                            if (k > 0) emit(", ");
-                            emit(".%s = ", v->fields[k].name);
-                            gen_expr(n->enum_init.args[k]);
-                        }
-                        emit(" }");
-                    }
+            Variant *v = enum_variant(en, vn);
+            if (v && v->nfields > 0) {
+                emit(", .%s = { ", vn);
+                for (int k = 0; k < v->nfields && k < n->enum_init.nargs; k++) {
+                    if (k > 0) emit_str(", ");
+                    emit(".%s = ", v->fields[k].name);
+                    gen_expr(n->enum_init.args[k]);
                 }
+                emit_str(" }");
             }
-            emit(" }");
+            emit_str(" }");
         }
         break;
     }
@@ -633,18 +1319,24 @@ static void gen_expr(Node *n) {
         break;
     }
     case NODE_EXPR_INDEX: {
+        if (is_slice_expr(n)) {
+            gen_slice(n);
+            break;
+        }
         const char *tt = infer_type(n->index.target);
         gen_expr(n->index.target);
         if (tt && is_list_type(tt)) {
             if (is_arc_type(tt))
-                emit("->data[");
+                emit_str("->data[");
             else
-                emit(".data[");
+                emit_str(".data[");
+        } else if (tt && is_slice_type(tt)) {
+            emit_str(".data[");
         } else {
-            emit("[");
+            emit_str("[");
         }
         gen_expr(n->index.idx);
-        emit("]");
+        emit_str("]");
         break;
     }
     case NODE_EXPR_METHOD: {
@@ -652,10 +1344,10 @@ static void gen_expr(Node *n) {
             gen_expr(n->method.target);
             emit("->%s(", n->method.name);
             for (int i = 0; i < n->method.nargs; i++) {
-                if (i > 0) emit(", ");
+                if (i > 0) emit_str(", ");
                 gen_expr(n->method.args[i]);
             }
-            emit(")");
+            emit_str(")");
         } else {
             const char *tt = NULL;
             if (n->method.target->kind == NODE_EXPR_IDENT)
@@ -672,20 +1364,20 @@ static void gen_expr(Node *n) {
             }
             gen_expr(n->method.target);
             for (int i = 0; i < n->method.nargs; i++) {
-                emit(", ");
+                emit_str(", ");
                 gen_expr(n->method.args[i]);
             }
-            emit(")");
+            emit_str(")");
         }
         break;
     }
     case NODE_EXPR_CALL:
         emit("%s(", n->call.name);
         for (int i = 0; i < n->call.nargs; i++) {
-            if (i > 0) emit(", ");
+            if (i > 0) emit_str(", ");
             gen_expr(n->call.args[i]);
         }
-        emit(")");
+        emit_str(")");
         break;
     case NODE_EXPR_EMPTY:
     case NODE_EXPR_OK:
@@ -696,9 +1388,9 @@ static void gen_expr(Node *n) {
         break;
     case NODE_EXPR_TERNARY:
         gen_expr(n->ternary.cond);
-        emit(" ? ");
+        emit_str(" ? ");
         gen_expr(n->ternary.then_expr);
-        emit(" : ");
+        emit_str(" : ");
         gen_expr(n->ternary.else_expr);
         break;
     case NODE_EXPR_CAST:
@@ -721,12 +1413,12 @@ static void gen_print(Node *n) {
     emit_indent();
     emit("printf(\"%s\\n\", ", f);
     gen_expr(n->print_stmt.arg);
-    emit(");\n");
+    emit_str(");\n");
 }
 
 static void gen_assert(Node *n) {
     emit_indent();
-    emit("if (!(");
+    emit_str("if (!(");
     gen_expr(n->assert_stmt.arg);
     emit(")) { fprintf(stderr, \"FAIL: assert at line %d\\n\"); exit(1); }\n",
          n->assert_stmt.line);
@@ -759,13 +1451,14 @@ static void gen_match(Node *n) {
 
             emitln("case %s_%s: {", tname, arm->pattern.variant);
             indent++;
+            sym_push_scope();
 
             if (arm->pattern.binding[0] != '\0') {
                 int is_ok = (strcmp(arm->pattern.variant, "Ok") == 0);
                 const char *fld = is_ok ? "ok" : "err";
                 const char *ft;
+                char inner[64];
                 if (is_ok && target_type) {
-                    char inner[64];
                     result_inner(target_type, inner);
                     ft = inner;
                 } else {
@@ -780,6 +1473,7 @@ static void gen_match(Node *n) {
         } else {
             emitln("case %s_%s: {", arm->pattern.enum_name, arm->pattern.variant);
             indent++;
+            sym_push_scope();
 
             if (arm->pattern.binding[0] != '\0') {
                 const char *ft = enum_field_type(
@@ -797,6 +1491,7 @@ static void gen_match(Node *n) {
         if (moxy_arc_enabled) arc_push_scope();
         gen_stmt(arm->body);
         if (moxy_arc_enabled) arc_pop_scope();
+        sym_pop_scope();
         emitln("break;");
         indent--;
         emitln("}");
@@ -826,7 +1521,7 @@ static void gen_var_decl(Node *n, int is_global) {
         if (lit->list_lit.nitems > 0) {
             emit("%s %s%s = %s_make((%s[]){", ct, arc ? "*" : "", n->var_decl.name, ct, celem);
             for (int i = 0; i < lit->list_lit.nitems; i++) {
-                if (i > 0) emit(", ");
+                if (i > 0) emit_str(", ");
                 gen_expr(lit->list_lit.items[i]);
             }
             emit("}, %d);\n", lit->list_lit.nitems);
@@ -840,13 +1535,13 @@ static void gen_var_decl(Node *n, int is_global) {
     if (n->var_decl.value->kind == NODE_EXPR_OK) {
         emit("%s %s = (%s){ .tag = %s_Ok, .ok = ", ct, n->var_decl.name, ct, ct);
         gen_expr(n->var_decl.value->ok_expr.inner);
-        emit(" };\n");
+        emit_str(" };\n");
         return;
     }
     if (n->var_decl.value->kind == NODE_EXPR_ERR) {
         emit("%s %s = (%s){ .tag = %s_Err, .err = ", ct, n->var_decl.name, ct, ct);
         gen_expr(n->var_decl.value->err_expr.inner);
-        emit(" };\n");
+        emit_str(" };\n");
         return;
     }
 
@@ -877,7 +1572,7 @@ static void gen_var_decl(Node *n, int is_global) {
 
         emit("%s _aw%d = ", fut_ct, idx);
         gen_expr(inner);
-        emit(";\n");
+        emit_str(";\n");
 
         if (strcmp(fut_inner, "void") == 0) {
             emitln("pthread_join(_aw%d.thread, NULL);", idx);
@@ -901,12 +1596,14 @@ static void gen_var_decl(Node *n, int is_global) {
         }
         emit("%s *%s = ", ct, n->var_decl.name);
         gen_expr(n->var_decl.value);
-        emit(";\n");
+        emit_str(";\n");
         arc_register_var(n->var_decl.name, mtype);
     } else {
         emit("%s %s = ", ct, n->var_decl.name);
+        if (is_slice_type(mtype)) slice_hint = mtype;
         gen_expr(n->var_decl.value);
-        emit(";\n");
+        slice_hint = NULL;
+        emit_str(";\n");
     }
 }
 
@@ -917,27 +1614,31 @@ static void gen_block(Node *block) {
 
 static void gen_if_inner(Node *n, int is_else_if) {
     if (!is_else_if) emit_indent();
-    emit("if (");
+    emit_str("if (");
     gen_expr(n->if_stmt.cond);
-    emit(") {\n");
+    emit_str(") {\n");
     indent++;
+    sym_push_scope();
     if (moxy_arc_enabled) arc_push_scope();
     gen_block(n->if_stmt.then_body);
     if (moxy_arc_enabled) arc_pop_scope();
+    sym_pop_scope();
     indent--;
     if (n->if_stmt.else_body) {
         Node *eb = n->if_stmt.else_body;
         if (eb->block.nstmts == 1 && eb->block.stmts[0]->kind == NODE_IF_STMT) {
             emit_indent();
-            emit("} else ");
+            emit_str("} else ");
             gen_if_inner(eb->block.stmts[0], 1);
             return;
         }
         emitln("} else {");
         indent++;
+        sym_push_scope();
         if (moxy_arc_enabled) arc_push_scope();
         gen_block(n->if_stmt.else_body);
         if (moxy_arc_enabled) arc_pop_scope();
+        sym_pop_scope();
         indent--;
     }
     emitln("}");
@@ -949,14 +1650,16 @@ static void gen_if(Node *n) {
 
 static void gen_while(Node *n) {
     emit_indent();
-    emit("while (");
+    emit_str("while (");
     gen_expr(n->while_stmt.cond);
-    emit(") {\n");
+    emit_str(") {\n");
     indent++;
+    sym_push_scope();
     if (moxy_arc_enabled) arc_push_scope();
     for (int i = 0; i < n->while_stmt.nbody; i++)
         gen_stmt(n->while_stmt.body[i]);
     if (moxy_arc_enabled) arc_pop_scope();
+    sym_pop_scope();
     indent--;
     emitln("}");
 }
@@ -973,7 +1676,8 @@ static void gen_for_step(Node *n) {
 
 static void gen_for(Node *n) {
     emit_indent();
-    emit("for (");
+    emit_str("for (");
+    sym_push_scope();
 
     if (n->for_stmt.init->kind == NODE_VAR_DECL) {
         const char *mtype = n->for_stmt.init->var_decl.type;
@@ -985,19 +1689,20 @@ static void gen_for(Node *n) {
     } else {
         gen_expr(n->for_stmt.init);
     }
-    emit("; ");
+    emit_str("; ");
 
     gen_expr(n->for_stmt.cond);
-    emit("; ");
+    emit_str("; ");
 
     gen_for_step(n->for_stmt.step);
-    emit(") {\n");
+    emit_str(") {\n");
 
     indent++;
     if (moxy_arc_enabled) arc_push_scope();
     for (int i = 0; i < n->for_stmt.nbody; i++)
         gen_stmt(n->for_stmt.body[i]);
     if (moxy_arc_enabled) arc_pop_scope();
+    sym_pop_scope();
     indent--;
     emitln("}");
 }
@@ -1012,11 +1717,13 @@ static void gen_for_in(Node *n) {
         emit("; %s < ", n->for_in_stmt.var1);
         gen_expr(n->for_in_stmt.iter->range.end);
         emit("; %s++) {\n", n->for_in_stmt.var1);
+        sym_push_scope();
         sym_add(n->for_in_stmt.var1, "int");
         indent++;
         for (int i = 0; i < n->for_in_stmt.nbody; i++)
             gen_stmt(n->for_in_stmt.body[i]);
         indent--;
+        sym_pop_scope();
         emitln("}");
         return;
     }
@@ -1027,9 +1734,41 @@ static void gen_for_in(Node *n) {
 
     const char *coll_type = coll_name ? sym_type(coll_name) : NULL;
 
+    /* a slice expression is evaluated once, into _fs<n> */
+    char tmp[32], st[72];
+    if (!coll_name && is_slice_expr(n->for_in_stmt.iter) && infer_type(n->for_in_stmt.iter)) {
+        char tname[128];
+        snprintf(st, sizeof(st), "%s", infer_type(n->for_in_stmt.iter));
+        c_type_buf(st, tname);
+        snprintf(tmp, sizeof(tmp), "_fs%d", idx);
+        emit_indent();
+        emit("%s %s = ", tname, tmp);
+        gen_expr(n->for_in_stmt.iter);
+        emit_str(";\n");
+        coll_name = tmp;
+        coll_type = st;
+    }
+
     const char *dot = (coll_type && is_arc_type(coll_type)) ? "->" : ".";
 
-    if (coll_type && is_list_type(coll_type)) {
+    if (coll_type && is_slice_type(coll_type)) {
+        char elem[64], celem[64];
+        slice_elem(coll_type, elem);
+        c_type_buf(elem, celem);
+
+        emitln("for (int _fi%d = 0; _fi%d < %s.len; _fi%d++) {", idx, idx, coll_name, idx);
+        indent++;
+        sym_push_scope();
+        if (moxy_arc_enabled) arc_push_scope();
+        emitln("%s %s = %s.data[_fi%d];", celem, n->for_in_stmt.var1, coll_name, idx);
+        sym_add(n->for_in_stmt.var1, elem);
+        for (int i = 0; i < n->for_in_stmt.nbody; i++)
+            gen_stmt(n->for_in_stmt.body[i]);
+        if (moxy_arc_enabled) arc_pop_scope();
+        sym_pop_scope();
+        indent--;
+        emitln("}");
+    } else if (coll_type && is_list_type(coll_type)) {
         char elem[64], celem[64];
         list_elem(coll_type, elem);
         c_type_buf(elem, celem);
@@ -1039,6 +1778,7 @@ static void gen_for_in(Node *n) {
         gen_expr(n->for_in_stmt.iter);
         emit("%slen; _fi%d++) {\n", dot, idx);
         indent++;
+        sym_push_scope();
         if (moxy_arc_enabled) arc_push_scope();
         emit_indent();
         emit("%s %s = ", celem, n->for_in_stmt.var1);
@@ -1048,6 +1788,7 @@ static void gen_for_in(Node *n) {
         for (int i = 0; i < n->for_in_stmt.nbody; i++)
             gen_stmt(n->for_in_stmt.body[i]);
         if (moxy_arc_enabled) arc_pop_scope();
+        sym_pop_scope();
         indent--;
         emitln("}");
     } else if (coll_type && is_map_type(coll_type)) {
@@ -1062,6 +1803,7 @@ static void gen_for_in(Node *n) {
         gen_expr(n->for_in_stmt.iter);
         emit("%slen; _fi%d++) {\n", dot, idx);
         indent++;
+        sym_push_scope();
         if (moxy_arc_enabled) arc_push_scope();
         emit_indent();
         emit("%s %s = ", ck, n->for_in_stmt.var1);
@@ -1080,6 +1822,7 @@ static void gen_for_in(Node *n) {
         for (int i = 0; i < n->for_in_stmt.nbody; i++)
             gen_stmt(n->for_in_stmt.body[i]);
         if (moxy_arc_enabled) arc_pop_scope();
+        sym_pop_scope();
         indent--;
         emitln("}");
     }
@@ -1094,13 +1837,13 @@ static void gen_return(Node *n) {
     }
     emit_indent();
     if (n->return_stmt.value) {
-        emit("return ");
+        emit_str("return ");
         gen_expr(n->return_stmt.value);
-        emit(";\n");
+        emit_str(";\n");
     } else if (in_main) {
-        emit("return 0;\n");
+        emit_str("return 0;\n");
     } else {
-        emit("return;\n");
+        emit_str("return;\n");
     }
 }
 
@@ -1113,9 +1856,9 @@ static void gen_assign(Node *n) {
             emitln("%s_release(%s);", tname, n->assign.target->ident.name);
             emit_indent();
             gen_expr(n->assign.target);
-            emit(" = ");
+            emit_str(" = ");
             gen_expr(n->assign.value);
-            emit(";\n");
+            emit_str(";\n");
             if (n->assign.value->kind == NODE_EXPR_IDENT) {
                 emitln("%s_retain(%s);", tname, n->assign.target->ident.name);
             }
@@ -1126,7 +1869,7 @@ static void gen_assign(Node *n) {
     gen_expr(n->assign.target);
     emit(" %s ", n->assign.op);
     gen_expr(n->assign.value);
-    emit(";\n");
+    emit_str(";\n");
 }
 
 static void gen_stmt(Node *n) {
@@ -1179,7 +1922,7 @@ static void gen_stmt(Node *n) {
             emit_indent();
             emit("%s _aw%d = ", fut_ct, idx);
             gen_expr(inner);
-            emit(";\n");
+            emit_str(";\n");
 
             if (strcmp(fut_inner, "void") == 0) {
                 emitln("pthread_join(_aw%d.thread, NULL);", idx);
@@ -1193,9 +1936,10 @@ static void gen_stmt(Node *n) {
         }
         emit_indent();
         gen_expr(n->expr_stmt.expr);
-        emit(";\n");
+        emit_str(";\n");
         break;
     case NODE_RAW:
+        sym_add_raw_array(n->raw.text);
         emitln("%s", n->raw.text);
         break;
     default:
@@ -1204,12 +1948,16 @@ static void gen_stmt(Node *n) {
 }
 
 static void gen_enum(Node *n) {
-    if (nenums >= 16) return;
-    strncpy(enums[nenums].name, n->enum_decl.name, 63);
-    enums[nenums].name[63] = '\0';
+    if (nenums >= enums_cap) {
+        enums_cap = enums_cap ? enums_cap * 2 : 16;
+        enums = realloc(enums, enums_cap * sizeof(EnumStore));
+        moxy_alloc_bytes += enums_cap * sizeof(EnumStore);
+    }
+    int first = enum_find(n->enum_decl.name) == NULL;
+    enums[nenums].atom = intern_cstr(n->enum_decl.name);
+    if (first) intern_info(enums[nenums].atom)->enum_slot = nenums + 1;
+    enums[nenums].variants = n->enum_decl.variants;
     enums[nenums].nvariants = n->enum_decl.nvariants;
-    for (int i = 0; i < n->enum_decl.nvariants; i++)
-        enums[nenums].variants[i] = n->enum_decl.variants[i];
 
     int has_fields = 0;
     for (int i = 0; i < n->enum_decl.nvariants; i++)
@@ -1222,7 +1970,7 @@ static void gen_enum(Node *n) {
 
     if (!has_fields) {
         /* simple enum: plain typedef enum */
-        emit("typedef enum {\n");
+        emit_str("typedef enum {\n");
         for (int i = 0; i < n->enum_decl.nvariants; i++)
             emit("    %s_%s,\n", name, n->enum_decl.variants[i].name);
         emit("} %s;\n\n", name);
@@ -1230,19 +1978,19 @@ static void gen_enum(Node *n) {
     }
 
     /* tagged enum: tag + struct wrapper */
-    emit("typedef enum {\n");
+    emit_str("typedef enum {\n");
     for (int i = 0; i < n->enum_decl.nvariants; i++)
         emit("    %s_%s,\n", name, n->enum_decl.variants[i].name);
     emit("} %s_Tag;\n\n", name);
 
-    emit("typedef struct {\n");
+    emit_str("typedef struct {\n");
     emit("    %s_Tag tag;\n", name);
 
-    emit("    union {\n");
+    emit_str("    union {\n");
     for (int i = 0; i < n->enum_decl.nvariants; i++) {
         Variant *v = &n->enum_decl.variants[i];
         if (v->nfields > 0) {
-            emit("        struct {");
+            emit_str("        struct {");
             for (int j = 0; j < v->nfields; j++) {
                 char fct[128];
                 c_type_buf(v->fields[j].type, fct);
@@ -1251,7 +1999,7 @@ static void gen_enum(Node *n) {
             emit(" } %s;\n", v->name);
         }
     }
-    emit("    };\n");
+    emit_str("    };\n");
 
     emit("} %s;\n\n", name);
 }
@@ -1270,12 +2018,12 @@ static int is_fnptr_type(const char *t) {
 
 static void emit_params(Node *n) {
     if (n->func_decl.nparams == 0) {
-        emit("void");
+        emit_str("void");
     } else {
         for (int i = 0; i < n->func_decl.nparams; i++) {
-            if (i > 0) emit(", ");
+            if (i > 0) emit_str(", ");
             if (strcmp(n->func_decl.params[i].type, "...") == 0) {
-                emit("...");
+                emit_str("...");
             } else {
                 char pct[128];
                 c_type_buf(n->func_decl.params[i].type, pct);
@@ -1290,6 +2038,40 @@ static void emit_params(Node *n) {
     }
 }
 
+/* under moxy_internal_linkage, functions without their own storage class
+   (kept in the return type) become static */
+static void emit_linkage(const char *ret) {
+    if (!moxy_internal_linkage) return;
+    for (const char *p = ret; *p; ) {
+        size_t n = strcspn(p, " ");
+        if (n == 6 && (strncmp(p, "static", 6) == 0 || strncmp(p, "extern", 6) == 0))
+            return;
+        p += n;
+        while (*p == ' ') p++;
+    }
+    emit_str("static ");
+}
+
+/* a raw C prototype of a function the program defines; its linkage has to
+   agree with the definition's */
+static int is_own_prototype(Node *program, const char *text) {
+    if (!moxy_internal_linkage || strchr(text, '{') || strchr(text, '=')) return 0;
+    const char *paren = strchr(text, '(');
+    if (!paren) return 0;
+    const char *end = paren;
+    while (end > text && end[-1] == ' ') end--;
+    const char *start = end;
+    while (start > text && (isalnum((unsigned char)start[-1]) || start[-1] == '_')) start--;
+    int len = (int)(end - start);
+    for (int i = 0; i < program->program.ndecls; i++) {
+        Node *d = program->program.decls[i];
+        if (d->kind == NODE_FUNC_DECL && (int)strlen(d->func_decl.name) == len
+            && strncmp(d->func_decl.name, start, len) == 0)
+            return strcmp(d->func_decl.name, "main") != 0;
+    }
+    return 0;
+}
+
 static void gen_forward_decl(Node *n) {
     char retct[128];
     c_type_buf(n->func_decl.ret, retct);
@@ -1301,12 +2083,13 @@ static void gen_forward_decl(Node *n) {
         return;
     }
 
+    emit_linkage(n->func_decl.ret);
     if (is_arc_type(n->func_decl.ret))
         emit("%s *%s(", retct, n->func_decl.name);
     else
         emit("%s %s(", retct, n->func_decl.name);
     emit_params(n);
-    emit(");\n");
+    emit_str(");\n");
 
     sym_add(n->func_decl.name, n->func_decl.ret);
 }
@@ -1320,23 +2103,23 @@ static void gen_async_stmt(Node *n, const char *inner_type) {
                 emitln("return NULL;");
         } else if (strcmp(inner_type, "string") == 0) {
             emit_indent();
-            emit("return (void *)");
+            emit_str("return (void *)");
             if (n->return_stmt.value)
                 gen_expr(n->return_stmt.value);
             else
-                emit("NULL");
-            emit(";\n");
+                emit_str("NULL");
+            emit_str(";\n");
         } else {
             char cinner[128];
             c_type_buf(inner_type, cinner);
             emitln("%s *_ret = malloc(sizeof(%s));", cinner, cinner);
             emit_indent();
-            emit("*_ret = ");
+            emit_str("*_ret = ");
             if (n->return_stmt.value)
                 gen_expr(n->return_stmt.value);
             else
-                emit("0");
-            emit(";\n");
+                emit_str("0");
+            emit_str(";\n");
             emitln("return (void *)_ret;");
         }
     } else {
@@ -1352,9 +2135,9 @@ static void gen_async_func(Node *n) {
     c_type_buf(n->func_decl.ret, tname);
 
     /* 1. args struct */
-    emit("typedef struct {");
+    emit_str("typedef struct {");
     if (n->func_decl.nparams == 0) {
-        emit(" int _dummy;");
+        emit_str(" int _dummy;");
     } else {
         for (int i = 0; i < n->func_decl.nparams; i++) {
             char pct[128];
@@ -1368,6 +2151,7 @@ static void gen_async_func(Node *n) {
     emit("static void *_%s_thread(void *_arg) {\n", fname);
     indent = 1;
     emitln("_%s_args *_a = (_%s_args *)_arg;", fname, fname);
+    sym_push_scope();
     for (int i = 0; i < n->func_decl.nparams; i++) {
         char pct[128];
         c_type_buf(n->func_decl.params[i].type, pct);
@@ -1384,14 +2168,15 @@ static void gen_async_func(Node *n) {
         n->func_decl.body[n->func_decl.nbody - 1]->kind == NODE_RETURN_STMT);
     if (strcmp(inner, "void") == 0 && !last_is_return)
         emitln("return NULL;");
+    sym_pop_scope();
 
     indent = 0;
-    emit("}\n\n");
+    emit_str("}\n\n");
 
     /* 3. launcher function */
     emit("static %s %s(", tname, fname);
     emit_params(n);
-    emit(") {\n");
+    emit_str(") {\n");
     indent = 1;
     emitln("%s _f;", tname);
     emitln("_%s_args *_a = malloc(sizeof(_%s_args));", fname, fname);
@@ -1402,7 +2187,7 @@ static void gen_async_func(Node *n) {
     emitln("_f.started = 1;");
     emitln("return _f;");
     indent = 0;
-    emit("}\n\n");
+    emit_str("}\n\n");
 }
 
 static void gen_func(Node *n) {
@@ -1418,16 +2203,18 @@ static void gen_func(Node *n) {
 
     in_main = is_main;
     if (is_main) {
-        emit("int main(void) {\n");
+        emit_str("int main(void) {\n");
     } else {
+        emit_linkage(n->func_decl.ret);
         if (is_arc_type(n->func_decl.ret))
             emit("%s *%s(", retct, n->func_decl.name);
         else
             emit("%s %s(", retct, n->func_decl.name);
         emit_params(n);
-        emit(") {\n");
+        emit_str(") {\n");
     }
 
+    sym_push_scope();
     for (int i = 0; i < n->func_decl.nparams; i++) {
         if (strcmp(n->func_decl.params[i].type, "...") != 0)
             sym_add(n->func_decl.params[i].name, n->func_decl.params[i].type);
@@ -1457,9 +2244,10 @@ static void gen_func(Node *n) {
     } else {
         if (moxy_arc_enabled) arc_pop_scope();
     }
+    sym_pop_scope();
 
     indent = 0;
-    emit("}\n\n");
+    emit_str("}\n\n");
 }
 
 static void collect_types(Node *n) {
@@ -1473,13 +2261,17 @@ static void collect_types(Node *n) {
         if (is_list_type(n->var_decl.type) ||
             is_result_type(n->var_decl.type) ||
             is_map_type(n->var_decl.type) ||
-            is_future_type(n->var_decl.type))
+            is_future_type(n->var_decl.type) ||
+            is_slice_type(n->var_decl.type))
             inst_add(n->var_decl.type);
         collect_types(n->var_decl.value);
         break;
     case NODE_FUNC_DECL:
-        if (is_future_type(n->func_decl.ret))
+        if (is_future_type(n->func_decl.ret) || is_slice_type(n->func_decl.ret))
             inst_add(n->func_decl.ret);
+        for (int i = 0; i < n->func_decl.nparams; i++)
+            if (is_slice_type(n->func_decl.params[i].type))
+                inst_add(n->func_decl.params[i].type);
         for (int i = 0; i < n->func_decl.nbody; i++)
             collect_types(n->func_decl.body[i]);
         break;
@@ -1501,6 +2293,7 @@ static void collect_types(Node *n) {
             collect_types(n->for_stmt.body[i]);
         break;
     case NODE_FOR_IN_STMT:
+        collect_types(n->for_in_stmt.iter);
         for (int i = 0; i < n->for_in_stmt.nbody; i++)
             collect_types(n->for_in_stmt.body[i]);
         break;
@@ -1521,6 +2314,29 @@ static void collect_types(Node *n) {
         for (int i = 0; i < n->block.nstmts; i++)
             collect_types(n->block.stmts[i]);
         break;
+    /* only to find slice expressions */
+    case NODE_EXPR_INDEX:
+        if (is_slice_expr(n)) uses_slices = 1;
+        collect_types(n->index.target);
+        break;
+    case NODE_EXPR_METHOD:
+        collect_types(n->method.target);
+        for (int i = 0; i < n->method.nargs; i++)
+            collect_types(n->method.args[i]);
+        break;
+    case NODE_ASSIGN:
+        collect_types(n->assign.value);
+        break;
+    case NODE_PRINT_STMT:
+        collect_types(n->print_stmt.arg);
+        break;
+    case NODE_EXPR_BINOP:
+        collect_types(n->binop.left);
+        collect_types(n->binop.right);
+        break;
+    case NODE_EXPR_PAREN:
+        collect_types(n->paren.inner);
+        break;
     default:
         break;
     }
@@ -1547,6 +2363,17 @@ static void collect_lambdas(Node *n) {
         for (int i = 0; i < n->call.nargs; i++)
             collect_lambdas(n->call.args[i]);
         break;
+    case NODE_EXPR_METHOD:
+        collect_lambdas(n->method.target);
+        for (int i = 0; i < n->method.nargs; i++)
+            collect_lambdas(n->method.args[i]);
+        break;
+    case NODE_PRINT_STMT:
+        collect_lambdas(n->print_stmt.arg);
+        break;
+    case NODE_ASSERT_STMT:
+        collect_lambdas(n->assert_stmt.arg);
+        break;
     case NODE_RETURN_STMT:
         if (n->return_stmt.value) collect_lambdas(n->return_stmt.value);
         break;
@@ -1586,7 +2413,15 @@ static void collect_lambdas(Node *n) {
     case NODE_EXPR_PAREN:
         collect_lambdas(n->paren.inner);
         break;
+    case NODE_EXPR_UNARY:
+        collect_lambdas(n->unary.operand);
+        break;
     case NODE_EXPR_LAMBDA:
+        if (nlambdas >= lambdas_cap) {
+            lambdas_cap = lambdas_cap ? lambdas_cap * 2 : 64;
+            lambdas = realloc(lambdas, lambdas_cap * sizeof(Node *));
+            moxy_alloc_bytes += lambdas_cap * sizeof(Node *);
+        }
         n->lambda.id = nlambdas;
         lambdas[nlambdas++] = n;
         collect_lambdas(n->lambda.body);
@@ -1602,10 +2437,13 @@ static int has_include(const char *inc) {
     return 0;
 }
 
-const char *codegen(Node *program) {
-    outpos = 0;
+static void codegen_run(Node *program) {
+    outlen = 0;
+    out_reserve(0);
+    out[0] = '\0';
     indent = 0;
-    nsyms = 0;
+    sym_unwind(0);
+    nsym_scopes = 0;
     nenums = 0;
     ninsts = 0;
     in_main = 0;
@@ -1615,11 +2453,35 @@ const char *codegen(Node *program) {
     nlambdas = 0;
     arc_depth = 0;
     memset(arc_scopes, 0, sizeof(arc_scopes));
-    memset(out, 0, sizeof(out));
 
+    nrt_types = 0;
+    rt_part = RT_STATIC;
+
+    uses_slices = 0;
     collect_types(program);
     collect_lambdas(program);
 
+    /* which T[..] a slice expression makes is only known during codegen,
+       so any of them gets the slice of every list type and of string */
+    if (uses_slices) {
+        int nlists = ninsts;
+        for (int i = 0; i < nlists; i++) {
+            const char *t = intern_text(type_insts[i]);
+            if (!is_list_type(t)) continue;
+            char elem[64], st[72];
+            list_elem(t, elem);
+            snprintf(st, sizeof(st), "%s[..]", elem);
+            inst_add(st);
+        }
+        inst_add("char[..]");
+    }
+
+    for (int i = 0; i < ninsts; i++) {
+        const char *t = intern_text(type_insts[i]);
+        if (is_shared_type(t) && nrt_types < 64)
+            snprintf(rt_types[nrt_types++], sizeof(rt_types[0]), "%s", t);
+    }
+
     for (int i = 0; i < nuser_includes; i++)
         emit("%s\n", user_includes[i]);
 
@@ -1632,21 +2494,24 @@ const char *codegen(Node *program) {
 
     int need_string = 0;
     for (int i = 0; i < ninsts; i++)
-        if (is_list_type(type_insts[i]) || is_map_type(type_insts[i]))
+        if (is_list_type(intern_text(type_insts[i])) || is_map_type(intern_text(type_insts[i])) ||
+            is_slice_type(intern_text(type_insts[i])))
             need_string = 1;
 
     for (int a = 0; auto_incs[a]; a++)
         if (!has_include(auto_incs[a])) emit("%s\n", auto_incs[a]);
 
     if (need_string && !has_include("#include <string.h>"))
-        emit("#include <string.h>\n");
+        emit_str("#include <string.h>\n");
 
     for (int i = 0; i < ninsts; i++) {
-        if (is_future_type(type_insts[i])) { has_futures = 1; break; }
+        if (is_future_type(intern_text(type_insts[i]))) { has_futures = 1; break; }
     }
     if (has_futures && !has_include("#include <pthread.h>"))
-        emit("#include <pthread.h>\n");
-    emit("\n");
+        emit_str("#include <pthread.h>\n");
+    if (nrt_types > 0)
+        emit_str("#include \"moxyrt.h\"\n");
+    emit_str("\n");
 
     for (int i = 0; i < nuser_directives; i++)
         emit("%s\n", user_directives[i]);
@@ -1655,16 +2520,28 @@ const char *codegen(Node *program) {
         if (program->program.decls[i]->kind == NODE_ENUM_DECL)
             gen_enum(program->program.decls[i]);
 
+    int nshared = 0;
+    for (int i = 0; i < ninsts; i++) {
+        const char *t = intern_text(type_insts[i]);
+        if (is_shared_type(t) && nshared++ < nrt_types) continue;
+        if (is_list_type(t)) emit_list_type(t);
+        else if (is_result_type(t)) emit_result_type(t);
+        else if (is_map_type(t)) emit_map_type(t);
+        else if (is_future_type(t)) emit_future_type(t);
+    }
+    /* after the lists, since a slice can be taken of one */
     for (int i = 0; i < ninsts; i++) {
-        if (is_list_type(type_insts[i])) emit_list_type(type_insts[i]);
-        else if (is_result_type(type_insts[i])) emit_result_type(type_insts[i]);
-        else if (is_map_type(type_insts[i])) emit_map_type(type_insts[i]);
-        else if (is_future_type(type_insts[i])) emit_future_type(type_insts[i]);
+        const char *t = intern_text(type_insts[i]);
+        if (is_slice_type(t)) emit_slice_type(t);
     }
 
     for (int i = 0; i < program->program.ndecls; i++) {
-        if (program->program.decls[i]->kind == NODE_RAW)
-            emit("%s\n", program->program.decls[i]->raw.text);
+        if (program->program.decls[i]->kind == NODE_RAW) {
+            const char *text = program->program.decls[i]->raw.text;
+            if (is_own_prototype(program, text)) emit_linkage(text);
+            sym_add_raw_array(text);
+            emit("%s\n", text);
+        }
     }
 
     /* emit lambda functions as static inline */
@@ -1674,15 +2551,15 @@ const char *codegen(Node *program) {
         strcpy(ret_buf, "void");
 
         if (lam->lambda.is_expr) {
-            int sym_save = nsyms;
+            sym_push_scope();
             for (int p = 0; p < lam->lambda.nparams; p++)
                 sym_add(lam->lambda.params[p].name, lam->lambda.params[p].type);
             const char *r = infer_type(lam->lambda.body);
             strcpy(ret_buf, r ? r : "int");
-            nsyms = sym_save;
+            sym_pop_scope();
         } else {
             Node *block = lam->lambda.body;
-            int sym_save = nsyms;
+            sym_push_scope();
             for (int p = 0; p < lam->lambda.nparams; p++)
                 sym_add(lam->lambda.params[p].name, lam->lambda.params[p].type);
             for (int s = 0; s < block->block.nstmts; s++) {
@@ -1693,7 +2570,7 @@ const char *codegen(Node *program) {
                     break;
                 }
             }
-            nsyms = sym_save;
+            sym_pop_scope();
         }
 
         char retct[128];
@@ -1701,35 +2578,35 @@ const char *codegen(Node *program) {
 
         emit("static inline %s __moxy_lambda_%d(", retct, lam->lambda.id);
         if (lam->lambda.nparams == 0) {
-            emit("void");
+            emit_str("void");
         } else {
             for (int p = 0; p < lam->lambda.nparams; p++) {
-                if (p > 0) emit(", ");
+                if (p > 0) emit_str(", ");
                 char pct[128];
                 c_type_buf(lam->lambda.params[p].type, pct);
                 emit("%s %s", pct, lam->lambda.params[p].name);
             }
         }
-        emit(") {\n");
+        emit_str(") {\n");
 
-        int sym_save = nsyms;
+        sym_push_scope();
         for (int p = 0; p < lam->lambda.nparams; p++)
             sym_add(lam->lambda.params[p].name, lam->lambda.params[p].type);
 
         indent = 1;
         if (lam->lambda.is_expr) {
             emit_indent();
-            emit("return ");
+            emit_str("return ");
             gen_expr(lam->lambda.body);
-            emit(";\n");
+            emit_str(";\n");
         } else {
             for (int s = 0; s < lam->lambda.body->block.nstmts; s++)
                 gen_stmt(lam->lambda.body->block.stmts[s]);
         }
         indent = 0;
-        emit("}\n\n");
+        emit_str("}\n\n");
 
-        nsyms = sym_save;
+        sym_pop_scope();
 
         char lname[64];
         snprintf(lname, 64, "__moxy_lambda_%d", lam->lambda.id);
@@ -1739,17 +2616,68 @@ const char *codegen(Node *program) {
     for (int i = 0; i < program->program.ndecls; i++)
         if (program->program.decls[i]->kind == NODE_FUNC_DECL)
             gen_forward_decl(program->program.decls[i]);
-    emit("\n");
+    emit_str("\n");
 
     for (int i = 0; i < program->program.ndecls; i++) {
         if (program->program.decls[i]->kind != NODE_VAR_DECL) continue;
         gen_var_decl(program->program.decls[i], 1);
     }
-    emit("\n");
+    emit_str("\n");
 
     for (int i = 0; i < program->program.ndecls; i++)
         if (program->program.decls[i]->kind == NODE_FUNC_DECL)
             gen_func(program->program.decls[i]);
+}
+
+const char *codegen(Node *program) {
+    out_fp = NULL;
+    codegen_run(program);
+    return out;
+}
+
+int codegen_to_file(Node *program, FILE *f) {
+    out_fp = f;
+    codegen_run(program);
+    fwrite(out, 1, outlen, f);
+    outlen = 0;
+    out[0] = '\0';
+    out_fp = NULL;
+    return ferror(f) ? -1 : 0;
+}
+
+int codegen_rt_count(void) {
+    return nrt_types;
+}
+
+const char *codegen_rt_type(int i) {
+    return rt_types[i];
+}
 
+const char *codegen_runtime(const char *const *types, int ntypes, int source) {
+    out_fp = NULL;
+    outlen = 0;
+    out_reserve(0);
+    out[0] = '\0';
+    int saved_arc = moxy_arc_enabled;
+    moxy_arc_enabled = 1;
+    if (source) {
+        /* every library of a workspace carries its own copy; weak
+           definitions let the linker keep one */
+        emit_str("#include \"moxyrt.h\"\n\n");
+        emit_str("#if defined(__GNUC__)\n#define MOXYRT_FN __attribute__((weak))\n");
+        emit_str("#else\n#define MOXYRT_FN\n#endif\n\n");
+        rt_part = RT_DEF;
+    } else {
+        emit_str("#ifndef MOXYRT_H\n#define MOXYRT_H\n\n");
+        emit_str("#include <stdlib.h>\n#include <stdbool.h>\n#include <string.h>\n\n");
+        rt_part = RT_DECL;
+    }
+    for (int i = 0; i < ntypes; i++) {
+        if (is_list_type(types[i])) emit_list_type(types[i]);
+        else if (is_map_type(types[i])) emit_map_type(types[i]);
+    }
+    if (!source) emit_str("#endif\n");
+    rt_part = RT_STATIC;
+    moxy_arc_enabled = saved_arc;
     return out;
 }
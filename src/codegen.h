@@ -2,10 +2,26 @@
 #define MOXY_CODEGEN_H
 
 #include "ast.h"
+#include <stdio.h>
 
+/* the returned text stays valid until the next codegen call */
 const char *codegen(Node *program);
+/* streams the generated C to f; returns -1 on a write error */
+int codegen_to_file(Node *program, FILE *f);
 void codegen_add_include(const char *line);
 void codegen_add_directive(const char *line);
 void codegen_reset_includes(void);
 
+/* the instantiations the last codegen call left to moxyrt.h (see
+   moxy_shared_rt), valid until the next call */
+int codegen_rt_count(void);
+const char *codegen_rt_type(int i);
+
+/* moxyrt.h, or with source set moxyrt.c, for a set of those types; uses
+   the installed intern table and codegen's buffer like codegen does */
+const char *codegen_runtime(const char *const *types, int ntypes, int source);
+
+/* frees the calling thread's scratch buffers; the next call regrows them */
+void codegen_release(void);
+
 #endif
@@ -1,10 +1,11 @@
+#define _DEFAULT_SOURCE
 #include "diag.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-static const char *src;
-static const char *fname;
+static _Thread_local const char *src;
+static _Thread_local const char *fname;
 
 void diag_init(const char *source, const char *filename) {
     src = source;
@@ -35,55 +36,91 @@ static int digit_width(int n) {
     return 4;
 }
 
-static void show_source(int line, int col, int span) {
+static void show_source(FILE *out, int line, int col, int span) {
     const char *ls = line_start(line);
     if (!ls) return;
 
     int len = line_len(ls);
     int w = digit_width(line);
 
-    fprintf(stderr, " %*s |\n", w, "");
+    fprintf(out, " %*s |\n", w, "");
 
-    fprintf(stderr, " %*d | ", w, line);
-    fwrite(ls, 1, len, stderr);
-    fprintf(stderr, "\n");
+    fprintf(out, " %*d | ", w, line);
+    fwrite(ls, 1, len, out);
+    fprintf(out, "\n");
 
-    fprintf(stderr, " %*s | ", w, "");
+    fprintf(out, " %*s | ", w, "");
     int caret_pos = (col > 0) ? col - 1 : 0;
     for (int i = 0; i < caret_pos; i++) {
-        if (i < len && ls[i] == '\t') fprintf(stderr, "\t");
-        else fprintf(stderr, " ");
+        if (i < len && ls[i] == '\t') fprintf(out, "\t");
+        else fprintf(out, " ");
     }
     for (int i = 0; i < span && i < 40; i++)
-        fprintf(stderr, "^");
-    fprintf(stderr, "\n");
+        fprintf(out, "^");
+    fprintf(out, "\n");
 }
 
-void diag_error(int line, int col, const char *msg) {
-    fprintf(stderr, "\033[1;31merror\033[0m\033[1m: %s\033[0m\n", msg);
+/* while a capture is installed, diagnostics are recorded (or printed to
+   its stream) and diag_bail unwinds to the capture instead of exiting */
+static _Thread_local DiagCapture *capture;
+
+DiagCapture *diag_capture(DiagCapture *cap) {
+    DiagCapture *prev = capture;
+    capture = cap;
+    return prev;
+}
+
+static void record(DiagKind kind, int line, int col, int span, const char *msg) {
+    if (capture->count >= capture->cap) {
+        int cap = capture->cap ? capture->cap * 2 : 8;
+        Diagnostic *items = realloc(capture->items, cap * sizeof(Diagnostic));
+        if (!items) return;
+        capture->items = items;
+        capture->cap = cap;
+    }
+    Diagnostic *d = &capture->items[capture->count++];
+    d->kind = kind;
+    d->line = line;
+    d->col = col;
+    d->span = span;
+    d->message = strdup(msg);
+}
+
+/* where printed diagnostics go */
+static FILE *print_stream(void) {
+    return capture ? capture->print : stderr;
+}
+
+static void report(DiagKind kind, int line, int col, int span, const char *msg) {
+    if (capture && !capture->print) {
+        record(kind, line, col, span, msg);
+        return;
+    }
+    FILE *out = print_stream();
+    if (kind == DIAG_ERROR)
+        fprintf(out, "\033[1;31merror\033[0m\033[1m: %s\033[0m\n", msg);
+    else
+        fprintf(out, "\033[1;33mwarning\033[0m\033[1m: %s\033[0m\n", msg);
     if (fname)
-        fprintf(stderr, "  \033[1;34m-->\033[0m %s:%d:%d\n", fname, line, col);
-    show_source(line, col, 1);
+        fprintf(out, "  \033[1;34m-->\033[0m %s:%d:%d\n", fname, line, col);
+    show_source(out, line, col, span);
+}
+
+void diag_error(int line, int col, const char *msg) {
+    report(DIAG_ERROR, line, col, 1, msg);
 }
 
 void diag_error_span(int line, int col, int span, const char *msg) {
-    fprintf(stderr, "\033[1;31merror\033[0m\033[1m: %s\033[0m\n", msg);
-    if (fname)
-        fprintf(stderr, "  \033[1;34m-->\033[0m %s:%d:%d\n", fname, line, col);
-    show_source(line, col, span > 0 ? span : 1);
+    report(DIAG_ERROR, line, col, span > 0 ? span : 1, msg);
 }
 
-void diag_error_expected(int line, int col, TokenKind expected, TokenKind got, const char *got_text) {
+void diag_error_expected(int line, int col, TokenKind expected, TokenKind got, int got_len) {
     char msg[256];
-    int got_len = (int)strlen(got_text);
 
     snprintf(msg, sizeof(msg), "expected %s, found %s",
              tok_name(expected), tok_name(got));
 
-    fprintf(stderr, "\033[1;31merror\033[0m\033[1m: %s\033[0m\n", msg);
-    if (fname)
-        fprintf(stderr, "  \033[1;34m-->\033[0m %s:%d:%d\n", fname, line, col);
-    show_source(line, col, got_len > 0 ? got_len : 1);
+    report(DIAG_ERROR, line, col, got_len > 0 ? got_len : 1, msg);
 
     if (expected == TOK_SEMI && got == TOK_COMMA) {
         diag_hint("in match arms, wrap statements in braces: { statement; }");
@@ -105,24 +142,32 @@ void diag_error_expected(int line, int col, TokenKind expected, TokenKind got, c
 }
 
 void diag_warn(int line, int col, const char *msg) {
-    fprintf(stderr, "\033[1;33mwarning\033[0m\033[1m: %s\033[0m\n", msg);
-    if (fname)
-        fprintf(stderr, "  \033[1;34m-->\033[0m %s:%d:%d\n", fname, line, col);
-    show_source(line, col, 1);
+    report(DIAG_WARNING, line, col, 1, msg);
 }
 
 void diag_warn_span(int line, int col, int span, const char *msg) {
-    fprintf(stderr, "\033[1;33mwarning\033[0m\033[1m: %s\033[0m\n", msg);
-    if (fname)
-        fprintf(stderr, "  \033[1;34m-->\033[0m %s:%d:%d\n", fname, line, col);
-    show_source(line, col, span > 0 ? span : 1);
+    report(DIAG_WARNING, line, col, span > 0 ? span : 1, msg);
 }
 
 void diag_hint(const char *msg) {
-    fprintf(stderr, "  \033[1;32m= help\033[0m: %s\n", msg);
+    if (capture && !capture->print) {
+        record(DIAG_HINT, 0, 0, 0, msg);
+        return;
+    }
+    fprintf(print_stream(), "  \033[1;32m= help\033[0m: %s\n", msg);
+}
+
+_Noreturn void diag_fatal(const char *msg) {
+    if (capture && !capture->print)
+        record(DIAG_ERROR, 0, 0, 0, msg);
+    else
+        fprintf(print_stream(), "moxy: %s\n", msg);
+    if (capture) longjmp(capture->bail, 1);
+    exit(1);
 }
 
 _Noreturn void diag_bail(void) {
+    if (capture) longjmp(capture->bail, 1);
     exit(1);
 }
 
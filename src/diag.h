@@ -2,15 +2,40 @@
 #define MOXY_DIAG_H
 
 #include "token.h"
+#include <setjmp.h>
+#include <stdio.h>
+
+typedef enum { DIAG_ERROR, DIAG_WARNING, DIAG_HINT } DiagKind;
+
+/* line and col are 0 for hints and for errors not tied to the source */
+typedef struct {
+    DiagKind kind;
+    int line, col, span;
+    char *message;
+} Diagnostic;
+
+/* with print set, diagnostics are printed there as the CLI prints them
+   instead of being recorded */
+typedef struct {
+    Diagnostic *items;
+    int count, cap;
+    FILE *print;
+    jmp_buf bail;
+} DiagCapture;
 
 void diag_init(const char *source, const char *filename);
 void diag_error(int line, int col, const char *msg);
 void diag_error_span(int line, int col, int span, const char *msg);
-void diag_error_expected(int line, int col, TokenKind expected, TokenKind got, const char *got_text);
+void diag_error_expected(int line, int col, TokenKind expected, TokenKind got, int got_len);
 void diag_warn(int line, int col, const char *msg);
 void diag_warn_span(int line, int col, int span, const char *msg);
 void diag_hint(const char *msg);
 _Noreturn void diag_bail(void);
+_Noreturn void diag_fatal(const char *msg);
+
+/* installs cap for the calling thread (NULL restores printing and exiting)
+   and returns the previous one; the caller owns the recorded messages */
+DiagCapture *diag_capture(DiagCapture *cap);
 const char *tok_name(TokenKind kind);
 
 #endif
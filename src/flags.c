@@ -1,4 +1,7 @@
 #include "flags.h"
 
-int moxy_async_enabled = 0;
-int moxy_arc_enabled = 0;
+_Thread_local int moxy_async_enabled = 0;
+_Thread_local int moxy_arc_enabled = 0;
+_Thread_local int moxy_shared_rt = 0;
+_Thread_local int moxy_internal_linkage = 0;
+_Thread_local unsigned long long moxy_alloc_bytes = 0;
@@ -1,7 +1,15 @@
 #ifndef MOXY_FLAGS_H
 #define MOXY_FLAGS_H
 
-extern int moxy_async_enabled;
-extern int moxy_arc_enabled;
+extern _Thread_local int moxy_async_enabled;
+extern _Thread_local int moxy_arc_enabled;
+/* project builds: lists and maps of builtin types come from a shared
+   moxyrt.h/moxyrt.c instead of being defined in every generated file */
+extern _Thread_local int moxy_shared_rt;
+/* unity builds of binaries: every function but main is static */
+extern _Thread_local int moxy_internal_linkage;
+/* bytes requested from malloc and realloc by the compiler's own buffers
+   (arenas, token arrays, tables, output) on this thread, for --time-passes */
+extern _Thread_local unsigned long long moxy_alloc_bytes;
 
 #endif
@@ -0,0 +1,149 @@
+#include "intern.h"
+#include "flags.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define INTERN_POOL_SIZE (64 * 1024)
+
+/* atoms live in a pool that is only freed with its table, so texts and
+   infos stay put while the table grows */
+typedef struct {
+    AtomInfo info;
+    unsigned hash;
+    int len;
+    char text[];
+} Atom;
+
+struct InternTable {
+    Atom **atoms;
+    int natoms;
+    int atoms_cap;
+
+    int *slots;
+    int nslots;
+
+    char **blocks;      /* pool blocks, for freeing */
+    int nblocks;
+    int blocks_cap;
+    char *pool;
+    size_t pool_left;
+};
+
+/* each thread works on one compilation at a time; a thread that never
+   installed a table gets one of its own on first use */
+static _Thread_local InternTable *cur;
+
+InternTable *intern_table_new(void) {
+    InternTable *t = calloc(1, sizeof(InternTable));
+    if (!t) abort();
+    return t;
+}
+
+void intern_table_free(InternTable *t) {
+    if (!t) return;
+    for (int i = 0; i < t->nblocks; i++) free(t->blocks[i]);
+    free(t->blocks);
+    free(t->atoms);
+    free(t->slots);
+    free(t);
+}
+
+InternTable *intern_use(InternTable *t) {
+    InternTable *prev = cur;
+    cur = t;
+    return prev;
+}
+
+static InternTable *table(void) {
+    if (!cur) cur = intern_table_new();
+    return cur;
+}
+
+static unsigned hash_bytes(const char *s, int len) {
+    unsigned h = 2166136261u;
+    for (int i = 0; i < len; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static Atom *atom_alloc(InternTable *t, int len) {
+    size_t size = sizeof(Atom) + len + 1;
+    size = (size + _Alignof(Atom) - 1) & ~(_Alignof(Atom) - 1);
+    if (size > t->pool_left) {
+        size_t cap = size > INTERN_POOL_SIZE ? size : INTERN_POOL_SIZE;
+        if (t->nblocks >= t->blocks_cap) {
+            t->blocks_cap = t->blocks_cap ? t->blocks_cap * 2 : 4;
+            t->blocks = realloc(t->blocks, t->blocks_cap * sizeof(char *));
+            if (!t->blocks) abort();
+        }
+        t->pool = malloc(cap);
+        if (!t->pool) abort();
+        moxy_alloc_bytes += cap;
+        t->blocks[t->nblocks++] = t->pool;
+        t->pool_left = cap;
+    }
+    Atom *a = (Atom *)t->pool;
+    t->pool += size;
+    t->pool_left -= size;
+    return a;
+}
+
+static void rehash(InternTable *t) {
+    int n = t->nslots ? t->nslots * 2 : 1024;
+    int *grown = calloc(n, sizeof(int));
+    if (!grown) abort();
+    moxy_alloc_bytes += n * sizeof(int);
+    for (int id = 1; id < t->natoms; id++) {
+        unsigned i = t->atoms[id]->hash & (n - 1);
+        while (grown[i]) i = (i + 1) & (n - 1);
+        grown[i] = id;
+    }
+    free(t->slots);
+    t->slots = grown;
+    t->nslots = n;
+}
+
+int intern(const char *s, int len) {
+    InternTable *t = table();
+    if (t->natoms == 0) t->natoms = 1; /* id 0 means "no atom" */
+    if ((t->natoms + 1) * 2 > t->nslots) rehash(t);
+
+    unsigned h = hash_bytes(s, len);
+    unsigned i = h & (t->nslots - 1);
+    while (t->slots[i]) {
+        Atom *a = t->atoms[t->slots[i]];
+        if (a->hash == h && a->len == len && memcmp(a->text, s, len) == 0)
+            return t->slots[i];
+        i = (i + 1) & (t->nslots - 1);
+    }
+
+    if (t->natoms >= t->atoms_cap) {
+        t->atoms_cap = t->atoms_cap ? t->atoms_cap * 2 : 1024;
+        t->atoms = realloc(t->atoms, t->atoms_cap * sizeof(Atom *));
+        if (!t->atoms) abort();
+        moxy_alloc_bytes += t->atoms_cap * sizeof(Atom *);
+    }
+    Atom *a = atom_alloc(t, len);
+    memset(&a->info, 0, sizeof(a->info));
+    a->hash = h;
+    a->len = len;
+    memcpy(a->text, s, len);
+    a->text[len] = '\0';
+    t->atoms[t->natoms] = a;
+    t->slots[i] = t->natoms;
+    return t->natoms++;
+}
+
+int intern_cstr(const char *s) {
+    return intern(s, (int)strlen(s));
+}
+
+const char *intern_text(int id) {
+    return table()->atoms[id]->text;
+}
+
+AtomInfo *intern_info(int id) {
+    return &table()->atoms[id]->info;
+}
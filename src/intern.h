@@ -0,0 +1,31 @@
+#ifndef MOXY_INTERN_H
+#define MOXY_INTERN_H
+
+/* interned names: equal text always maps to the same small id (0 is never
+   handed out), so names compare as ints and each id can carry facts that
+   the parser and codegen cache about it */
+
+enum {
+    ATOM_USER_TYPE = 1 << 0, /* registered with @type */
+};
+
+typedef struct {
+    unsigned flags;       /* ATOM_* bits */
+    const char *ctype;    /* C spelling of this moxy type, once computed */
+    int enum_slot;        /* codegen enum table index + 1, or 0 */
+} AtomInfo;
+
+/* a table holds every atom of one compilation; the calls below work on
+   the table installed on the calling thread */
+typedef struct InternTable InternTable;
+
+InternTable *intern_table_new(void);
+void intern_table_free(InternTable *t);
+InternTable *intern_use(InternTable *t);  /* returns the previous table */
+
+int intern(const char *s, int len);
+int intern_cstr(const char *s);
+const char *intern_text(int id);
+AtomInfo *intern_info(int id);
+
+#endif
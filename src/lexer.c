@@ -1,14 +1,63 @@
 #include "lexer.h"
+#include "intern.h"
+#include "flags.h"
 #include <string.h>
-#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 
+/* vector scans over whole blocks of the source; the scalar loops below
+   finish the tail and are the whole story on other targets */
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define VW 32
+#define VFULL 0xffffffffu
+typedef __m256i vbyte;
+#define vload(p) _mm256_loadu_si256((const __m256i *)(p))
+#define vsplat(c) _mm256_set1_epi8((char)(c))
+#define veq(a, c) _mm256_cmpeq_epi8(a, vsplat(c))
+#define vgt(a, b) _mm256_cmpgt_epi8(a, b)
+#define vor(a, b) _mm256_or_si256(a, b)
+#define vand(a, b) _mm256_and_si256(a, b)
+#define vmask(v) ((unsigned)_mm256_movemask_epi8(v))
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define VW 16
+#define VFULL 0xffffu
+typedef __m128i vbyte;
+#define vload(p) _mm_loadu_si128((const __m128i *)(p))
+#define vsplat(c) _mm_set1_epi8((char)(c))
+#define veq(a, c) _mm_cmpeq_epi8(a, vsplat(c))
+#define vgt(a, b) _mm_cmpgt_epi8(a, b)
+#define vor(a, b) _mm_or_si128(a, b)
+#define vand(a, b) _mm_and_si128(a, b)
+#define vmask(v) ((unsigned)_mm_movemask_epi8(v))
+#endif
+
+/* character classes for the ASCII range; bytes >= 0x80 are in none */
+enum { CC_SPACE = 1, CC_ALPHA = 2, CC_DIGIT = 4, CC_HEX = 8 };
+#define CC_IDENT (CC_ALPHA | CC_DIGIT)
+
+static const unsigned char cclass[256] = {
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x01, 0x00, 0x00, 0x01, 0x00, 0x00,  /* 00-0f */
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  /* 10-1f */
+    0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  /* 20-2f */
+    0x0c, 0x0c, 0x0c, 0x0c, 0x0c, 0x0c, 0x0c, 0x0c, 0x0c, 0x0c, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  /* 30-3f */
+    0x00, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02,  /* 40-4f */
+    0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x00, 0x00, 0x00, 0x00, 0x02,  /* 50-5f */
+    0x00, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02,  /* 60-6f */
+    0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00,  /* 70-7f */
+};
+
+static int cc(char c, int mask) {
+    return cclass[(unsigned char)c] & mask;
+}
+
 void lexer_init(Lexer *l, const char *src) {
     l->src = src;
+    l->len = (int)strlen(src);
     l->pos = 0;
     l->line = 1;
-    l->col = 1;
+    l->line_start = 0;
 }
 
 static char peek(Lexer *l) {
@@ -19,96 +68,213 @@ static char peek2(Lexer *l) {
     return l->src[l->pos + 1];
 }
 
-static char peek3(Lexer *l) {
-    return l->src[l->pos + 2];
+static void newline_at(Lexer *l, int pos) {
+    l->line++;
+    l->line_start = pos + 1;
 }
 
 static char advance(Lexer *l) {
     char c = l->src[l->pos++];
-    if (c == '\n') { l->line++; l->col = 1; }
-    else { l->col++; }
+    if (c == '\n') newline_at(l, l->pos - 1);
     return c;
 }
 
+#ifdef VW
+/* a ... b as signed bytes; everything >= 0x80 falls outside */
+static vbyte vrange(vbyte v, char a, char b) {
+    return vand(vgt(v, vsplat(a - 1)), vgt(vsplat(b + 1), v));
+}
+#endif
+
+/* gaps between tokens and identifiers are mostly a few bytes long, so
+   those two scans start scalar and only go wide once a run gets longer */
+static void skip_spaces(Lexer *l) {
+    const char *s = l->src;
+    int pos = l->pos;
+#ifdef VW
+    int scalar_end = pos + VW;
+    for (; pos < scalar_end && cc(s[pos], CC_SPACE); pos++)
+        if (s[pos] == '\n') newline_at(l, pos);
+    if (pos < scalar_end) {
+        l->pos = pos;
+        return;
+    }
+    for (; pos + VW <= l->len; pos += VW) {
+        vbyte v = vload(s + pos);
+        unsigned space = vmask(vor(vor(veq(v, ' '), veq(v, '\t')), vor(veq(v, '\n'), veq(v, '\r'))));
+        unsigned nl = vmask(veq(v, '\n'));
+        unsigned stop = ~space & VFULL;
+        if (stop) nl &= (stop & -stop) - 1;
+        if (nl) {
+            l->line += __builtin_popcount(nl);
+            l->line_start = pos + 32 - __builtin_clz(nl);
+        }
+        if (stop) {
+            l->pos = pos + __builtin_ctz(stop);
+            return;
+        }
+    }
+#endif
+    for (; cc(s[pos], CC_SPACE); pos++)
+        if (s[pos] == '\n') newline_at(l, pos);
+    l->pos = pos;
+}
+
+/* stops at the newline that ends the comment, or the end of input */
+static void skip_line_comment(Lexer *l) {
+    const char *s = l->src;
+    int pos = l->pos;
+#ifdef VW
+    for (; pos + VW <= l->len; pos += VW) {
+        unsigned stop = vmask(veq(vload(s + pos), '\n'));
+        if (stop) {
+            l->pos = pos + __builtin_ctz(stop);
+            return;
+        }
+    }
+#endif
+    while (s[pos] && s[pos] != '\n') pos++;
+    l->pos = pos;
+}
+
+/* next '*' or newline at or after pos, or the end of input */
+static int span_block_comment(const Lexer *l, int pos) {
+    const char *s = l->src;
+#ifdef VW
+    for (; pos + VW <= l->len; pos += VW) {
+        vbyte v = vload(s + pos);
+        unsigned stop = vmask(vor(veq(v, '*'), veq(v, '\n')));
+        if (stop) return pos + __builtin_ctz(stop);
+    }
+#endif
+    while (s[pos] && s[pos] != '*' && s[pos] != '\n') pos++;
+    return pos;
+}
+
+/* next quote, backslash or newline inside a string literal */
+static int span_string(const Lexer *l, int pos) {
+    const char *s = l->src;
+#ifdef VW
+    for (; pos + VW <= l->len; pos += VW) {
+        vbyte v = vload(s + pos);
+        unsigned stop = vmask(vor(vor(veq(v, '"'), veq(v, '\\')), veq(v, '\n')));
+        if (stop) return pos + __builtin_ctz(stop);
+    }
+#endif
+    while (s[pos] && s[pos] != '"' && s[pos] != '\\' && s[pos] != '\n') pos++;
+    return pos;
+}
+
+static int span_ident(const Lexer *l, int pos) {
+    const char *s = l->src;
+#ifdef VW
+    int scalar_end = pos + VW;
+    while (pos < scalar_end && cc(s[pos], CC_IDENT)) pos++;
+    if (pos < scalar_end) return pos;
+    for (; pos + VW <= l->len; pos += VW) {
+        vbyte v = vload(s + pos);
+        vbyte word = vor(vor(vrange(vor(v, vsplat(0x20)), 'a', 'z'), vrange(v, '0', '9')), veq(v, '_'));
+        unsigned stop = ~vmask(word) & VFULL;
+        if (stop) return pos + __builtin_ctz(stop);
+    }
+#endif
+    while (cc(s[pos], CC_IDENT)) pos++;
+    return pos;
+}
+
 static void skip_ws(Lexer *l) {
     for (;;) {
+        skip_spaces(l);
         char c = peek(l);
-        if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
-            advance(l);
-            continue;
-        }
         if (c == '/' && peek2(l) == '/') {
-            while (peek(l) && peek(l) != '\n') advance(l);
+            skip_line_comment(l);
             continue;
         }
         if (c == '/' && peek2(l) == '*') {
-            advance(l); advance(l);
-            while (peek(l) && !(peek(l) == '*' && peek2(l) == '/'))
+            l->pos += 2;
+            for (;;) {
+                l->pos = span_block_comment(l, l->pos);
+                char d = peek(l);
+                if (d == '\0') break;
+                if (d == '*' && peek2(l) == '/') { l->pos += 2; break; }
                 advance(l);
-            if (peek(l)) { advance(l); advance(l); }
+            }
             continue;
         }
         break;
     }
 }
 
-static Token tok(TokenKind kind, const char *text, int line, int col) {
+static Token tok(TokenKind kind, int off, int len, int line, int col) {
     Token t;
     t.kind = kind;
+    t.off = off;
+    t.len = len;
     t.line = line;
     t.col = col;
-    strncpy(t.text, text, sizeof(t.text) - 1);
-    t.text[sizeof(t.text) - 1] = '\0';
+    t.atom = 0;
     return t;
 }
 
-static TokenKind keyword(const char *w) {
-    if (strcmp(w, "string") == 0) return TOK_STRING_KW;
-    if (strcmp(w, "int") == 0) return TOK_INT_KW;
-    if (strcmp(w, "float") == 0) return TOK_FLOAT_KW;
-    if (strcmp(w, "double") == 0) return TOK_DOUBLE_KW;
-    if (strcmp(w, "char") == 0) return TOK_CHAR_KW;
-    if (strcmp(w, "bool") == 0) return TOK_BOOL_KW;
-    if (strcmp(w, "long") == 0) return TOK_LONG_KW;
-    if (strcmp(w, "short") == 0) return TOK_SHORT_KW;
-    if (strcmp(w, "void") == 0) return TOK_VOID_KW;
-    if (strcmp(w, "enum") == 0) return TOK_ENUM_KW;
-    if (strcmp(w, "match") == 0) return TOK_MATCH_KW;
-    if (strcmp(w, "true") == 0) return TOK_TRUE_KW;
-    if (strcmp(w, "false") == 0) return TOK_FALSE_KW;
-    if (strcmp(w, "Result") == 0) return TOK_RESULT_KW;
-    if (strcmp(w, "map") == 0) return TOK_MAP_KW;
-    if (strcmp(w, "Ok") == 0) return TOK_OK_KW;
-    if (strcmp(w, "Err") == 0) return TOK_ERR_KW;
-    if (strcmp(w, "if") == 0) return TOK_IF_KW;
-    if (strcmp(w, "else") == 0) return TOK_ELSE_KW;
-    if (strcmp(w, "for") == 0) return TOK_FOR_KW;
-    if (strcmp(w, "while") == 0) return TOK_WHILE_KW;
-    if (strcmp(w, "return") == 0) return TOK_RETURN_KW;
-    if (strcmp(w, "null") == 0) return TOK_NULL_KW;
-    if (strcmp(w, "struct") == 0) return TOK_STRUCT_KW;
-    if (strcmp(w, "union") == 0) return TOK_UNION_KW;
-    if (strcmp(w, "typedef") == 0) return TOK_TYPEDEF_KW;
-    if (strcmp(w, "switch") == 0) return TOK_SWITCH_KW;
-    if (strcmp(w, "case") == 0) return TOK_CASE_KW;
-    if (strcmp(w, "default") == 0) return TOK_DEFAULT_KW;
-    if (strcmp(w, "do") == 0) return TOK_DO_KW;
-    if (strcmp(w, "break") == 0) return TOK_BREAK_KW;
-    if (strcmp(w, "continue") == 0) return TOK_CONTINUE_KW;
-    if (strcmp(w, "sizeof") == 0) return TOK_SIZEOF_KW;
-    if (strcmp(w, "static") == 0) return TOK_STATIC_KW;
-    if (strcmp(w, "const") == 0) return TOK_CONST_KW;
-    if (strcmp(w, "extern") == 0) return TOK_EXTERN_KW;
-    if (strcmp(w, "unsigned") == 0) return TOK_UNSIGNED_KW;
-    if (strcmp(w, "signed") == 0) return TOK_SIGNED_KW;
-    if (strcmp(w, "goto") == 0) return TOK_GOTO_KW;
-    if (strcmp(w, "volatile") == 0) return TOK_VOLATILE_KW;
-    if (strcmp(w, "register") == 0) return TOK_REGISTER_KW;
-    if (strcmp(w, "inline") == 0) return TOK_INLINE_KW;
-    if (strcmp(w, "NULL") == 0) return TOK_NULL_KW;
-    if (strcmp(w, "in") == 0) return TOK_IN_KW;
-    if (strcmp(w, "Future") == 0) return TOK_FUTURE_KW;
-    if (strcmp(w, "await") == 0) return TOK_AWAIT_KW;
+/* keywords are found with a perfect hash over (first byte, last byte,
+   length), checked offline to be collision-free for this set; a new keyword
+   needs a slot that no other keyword hashes to */
+#define KW_HASH(w, len) \
+    (((unsigned char)(w)[0] * 19u + (unsigned char)(w)[(len) - 1] * 14u + (unsigned)(len) * 5u) & 127u)
+
+static const struct { const char *word; int len; TokenKind kind; } keywords[128] = {
+    [3] = { "float", 5, TOK_FLOAT_KW },
+    [6] = { "NULL", 4, TOK_NULL_KW },
+    [7] = { "continue", 8, TOK_CONTINUE_KW },
+    [8] = { "do", 2, TOK_DO_KW },
+    [9] = { "enum", 4, TOK_ENUM_KW },
+    [12] = { "Result", 6, TOK_RESULT_KW },
+    [16] = { "double", 6, TOK_DOUBLE_KW },
+    [17] = { "static", 6, TOK_STATIC_KW },
+    [24] = { "return", 6, TOK_RETURN_KW },
+    [25] = { "else", 4, TOK_ELSE_KW },
+    [31] = { "signed", 6, TOK_SIGNED_KW },
+    [33] = { "extern", 6, TOK_EXTERN_KW },
+    [36] = { "await", 5, TOK_AWAIT_KW },
+    [38] = { "null", 4, TOK_NULL_KW },
+    [41] = { "char", 4, TOK_CHAR_KW },
+    [49] = { "false", 5, TOK_FALSE_KW },
+    [50] = { "int", 3, TOK_INT_KW },
+    [54] = { "true", 4, TOK_TRUE_KW },
+    [57] = { "break", 5, TOK_BREAK_KW },
+    [58] = { "long", 4, TOK_LONG_KW },
+    [59] = { "sizeof", 6, TOK_SIZEOF_KW },
+    [65] = { "Ok", 2, TOK_OK_KW },
+    [66] = { "bool", 4, TOK_BOOL_KW },
+    [70] = { "map", 3, TOK_MAP_KW },
+    [73] = { "string", 6, TOK_STRING_KW },
+    [74] = { "const", 5, TOK_CONST_KW },
+    [75] = { "goto", 4, TOK_GOTO_KW },
+    [76] = { "union", 5, TOK_UNION_KW },
+    [78] = { "void", 4, TOK_VOID_KW },
+    [79] = { "unsigned", 8, TOK_UNSIGNED_KW },
+    [83] = { "typedef", 7, TOK_TYPEDEF_KW },
+    [86] = { "Future", 6, TOK_FUTURE_KW },
+    [87] = { "switch", 6, TOK_SWITCH_KW },
+    [89] = { "in", 2, TOK_IN_KW },
+    [90] = { "register", 8, TOK_REGISTER_KW },
+    [93] = { "for", 3, TOK_FOR_KW },
+    [96] = { "match", 5, TOK_MATCH_KW },
+    [103] = { "default", 7, TOK_DEFAULT_KW },
+    [105] = { "if", 2, TOK_IF_KW },
+    [106] = { "Err", 3, TOK_ERR_KW },
+    [111] = { "inline", 6, TOK_INLINE_KW },
+    [112] = { "volatile", 8, TOK_VOLATILE_KW },
+    [115] = { "case", 4, TOK_CASE_KW },
+    [116] = { "while", 5, TOK_WHILE_KW },
+    [122] = { "short", 5, TOK_SHORT_KW },
+    [127] = { "struct", 6, TOK_STRUCT_KW },
+};
+
+static TokenKind keyword_span(const char *w, int len) {
+    unsigned h = KW_HASH(w, len);
+    if (keywords[h].len == len && memcmp(keywords[h].word, w, len) == 0)
+        return keywords[h].kind;
     return TOK_IDENT;
 }
 
@@ -116,45 +282,49 @@ Token lexer_next(Lexer *l) {
     skip_ws(l);
 
     int line = l->line;
-    int col = l->col;
+    int col = l->pos - l->line_start + 1;
     char c = peek(l);
 
-    if (c == '\0') return tok(TOK_EOF, "", line, col);
+    int start = l->pos;
+
+    if (c == '\0') return tok(TOK_EOF, start, 0, line, col);
 
     if (c == '"') {
-        advance(l);
-        int start = l->pos;
-        while (peek(l) && peek(l) != '"') {
-            if (peek(l) == '\\') advance(l);
-            if (peek(l)) advance(l);
+        l->pos++;
+        int body = l->pos;
+        for (;;) {
+            l->pos = span_string(l, l->pos);
+            char d = peek(l);
+            if (d == '\0' || d == '"') break;
+            if (d == '\\') {
+                l->pos++;
+                if (peek(l)) advance(l);
+            } else {
+                advance(l);
+            }
         }
-        int len = l->pos - start;
-        char buf[256] = {0};
-        if (len > 255) len = 255;
-        memcpy(buf, l->src + start, len);
-        advance(l);
-        return tok(TOK_STRLIT, buf, line, col);
+        int len = l->pos - body;
+        if (peek(l)) l->pos++;
+        return tok(TOK_STRLIT, body, len, line, col);
     }
 
-    if (isdigit(c)) {
-        int start = l->pos;
+    if (cc(c, CC_DIGIT)) {
         int is_float = 0;
-
         if (c == '0' && (peek2(l) == 'x' || peek2(l) == 'X')) {
-            advance(l); advance(l);
-            while (isxdigit(peek(l))) advance(l);
+            l->pos += 2;
+            while (cc(peek(l), CC_HEX)) l->pos++;
         } else {
-            while (isdigit(peek(l))) advance(l);
-            if (peek(l) == '.' && isdigit(l->src[l->pos + 1])) {
+            while (cc(peek(l), CC_DIGIT)) l->pos++;
+            if (peek(l) == '.' && cc(peek2(l), CC_DIGIT)) {
                 is_float = 1;
-                advance(l);
-                while (isdigit(peek(l))) advance(l);
+                l->pos++;
+                while (cc(peek(l), CC_DIGIT)) l->pos++;
             }
             if (peek(l) == 'e' || peek(l) == 'E') {
                 is_float = 1;
-                advance(l);
-                if (peek(l) == '+' || peek(l) == '-') advance(l);
-                while (isdigit(peek(l))) advance(l);
+                l->pos++;
+                if (peek(l) == '+' || peek(l) == '-') l->pos++;
+                while (cc(peek(l), CC_DIGIT)) l->pos++;
             }
         }
 
@@ -162,102 +332,123 @@ Token lexer_next(Lexer *l) {
                peek(l) == 'U' || peek(l) == 'u' ||
                peek(l) == 'f' || peek(l) == 'F') {
             if (peek(l) == 'f' || peek(l) == 'F') is_float = 1;
-            advance(l);
+            l->pos++;
         }
 
-        int len = l->pos - start;
-        char buf[64] = {0};
-        if (len > 63) len = 63;
-        memcpy(buf, l->src + start, len);
-        return tok(is_float ? TOK_FLOATLIT : TOK_INTLIT, buf, line, col);
+        return tok(is_float ? TOK_FLOATLIT : TOK_INTLIT, start, l->pos - start, line, col);
     }
 
     if (c == '\'') {
         advance(l);
-        int start = l->pos;
+        int body = l->pos;
         if (peek(l) == '\\') {
             advance(l);
-            advance(l);
-        } else {
+            if (peek(l)) advance(l);
+        } else if (peek(l)) {
             advance(l);
         }
-        int len = l->pos - start;
-        char buf[8] = {0};
-        if (len > 7) len = 7;
-        memcpy(buf, l->src + start, len);
+        int len = l->pos - body;
         if (peek(l) == '\'') advance(l);
-        return tok(TOK_CHARLIT, buf, line, col);
+        return tok(TOK_CHARLIT, body, len, line, col);
     }
 
-    if (isalpha(c) || c == '_') {
-        int start = l->pos;
-        while (isalnum(peek(l)) || peek(l) == '_') advance(l);
+    if (cc(c, CC_ALPHA)) {
+        l->pos = span_ident(l, l->pos + 1);
         int len = l->pos - start;
-        char buf[256] = {0};
-        if (len > 255) len = 255;
-        memcpy(buf, l->src + start, len);
-        return tok(keyword(buf), buf, line, col);
+        Token t = tok(keyword_span(l->src + start, len), start, len, line, col);
+        if (t.kind == TOK_IDENT) t.atom = intern(l->src + start, len);
+        return t;
     }
 
     char c2 = peek2(l);
-    char c3 = peek3(l);
-
-    if (c == '<' && c2 == '<' && c3 == '=') { advance(l); advance(l); advance(l); return tok(TOK_LSHIFTEQ, "<<=", line, col); }
-    if (c == '>' && c2 == '>' && c3 == '=') { advance(l); advance(l); advance(l); return tok(TOK_RSHIFTEQ, ">>=", line, col); }
-    if (c == '.' && c2 == '.' && c3 == '.') { advance(l); advance(l); advance(l); return tok(TOK_ELLIPSIS, "...", line, col); }
-    if (c == '.' && c2 == '.' && c3 != '.') { advance(l); advance(l); return tok(TOK_DOTDOT, "..", line, col); }
-
-    if (c == ':' && c2 == ':') { advance(l); advance(l); return tok(TOK_COLONCOLON, "::", line, col); }
-    if (c == '=' && c2 == '>') { advance(l); advance(l); return tok(TOK_FATARROW, "=>", line, col); }
-    if (c == '=' && c2 == '=') { advance(l); advance(l); return tok(TOK_EQEQ, "==", line, col); }
-    if (c == '!' && c2 == '=') { advance(l); advance(l); return tok(TOK_NEQ, "!=", line, col); }
-    if (c == '<' && c2 == '<') { advance(l); advance(l); return tok(TOK_LSHIFT, "<<", line, col); }
-    if (c == '<' && c2 == '=') { advance(l); advance(l); return tok(TOK_LTEQ, "<=", line, col); }
-    if (c == '>' && c2 == '>') { advance(l); advance(l); return tok(TOK_RSHIFT, ">>", line, col); }
-    if (c == '>' && c2 == '=') { advance(l); advance(l); return tok(TOK_GTEQ, ">=", line, col); }
-    if (c == '&' && c2 == '&') { advance(l); advance(l); return tok(TOK_AND, "&&", line, col); }
-    if (c == '&' && c2 == '=') { advance(l); advance(l); return tok(TOK_AMPEQ, "&=", line, col); }
-    if (c == '|' && c2 == '|') { advance(l); advance(l); return tok(TOK_OR, "||", line, col); }
-    if (c == '|' && c2 == '>') { advance(l); advance(l); return tok(TOK_PIPEARROW, "|>", line, col); }
-    if (c == '|' && c2 == '=') { advance(l); advance(l); return tok(TOK_PIPEEQ, "|=", line, col); }
-    if (c == '^' && c2 == '=') { advance(l); advance(l); return tok(TOK_CARETEQ, "^=", line, col); }
-    if (c == '%' && c2 == '=') { advance(l); advance(l); return tok(TOK_PERCENTEQ, "%=", line, col); }
-    if (c == '-' && c2 == '>') { advance(l); advance(l); return tok(TOK_ARROW, "->", line, col); }
-    if (c == '+' && c2 == '=') { advance(l); advance(l); return tok(TOK_PLUSEQ, "+=", line, col); }
-    if (c == '-' && c2 == '=') { advance(l); advance(l); return tok(TOK_MINUSEQ, "-=", line, col); }
-    if (c == '*' && c2 == '=') { advance(l); advance(l); return tok(TOK_STAREQ, "*=", line, col); }
-    if (c == '/' && c2 == '=') { advance(l); advance(l); return tok(TOK_SLASHEQ, "/=", line, col); }
-    if (c == '+' && c2 == '+') { advance(l); advance(l); return tok(TOK_PLUSPLUS, "++", line, col); }
-    if (c == '-' && c2 == '-') { advance(l); advance(l); return tok(TOK_MINUSMINUS, "--", line, col); }
+    char c3 = c2 ? l->src[l->pos + 2] : '\0';
+
+    if (c == '<' && c2 == '<' && c3 == '=') { advance(l); advance(l); advance(l); return tok(TOK_LSHIFTEQ, start, 3, line, col); }
+    if (c == '>' && c2 == '>' && c3 == '=') { advance(l); advance(l); advance(l); return tok(TOK_RSHIFTEQ, start, 3, line, col); }
+    if (c == '.' && c2 == '.' && c3 == '.') { advance(l); advance(l); advance(l); return tok(TOK_ELLIPSIS, start, 3, line, col); }
+    if (c == '.' && c2 == '.' && c3 != '.') { advance(l); advance(l); return tok(TOK_DOTDOT, start, 2, line, col); }
+
+    if (c == ':' && c2 == ':') { advance(l); advance(l); return tok(TOK_COLONCOLON, start, 2, line, col); }
+    if (c == '=' && c2 == '>') { advance(l); advance(l); return tok(TOK_FATARROW, start, 2, line, col); }
+    if (c == '=' && c2 == '=') { advance(l); advance(l); return tok(TOK_EQEQ, start, 2, line, col); }
+    if (c == '!' && c2 == '=') { advance(l); advance(l); return tok(TOK_NEQ, start, 2, line, col); }
+    if (c == '<' && c2 == '<') { advance(l); advance(l); return tok(TOK_LSHIFT, start, 2, line, col); }
+    if (c == '<' && c2 == '=') { advance(l); advance(l); return tok(TOK_LTEQ, start, 2, line, col); }
+    if (c == '>' && c2 == '>') { advance(l); advance(l); return tok(TOK_RSHIFT, start, 2, line, col); }
+    if (c == '>' && c2 == '=') { advance(l); advance(l); return tok(TOK_GTEQ, start, 2, line, col); }
+    if (c == '&' && c2 == '&') { advance(l); advance(l); return tok(TOK_AND, start, 2, line, col); }
+    if (c == '&' && c2 == '=') { advance(l); advance(l); return tok(TOK_AMPEQ, start, 2, line, col); }
+    if (c == '|' && c2 == '|') { advance(l); advance(l); return tok(TOK_OR, start, 2, line, col); }
+    if (c == '|' && c2 == '>') { advance(l); advance(l); return tok(TOK_PIPEARROW, start, 2, line, col); }
+    if (c == '|' && c2 == '=') { advance(l); advance(l); return tok(TOK_PIPEEQ, start, 2, line, col); }
+    if (c == '^' && c2 == '=') { advance(l); advance(l); return tok(TOK_CARETEQ, start, 2, line, col); }
+    if (c == '%' && c2 == '=') { advance(l); advance(l); return tok(TOK_PERCENTEQ, start, 2, line, col); }
+    if (c == '-' && c2 == '>') { advance(l); advance(l); return tok(TOK_ARROW, start, 2, line, col); }
+    if (c == '+' && c2 == '=') { advance(l); advance(l); return tok(TOK_PLUSEQ, start, 2, line, col); }
+    if (c == '-' && c2 == '=') { advance(l); advance(l); return tok(TOK_MINUSEQ, start, 2, line, col); }
+    if (c == '*' && c2 == '=') { advance(l); advance(l); return tok(TOK_STAREQ, start, 2, line, col); }
+    if (c == '/' && c2 == '=') { advance(l); advance(l); return tok(TOK_SLASHEQ, start, 2, line, col); }
+    if (c == '+' && c2 == '+') { advance(l); advance(l); return tok(TOK_PLUSPLUS, start, 2, line, col); }
+    if (c == '-' && c2 == '-') { advance(l); advance(l); return tok(TOK_MINUSMINUS, start, 2, line, col); }
 
     advance(l);
     switch (c) {
-        case '{': return tok(TOK_LBRACE, "{", line, col);
-        case '}': return tok(TOK_RBRACE, "}", line, col);
-        case '(': return tok(TOK_LPAREN, "(", line, col);
-        case ')': return tok(TOK_RPAREN, ")", line, col);
-        case ',': return tok(TOK_COMMA, ",", line, col);
-        case ';': return tok(TOK_SEMI, ";", line, col);
-        case '=': return tok(TOK_EQ, "=", line, col);
-        case '[': return tok(TOK_LBRACKET, "[", line, col);
-        case ']': return tok(TOK_RBRACKET, "]", line, col);
-        case '<': return tok(TOK_LT, "<", line, col);
-        case '>': return tok(TOK_GT, ">", line, col);
-        case '.': return tok(TOK_DOT, ".", line, col);
-        case '+': return tok(TOK_PLUS, "+", line, col);
-        case '-': return tok(TOK_MINUS, "-", line, col);
-        case '*': return tok(TOK_STAR, "*", line, col);
-        case '/': return tok(TOK_SLASH, "/", line, col);
-        case '%': return tok(TOK_PERCENT, "%", line, col);
-        case '!': return tok(TOK_BANG, "!", line, col);
-        case ':': return tok(TOK_COLON, ":", line, col);
-        case '?': return tok(TOK_QUESTION, "?", line, col);
-        case '&': return tok(TOK_AMP, "&", line, col);
-        case '|': return tok(TOK_PIPE, "|", line, col);
-        case '^': return tok(TOK_CARET, "^", line, col);
-        case '~': return tok(TOK_TILDE, "~", line, col);
+        case '{': return tok(TOK_LBRACE, start, 1, line, col);
+        case '}': return tok(TOK_RBRACE, start, 1, line, col);
+        case '(': return tok(TOK_LPAREN, start, 1, line, col);
+        case ')': return tok(TOK_RPAREN, start, 1, line, col);
+        case ',': return tok(TOK_COMMA, start, 1, line, col);
+        case ';': return tok(TOK_SEMI, start, 1, line, col);
+        case '=': return tok(TOK_EQ, start, 1, line, col);
+        case '[': return tok(TOK_LBRACKET, start, 1, line, col);
+        case ']': return tok(TOK_RBRACKET, start, 1, line, col);
+        case '<': return tok(TOK_LT, start, 1, line, col);
+        case '>': return tok(TOK_GT, start, 1, line, col);
+        case '.': return tok(TOK_DOT, start, 1, line, col);
+        case '+': return tok(TOK_PLUS, start, 1, line, col);
+        case '-': return tok(TOK_MINUS, start, 1, line, col);
+        case '*': return tok(TOK_STAR, start, 1, line, col);
+        case '/': return tok(TOK_SLASH, start, 1, line, col);
+        case '%': return tok(TOK_PERCENT, start, 1, line, col);
+        case '!': return tok(TOK_BANG, start, 1, line, col);
+        case ':': return tok(TOK_COLON, start, 1, line, col);
+        case '?': return tok(TOK_QUESTION, start, 1, line, col);
+        case '&': return tok(TOK_AMP, start, 1, line, col);
+        case '|': return tok(TOK_PIPE, start, 1, line, col);
+        case '^': return tok(TOK_CARET, start, 1, line, col);
+        case '~': return tok(TOK_TILDE, start, 1, line, col);
+    }
+
+    return tok(TOK_UNKNOWN, start, 1, line, col);
+}
+
+void lexer_lex_all(Lexer *l, TokenList *out) {
+    out->count = 0;
+    if (out->cap == 0) {
+        out->cap = 1024;
+        out->toks = malloc(out->cap * sizeof(Token));
+        moxy_alloc_bytes += out->cap * sizeof(Token);
     }
+    for (;;) {
+        /* keep two spare slots so the parser's lookahead past EOF stays in bounds */
+        if (out->count + 3 > out->cap) {
+            out->cap *= 2;
+            out->toks = realloc(out->toks, out->cap * sizeof(Token));
+            moxy_alloc_bytes += out->cap * sizeof(Token);
+        }
+        Token t = lexer_next(l);
+        out->toks[out->count++] = t;
+        if (t.kind == TOK_EOF) {
+            out->toks[out->count] = t;
+            out->toks[out->count + 1] = t;
+            break;
+        }
+    }
+}
 
-    char unk[4] = {c, '\0'};
-    return tok(TOK_UNKNOWN, unk, line, col);
+void token_list_free(TokenList *tl) {
+    free(tl->toks);
+    tl->toks = NULL;
+    tl->count = 0;
+    tl->cap = 0;
 }
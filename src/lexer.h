@@ -3,14 +3,24 @@
 
 #include "token.h"
 
+/* col is not tracked per byte; it is pos - line_start + 1 */
 typedef struct {
     const char *src;
+    int len;
     int pos;
     int line;
-    int col;
+    int line_start;
 } Lexer;
 
+typedef struct {
+    Token *toks;
+    int count;
+    int cap;
+} TokenList;
+
 void lexer_init(Lexer *l, const char *src);
 Token lexer_next(Lexer *l);
+void lexer_lex_all(Lexer *l, TokenList *out);
+void token_list_free(TokenList *tl);
 
 #endif
@@ -0,0 +1,119 @@
+#include "moxy.h"
+#include "lexer.h"
+#include "parser.h"
+#include "codegen.h"
+#include "diag.h"
+#include "flags.h"
+#include "intern.h"
+#include "preprocess.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Everything a compilation touches is per thread (codegen, parser and
+   diag state, flags, the installed intern table) or created per call
+   (names, the include cache), so a call only has to install its own
+   tables and put the thread's back afterwards. Errors unwind here through
+   the diag capture instead of exiting. */
+
+static void take_diags(MoxyResult *out, DiagCapture *cap) {
+    if (cap->count == 0) return;
+    out->diags = malloc(cap->count * sizeof(MoxyDiagnostic));
+    if (!out->diags) {
+        for (int i = 0; i < cap->count; i++) free(cap->items[i].message);
+        free(cap->items);
+        return;
+    }
+    for (int i = 0; i < cap->count; i++) {
+        Diagnostic *d = &cap->items[i];
+        MoxyDiagnostic *md = &out->diags[i];
+        md->kind = d->kind == DIAG_ERROR ? MOXY_ERROR
+                 : d->kind == DIAG_WARNING ? MOXY_WARNING : MOXY_HINT;
+        md->line = d->line;
+        md->col = d->col;
+        md->span = d->span;
+        md->message = d->message;
+    }
+    out->ndiags = cap->count;
+    free(cap->items);
+}
+
+int moxy_transpile(const char *src, size_t len, const MoxyOptions *opts, MoxyResult *out) {
+    memset(out, 0, sizeof(*out));
+    const char *path = opts ? opts->path : NULL;
+
+    /* allocated before setjmp so an unwind can still free them */
+    char *text = malloc(len + 1);
+    TokenList *tl = calloc(1, sizeof(TokenList));
+    Arena *arena = calloc(1, sizeof(Arena));
+    DiagCapture *cap = calloc(1, sizeof(DiagCapture));
+    if (!text || !tl || !arena || !cap) {
+        free(text);
+        free(tl);
+        free(arena);
+        free(cap);
+        return -1;
+    }
+    memcpy(text, src, len);
+    text[len] = '\0';
+
+    int saved_async = moxy_async_enabled;
+    int saved_arc = moxy_arc_enabled;
+    moxy_async_enabled = opts && opts->enable_async;
+    moxy_arc_enabled = opts && opts->enable_arc;
+
+    InternTable *names = intern_table_new();
+    InternTable *prev_names = intern_use(names);
+    PPCache *pp = pp_cache_new();
+
+    char *volatile pre = NULL;
+    volatile int status = -1;
+
+    DiagCapture *prev_cap = diag_capture(cap);
+
+    if (setjmp(cap->bail) == 0) {
+        codegen_reset_includes();
+        pre = preprocess_source(pp, text, path);
+        diag_init(pre, path);
+
+        Lexer lexer;
+        lexer_init(&lexer, pre);
+        lexer_lex_all(&lexer, tl);
+        Node *program = parse(arena, pre, tl->toks, tl->count);
+        const char *c_code = codegen(program);
+
+        size_t c_len = strlen(c_code);
+        out->c_code = malloc(c_len + 1);
+        if (out->c_code) {
+            memcpy(out->c_code, c_code, c_len + 1);
+            out->c_len = c_len;
+            status = 0;
+        }
+    }
+
+    diag_capture(prev_cap);
+    diag_init(NULL, NULL);
+    codegen_release();
+    take_diags(out, cap);
+
+    token_list_free(tl);
+    arena_free(arena);
+    free(tl);
+    free(arena);
+    free(cap);
+    free(pre);
+    free(text);
+    pp_cache_free(pp);
+    intern_use(prev_names);
+    intern_table_free(names);
+    moxy_async_enabled = saved_async;
+    moxy_arc_enabled = saved_arc;
+    return status;
+}
+
+void moxy_result_free(MoxyResult *r) {
+    if (!r) return;
+    for (int i = 0; i < r->ndiags; i++) free(r->diags[i].message);
+    free(r->diags);
+    free(r->c_code);
+    memset(r, 0, sizeof(*r));
+}
@@ -6,6 +6,12 @@
 #include <sys/wait.h>
 #include <dirent.h>
 #include <sys/time.h>
+#include <sys/resource.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <errno.h>
+#include <fcntl.h>
 #include "token.h"
 #include "lexer.h"
 #include "parser.h"
@@ -15,7 +21,9 @@
 #include "fmt.h"
 #include "lint.h"
 #include "flags.h"
+#include "intern.h"
 #include "mxystdlib.h"
+#include "preprocess.h"
 
 /* goose library headers */
 #include "headers/main.h"
@@ -47,19 +55,6 @@ static char *read_file(const char *path) {
     return buf;
 }
 
-static char *try_read_file(const char *path) {
-    FILE *f = fopen(path, "r");
-    if (!f) return NULL;
-    fseek(f, 0, SEEK_END);
-    long len = ftell(f);
-    fseek(f, 0, SEEK_SET);
-    char *buf = malloc(len + 1);
-    fread(buf, 1, len, f);
-    buf[len] = '\0';
-    fclose(f);
-    return buf;
-}
-
 static void dir_of(const char *path, char *buf, int bufsz) {
     const char *last = strrchr(path, '/');
     if (!last) {
@@ -103,194 +98,324 @@ static char *find_project_yaml(const char *file_dir) {
     return NULL;
 }
 
-/* ── preprocessor ────────────────────────────────────────────── */
+static double now_ms(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
 
-static char *preprocess(const char *src, const char *srcpath) {
-    char basedir[512];
-    dir_of(srcpath, basedir, sizeof(basedir));
+static void json_string(FILE *f, const char *s) {
+    fputc('"', f);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') fputc('\\', f);
+        fputc(*s, f);
+    }
+    fputc('"', f);
+}
 
-    int cap = (int)strlen(src) * 2 + 4096;
-    char *out = malloc(cap);
-    int pos = 0;
+/* ── pass timing (--time-passes) ─────────────────────────────── */
+
+/* With --time-passes every transpile records the wall time and the bytes
+   allocated (moxy_alloc_bytes) of each phase, and every C compile its
+   wall time. Records come from any thread; the report is printed, or
+   written as JSON, when the command returns. */
+
+enum { PASS_PREPROCESS, PASS_LEX, PASS_PARSE, PASS_CODEGEN, PASS_CC, NPASSES };
+
+static const char *pass_names[NPASSES] = { "preprocess", "lex", "parse", "codegen", "cc" };
+
+typedef struct {
+    char name[512];
+    int is_cc;
+    double ms[NPASSES];
+    unsigned long long bytes[NPASSES];
+    long rss_kb;        /* moxy's peak RSS when the record was made */
+} PassRecord;
+
+static int time_passes;
+static const char *time_passes_json;    /* --time-passes-json FILE, or NULL */
+static double pass_start_ms;
+static PassRecord *pass_records;
+static int npass_records, pass_records_cap;
+static pthread_mutex_t pass_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* the phases of one compilation or compile, from pass_begin to pass_end */
+typedef struct {
+    double t;
+    unsigned long long bytes;
+    PassRecord rec;
+} PassClock;
+
+static long peak_rss_kb(int who) {
+    struct rusage ru;
+    return getrusage(who, &ru) == 0 ? ru.ru_maxrss : 0;
+}
 
-    const char *p = src;
-    while (*p) {
-        const char *eol = strchr(p, '\n');
-        int linelen = eol ? (int)(eol - p) : (int)strlen(p);
-
-        const char *lp = p;
-        while (*lp == ' ' || *lp == '\t') lp++;
-
-        if (*lp == '@' && strncmp(lp, "@type", 5) == 0) {
-            const char *cur = lp + 5;
-            while (cur < p + linelen) {
-                while (cur < p + linelen && (*cur == ' ' || *cur == '\t' || *cur == ',')) cur++;
-                if (cur >= p + linelen || *cur == ';') break;
-                const char *start = cur;
-                while (cur < p + linelen && *cur != ',' && *cur != ';' && *cur != ' ' && *cur != '\t') cur++;
-                if (cur > start) {
-                    char tname[64];
-                    int tlen = (int)(cur - start);
-                    if (tlen > 63) tlen = 63;
-                    memcpy(tname, start, tlen);
-                    tname[tlen] = '\0';
-                    parser_register_type(tname);
-                }
-            }
-            p += linelen;
-            if (eol) p++;
-            continue;
-        }
+static void pass_begin(PassClock *pc) {
+    if (!time_passes) return;
+    memset(pc, 0, sizeof(*pc));
+    pc->t = now_ms();
+    pc->bytes = moxy_alloc_bytes;
+}
 
-        if (*lp == '#' && strncmp(lp, "#include", 8) != 0) {
-            char directive[512];
-            int dlen = linelen < 511 ? linelen : 511;
-            memcpy(directive, p, dlen);
-            directive[dlen] = '\0';
-            codegen_add_directive(directive);
+/* charges the time and allocations since the last mark to pass */
+static void pass_mark(PassClock *pc, int pass) {
+    if (!time_passes) return;
+    double t = now_ms();
+    pc->rec.ms[pass] += t - pc->t;
+    pc->rec.bytes[pass] += moxy_alloc_bytes - pc->bytes;
+    if (pass == PASS_CC) pc->rec.is_cc = 1;
+    pc->t = t;
+    pc->bytes = moxy_alloc_bytes;
+}
 
-            p += linelen;
-            if (eol) p++;
-            continue;
+static void pass_end(PassClock *pc, const char *name) {
+    if (!time_passes) return;
+    if (!name) name = "<source>";
+    if (name[0] == '.' && name[1] == '/') name += 2;
+    snprintf(pc->rec.name, sizeof(pc->rec.name), "%s", name);
+    pc->rec.rss_kb = peak_rss_kb(RUSAGE_SELF);
+
+    pthread_mutex_lock(&pass_lock);
+    if (npass_records == pass_records_cap) {
+        int cap = pass_records_cap ? pass_records_cap * 2 : 64;
+        PassRecord *grown = realloc(pass_records, cap * sizeof(PassRecord));
+        if (grown) {
+            pass_records = grown;
+            pass_records_cap = cap;
         }
+    }
+    if (npass_records < pass_records_cap)
+        pass_records[npass_records++] = pc->rec;
+    pthread_mutex_unlock(&pass_lock);
+}
 
-        if (strncmp(lp, "#include", 8) == 0 && (lp[8] == ' ' || lp[8] == '\t' || lp[8] == '"' || lp[8] == '<')) {
-            const char *after = lp + 8;
-            while (*after == ' ' || *after == '\t') after++;
-
-            char filename[256];
-            int is_angle = 0;
-
-            if (*after == '"') {
-                after++;
-                const char *end = strchr(after, '"');
-                if (end) {
-                    int flen = (int)(end - after);
-                    memcpy(filename, after, flen);
-                    filename[flen] = '\0';
-                } else {
-                    filename[0] = '\0';
-                }
-            } else if (*after == '<') {
-                is_angle = 1;
-                after++;
-                const char *end = strchr(after, '>');
-                if (end) {
-                    int flen = (int)(end - after);
-                    memcpy(filename, after, flen);
-                    filename[flen] = '\0';
-                } else {
-                    filename[0] = '\0';
-                }
-            } else {
-                filename[0] = '\0';
-            }
-
-            if (filename[0] && ends_with(filename, ".mxy")) {
-                char fullpath[768];
-                snprintf(fullpath, sizeof(fullpath), "%s/%s", basedir, filename);
-
-                char *inc_src = try_read_file(fullpath);
-                const char *vpath = fullpath;
-
-                if (!inc_src) {
-                    const char *embedded = stdlib_lookup(filename);
-                    if (embedded) {
-                        inc_src = strdup(embedded);
-                        vpath = filename;
-                    }
-                }
+/* the C builds of projects and libraries, timed as one cc step each */
+static int cc_build_project(Config *cfg, int release, const char *gen_dir) {
+    PassClock pc;
+    pass_begin(&pc);
+    int rc = build_project_at(cfg, release, gen_dir);
+    pass_mark(&pc, PASS_CC);
+    pass_end(&pc, cfg->name);
+    return rc;
+}
 
-                if (!inc_src) {
-                    fprintf(stderr, "moxy: cannot find '%s' (checked disk and stdlib)\n", filename);
-                    exit(1);
-                }
+static int cmp_pass_record(const void *a, const void *b) {
+    const PassRecord *x = a, *y = b;
+    if (x->is_cc != y->is_cc) return x->is_cc - y->is_cc;
+    return strcmp(x->name, y->name);
+}
 
-                char *processed = preprocess(inc_src, vpath);
+static void format_bytes(char *buf, size_t size, double bytes) {
+    if (bytes < 1024)              snprintf(buf, size, "%.0fB", bytes);
+    else if (bytes < 1024 * 1024)  snprintf(buf, size, "%.1fKB", bytes / 1024);
+    else                           snprintf(buf, size, "%.1fMB", bytes / (1024 * 1024));
+}
 
-                int plen = (int)strlen(processed);
-                while (pos + plen + 2 >= cap) {
-                    cap *= 2;
-                    out = realloc(out, cap);
-                }
-                memcpy(out + pos, processed, plen);
-                pos += plen;
-                if (plen > 0 && processed[plen - 1] != '\n') {
-                    out[pos++] = '\n';
-                }
+static void pass_print_row(const PassRecord *r, int is_total) {
+    unsigned long long alloc = 0;
+    fprintf(stderr, "  %-30s", r->name);
+    for (int p = 0; p < NPASSES; p++) {
+        int used = is_total || (r->is_cc ? p == PASS_CC : p != PASS_CC);
+        if (used) fprintf(stderr, " %10.2f", r->ms[p]);
+        else      fprintf(stderr, " %10s", "-");
+        alloc += r->bytes[p];
+    }
+    char a[32] = "-", rss[32] = "-";
+    if (!r->is_cc) format_bytes(a, sizeof(a), (double)alloc);
+    if (!is_total && !r->is_cc) format_bytes(rss, sizeof(rss), r->rss_kb * 1024.0);
+    fprintf(stderr, " %9s %9s\n", a, rss);
+}
 
-                free(processed);
-                free(inc_src);
-            } else if (filename[0]) {
-                char directive[300];
-                if (is_angle)
-                    snprintf(directive, sizeof(directive), "#include <%s>", filename);
-                else
-                    snprintf(directive, sizeof(directive), "#include \"%s\"", filename);
-                codegen_add_include(directive);
-            }
+static int pass_write_json(const char *path, const PassRecord *total, double wall_ms,
+                           long self_kb, long cc_kb) {
+    FILE *f = strcmp(path, "-") == 0 ? stdout : fopen(path, "w");
+    if (!f) {
+        fprintf(stderr, "moxy: cannot write '%s'\n", path);
+        return 1;
+    }
+    fprintf(f, "{\n  \"wall_ms\": %.3f,\n  \"cc_ms\": %.3f,\n", wall_ms, total->ms[PASS_CC]);
+    fprintf(f, "  \"peak_rss_kb\": %ld,\n  \"cc_peak_rss_kb\": %ld,\n", self_kb, cc_kb);
+    fprintf(f, "  \"totals\": {");
+    for (int p = 0; p < NPASSES; p++)
+        fprintf(f, "%s\"%s_ms\": %.3f, \"%s_bytes\": %llu", p ? ", " : "",
+                pass_names[p], total->ms[p], pass_names[p], total->bytes[p]);
+    fprintf(f, "},\n  \"records\": [\n");
+    for (int i = 0; i < npass_records; i++) {
+        const PassRecord *r = &pass_records[i];
+        fprintf(f, "    {\"name\": ");
+        json_string(f, r->name);
+        if (r->is_cc) {
+            fprintf(f, ", \"kind\": \"cc\", \"cc_ms\": %.3f}", r->ms[PASS_CC]);
         } else {
-            while (pos + linelen + 2 >= cap) {
-                cap *= 2;
-                out = realloc(out, cap);
-            }
-            memcpy(out + pos, p, linelen);
-            pos += linelen;
-            if (eol) out[pos++] = '\n';
+            fprintf(f, ", \"kind\": \"transpile\"");
+            for (int p = 0; p < PASS_CC; p++)
+                fprintf(f, ", \"%s_ms\": %.3f, \"%s_bytes\": %llu",
+                        pass_names[p], r->ms[p], pass_names[p], r->bytes[p]);
+            fprintf(f, ", \"peak_rss_kb\": %ld}", r->rss_kb);
         }
-
-        p += linelen;
-        if (eol) p++;
+        fprintf(f, "%s\n", i + 1 < npass_records ? "," : "");
     }
+    fprintf(f, "  ]\n}\n");
+    if (f == stdout) return 0;
+    return fclose(f) == 0 ? 0 : 1;
+}
 
-    out[pos] = '\0';
-    return out;
+static int pass_report(void) {
+    if (!time_passes) return 0;
+    double wall_ms = now_ms() - pass_start_ms;
+    long self_kb = peak_rss_kb(RUSAGE_SELF), cc_kb = peak_rss_kb(RUSAGE_CHILDREN);
+
+    qsort(pass_records, npass_records, sizeof(PassRecord), cmp_pass_record);
+    PassRecord total = {0};
+    int nfiles = 0;
+    for (int i = 0; i < npass_records; i++) {
+        for (int p = 0; p < NPASSES; p++) {
+            total.ms[p] += pass_records[i].ms[p];
+            total.bytes[p] += pass_records[i].bytes[p];
+        }
+        if (!pass_records[i].is_cc) nfiles++;
+    }
+
+    if (time_passes_json)
+        return pass_write_json(time_passes_json, &total, wall_ms, self_kb, cc_kb);
+
+    fprintf(stderr, "\n  %-30s", "time-passes (ms)");
+    for (int p = 0; p < NPASSES; p++) fprintf(stderr, " %10s", pass_names[p]);
+    fprintf(stderr, " %9s %9s\n", "alloc", "peak RSS");
+    for (int i = 0; i < npass_records; i++)
+        pass_print_row(&pass_records[i], 0);
+    snprintf(total.name, sizeof(total.name), "total (%d files)", nfiles);
+    pass_print_row(&total, 1);
+
+    char self_rss[32], cc_rss[32];
+    format_bytes(self_rss, sizeof(self_rss), self_kb * 1024.0);
+    format_bytes(cc_rss, sizeof(cc_rss), cc_kb * 1024.0);
+    fprintf(stderr, "\n  wall %.1fms, waiting on cc %.1fms", wall_ms, total.ms[PASS_CC]);
+    if (total.ms[PASS_CC] > wall_ms)
+        fprintf(stderr, " (summed over parallel jobs)\n");
+    else
+        fprintf(stderr, " (%.0f%%)\n", wall_ms > 0 ? total.ms[PASS_CC] / wall_ms * 100 : 0);
+    fprintf(stderr, "  peak RSS: moxy %s, cc %s\n", self_rss, cc_rss);
+    return 0;
 }
 
 /* ── transpile pipeline ──────────────────────────────────────── */
 
-static const char *transpile(const char *path) {
+/* one scan cache for the whole run, shared by parallel transpile jobs */
+static PPCache *pp_cache;
+static pthread_once_t pp_cache_once = PTHREAD_ONCE_INIT;
+
+static void pp_cache_init(void) {
+    pp_cache = pp_cache_new();
+}
+
+static PPCache *shared_pp(void) {
+    pthread_once(&pp_cache_once, pp_cache_init);
+    return pp_cache;
+}
+
+/* with f set the generated C is streamed there and NULL is returned;
+   otherwise the text is returned from codegen's buffer. With text set,
+   it stands in for the file at path. */
+static const char *transpile_into(const char *path, const char *text, FILE *f) {
+    /* names and the facts cached on them belong to this compilation only */
+    PassClock pc;
+    pass_begin(&pc);
+    InternTable *names = intern_table_new();
+    InternTable *prev_names = intern_use(names);
     codegen_reset_includes();
-    char *raw = read_file(path);
-    char *src = preprocess(raw, path);
-    free(raw);
+    char *src = text ? preprocess_source(shared_pp(), text, path)
+                     : preprocess_file(shared_pp(), path);
+    pass_mark(&pc, PASS_PREPROCESS);
 
     diag_init(src, path);
 
     Lexer lexer;
     lexer_init(&lexer, src);
 
-    Token tokens[16384];
-    int ntokens = 0;
-    for (;;) {
-        tokens[ntokens] = lexer_next(&lexer);
-        if (tokens[ntokens].kind == TOK_EOF) { ntokens++; break; }
-        ntokens++;
+    TokenList tl = {0};
+    lexer_lex_all(&lexer, &tl);
+    pass_mark(&pc, PASS_LEX);
+    Arena arena = {0};
+    Node *program = parse(&arena, src, tl.toks, tl.count);
+    token_list_free(&tl);
+    pass_mark(&pc, PASS_PARSE);
+    const char *c_code = NULL;
+    if (f) {
+        if (codegen_to_file(program, f) != 0) {
+            fprintf(stderr, "moxy: error writing generated C for '%s'\n", path);
+            exit(1);
+        }
+    } else {
+        c_code = codegen(program);
     }
-
-    Node *program = parse(tokens, ntokens);
-    const char *c_code = codegen(program);
+    pass_mark(&pc, PASS_CODEGEN);
+    pass_end(&pc, path);
+    arena_free(&arena);
 
     free(src);
+    intern_use(prev_names);
+    intern_table_free(names);
     return c_code;
 }
 
-/* transpile a .mxy file to a .c file on disk */
-static int transpile_to_file(const char *mxy_path, const char *c_path) {
-    const char *c_code = transpile(mxy_path);
-    FILE *f = fopen(c_path, "w");
+static const char *transpile(const char *path) {
+    return transpile_into(path, NULL, NULL);
+}
+
+/* transpile a .mxy file to a .c file on disk, streaming through a temp file
+   so a failed run never leaves a half-written .c behind */
+static int transpile_to_file(const char *mxy_path, const char *text, const char *c_path) {
+    char tmp_path[1024];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", c_path);
+    FILE *f = fopen(tmp_path, "w");
     if (!f) {
         fprintf(stderr, "moxy: cannot write '%s'\n", c_path);
         return -1;
     }
-    fputs(c_code, f);
-    fclose(f);
+    transpile_into(mxy_path, text, f);
+    if (fclose(f) != 0 || rename(tmp_path, c_path) != 0) {
+        fprintf(stderr, "moxy: cannot write '%s'\n", c_path);
+        remove(tmp_path);
+        return -1;
+    }
     return 0;
 }
 
 /* ── single-file compile (for run/build on individual .mxy) ── */
 
-static int compile_single(const char *cpath, const char *binpath, const char *srcdir) {
+/* runs cmd through sh like system(), but safe to call from several
+   threads at once; with log_fd set, its stdout and stderr go there */
+static int run_shell(const char *cmd, int log_fd) {
+    pid_t pid = fork();
+    if (pid < 0) return -1;
+    if (pid == 0) {
+        if (log_fd >= 0) {
+            dup2(log_fd, STDOUT_FILENO);
+            dup2(log_fd, STDERR_FILENO);
+        }
+        execl("/bin/sh", "sh", "-c", cmd, (char *)NULL);
+        _exit(127);
+    }
+    int status;
+    while (waitpid(pid, &status, 0) < 0)
+        if (errno != EINTR) return -1;
+    return status;
+}
+
+/* the compiler command around "-o bin input": cc and cflags before it,
+   ldflags after */
+typedef struct {
+    char pre[2048];
+    char post[1100];
+} CompileCmd;
+
+/* optimization flags put right after -std, so CFLAGS can still override
+   them; `moxy bench` sets " -O2" */
+static const char *cc_opt = "";
+
+static void compile_cmd(const char *srcdir, CompileCmd *cc_cmd) {
     const char *cc = getenv("CC");
     if (!cc) cc = "cc";
 
@@ -310,58 +435,663 @@ static int compile_single(const char *cpath, const char *binpath, const char *sr
         free(ypath);
     }
 
-    char cmd[4096];
-    int off = snprintf(cmd, sizeof(cmd), "%s -std=c11", cc);
+    char *pre = cc_cmd->pre;
+    size_t presz = sizeof(cc_cmd->pre);
+    int off = snprintf(pre, presz, "%s -std=c11%s", cc, cc_opt);
+    if (env_cflags) off += snprintf(pre + off, presz - off, " %s", env_cflags);
+    if (proj_cflags[0]) snprintf(pre + off, presz - off, " %s", proj_cflags);
+
+    snprintf(cc_cmd->post, sizeof(cc_cmd->post), "%s%s%s",
+             proj_ldflags[0] ? " " : "", proj_ldflags, pthread_flag);
+}
 
-    if (env_cflags) off += snprintf(cmd + off, sizeof(cmd) - off, " %s", env_cflags);
-    if (proj_cflags[0]) off += snprintf(cmd + off, sizeof(cmd) - off, " %s", proj_cflags);
+static int exit_code(int status) {
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+    return 0;
+}
 
-    off += snprintf(cmd + off, sizeof(cmd) - off, " -o '%s' '%s'", binpath, cpath);
+static int compile_single(const char *cpath, const char *binpath, const char *srcdir, int log_fd) {
+    CompileCmd cc_cmd;
+    compile_cmd(srcdir, &cc_cmd);
 
-    if (proj_ldflags[0]) off += snprintf(cmd + off, sizeof(cmd) - off, " %s", proj_ldflags);
-    if (pthread_flag[0]) off += snprintf(cmd + off, sizeof(cmd) - off, "%s", pthread_flag);
+    char cmd[8192];
+    snprintf(cmd, sizeof(cmd), "%s -o '%s' '%s'%s", cc_cmd.pre, binpath, cpath, cc_cmd.post);
+    return exit_code(run_shell(cmd, log_fd));
+}
 
-    int status = system(cmd);
-    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
-        return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+/* --pipe: feed generated C to cc on stdin instead of through a file */
+static int pipe_cc;
+
+static int compile_code(const char *c_code, const CompileCmd *cc_cmd, const char *binpath,
+                        const char *scratch) {
+    char cmd[8192];
+    if (pipe_cc) {
+        /* -x none so ldflags naming objects or archives aren't read as C */
+        snprintf(cmd, sizeof(cmd), "%s -o '%s' -x c - -x none%s", cc_cmd->pre, binpath, cc_cmd->post);
+        FILE *p = popen(cmd, "w");
+        if (!p) return 1;
+        fputs(c_code, p);
+        return exit_code(pclose(p));
+    }
+
+    char cpath[1100];
+    snprintf(cpath, sizeof(cpath), "%s.c", scratch);
+    FILE *f = fopen(cpath, "w");
+    if (!f) {
+        fprintf(stderr, "moxy: failed to write temp file\n");
+        return 1;
+    }
+    fputs(c_code, f);
+    fclose(f);
+    snprintf(cmd, sizeof(cmd), "%s -o '%s' '%s'%s", cc_cmd->pre, binpath, cpath, cc_cmd->post);
+    int rc = exit_code(run_shell(cmd, -1));
+    remove(cpath);
+    return rc;
+}
+
+/* ── compiled-binary cache ───────────────────────────────────── */
+
+/* Binaries built by `moxy run` and `moxy build <file>` are kept in
+   $XDG_CACHE_HOME/moxy (~/.cache/moxy), named by a hash of the generated
+   C and the whole compiler command, so an unchanged script skips cc.
+   Entries are renamed into place once complete and can be deleted at
+   any time. */
+static int binary_cache_dir(char *dir, size_t size) {
+    const char *xdg = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    char parent[900];
+    if (xdg && xdg[0])
+        snprintf(parent, sizeof(parent), "%s", xdg);
+    else if (home && home[0])
+        snprintf(parent, sizeof(parent), "%s/.cache", home);
+    else
+        return -1;
+    snprintf(dir, size, "%s/moxy", parent);
+    mkdir(parent, 0755);
+    mkdir(dir, 0755);
+    struct stat st;
+    return stat(dir, &st) == 0 && S_ISDIR(st.st_mode) ? 0 : -1;
+}
+
+/* Besides the C and the command, a cached binary depends on the local
+   headers the C includes with quotes (found next to the source, in the
+   working directory or in a -I directory, and followed into the headers
+   they include) and on the files the flags name: objects, archives, and
+   -l libraries found under a -L directory. Each is keyed by its path and
+   contents. An include the scan cannot follow, such as
+   #include MACRO, leaves the binary uncached. */
+typedef struct {
+    char *dirs[64];     /* quoted-include search path */
+    int ndirs;
+    char *seen[256];    /* files already in the key */
+    int nseen;
+    unsigned long long h;
+    int untracked;
+} DepScan;
+
+static void dep_dir(DepScan *d, const char *dir, size_t len) {
+    if (d->ndirs < 64) d->dirs[d->ndirs++] = strndup(dir, len);
+    else d->untracked = 1;
+}
+
+/* adds a regular file's path and contents to the key; returns the
+   contents, for the caller to free, or NULL if it was already there or
+   is not a readable file */
+static char *dep_file(DepScan *d, const char *path) {
+    struct stat st;
+    if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) return NULL;
+    for (int i = 0; i < d->nseen; i++)
+        if (strcmp(d->seen[i], path) == 0) return NULL;
+    FILE *f = d->nseen < 256 ? fopen(path, "rb") : NULL;
+    char *buf = f ? malloc((size_t)st.st_size + 1) : NULL;
+    size_t n = buf ? fread(buf, 1, (size_t)st.st_size, f) : 0;
+    if (f) fclose(f);
+    if (!buf || n != (size_t)st.st_size) {
+        free(buf);
+        d->untracked = 1;
+        return NULL;
+    }
+    buf[n] = '\0';
+    d->seen[d->nseen++] = strdup(path);
+    d->h = pp_hash(d->h, path, strlen(path) + 1);
+    d->h = pp_hash(d->h, buf, n);
+    return buf;
+}
+
+static void dep_includes(DepScan *d, const char *text, const char *curdir) {
+    for (const char *p = text; *p && !d->untracked; ) {
+        const char *eol = strchr(p, '\n');
+        const char *q = p;
+        p = eol ? eol + 1 : p + strlen(p);
+        while (*q == ' ' || *q == '\t') q++;
+        if (*q++ != '#') continue;
+        while (*q == ' ' || *q == '\t') q++;
+        if (strncmp(q, "include", 7) != 0) continue;
+        q += 7;
+        while (*q == ' ' || *q == '\t') q++;
+        if (*q == '<') continue;
+        const char *end = *q == '"' ? strchr(q + 1, '"') : NULL;
+        if (!end || (eol && end > eol)) {
+            d->untracked = 1;
+            return;
+        }
+        int len = (int)(end - q - 1);
+        for (int i = -1; i < d->ndirs; i++) {
+            const char *dir = i < 0 ? curdir : d->dirs[i];
+            char path[PATH_MAX];
+            if (!dir) continue;
+            int n = snprintf(path, sizeof(path), "%s/%.*s", dir, len, q + 1);
+            if (n < 0 || n >= (int)sizeof(path) || access(path, R_OK) != 0) continue;
+            char *src = dep_file(d, path);
+            if (src) {
+                char dir_buf[PATH_MAX];
+                dir_of(path, dir_buf, sizeof(dir_buf));
+                dep_includes(d, src, dir_buf);
+                free(src);
+            }
+            break;
+        }
+    }
+}
+
+/* folds what c_code depends on outside itself into h; 0 when some of it
+   cannot be tracked */
+static int dep_hash(const char *c_code, const char *srcdir, const CompileCmd *cc_cmd,
+                    unsigned long long *h) {
+    DepScan d = { .h = *h };
+    char *libdirs[64];
+    int nlibdirs = 0;
+    dep_dir(&d, srcdir, strlen(srcdir));
+    dep_dir(&d, ".", 1);
+
+    char flags[sizeof(cc_cmd->pre) + sizeof(cc_cmd->post) + 1];
+    snprintf(flags, sizeof(flags), "%s %s", cc_cmd->pre, cc_cmd->post);
+    for (int pass = 0; pass < 2; pass++) {
+        char opt[3] = "";   /* a -I or -L whose directory is the next word */
+        for (const char *p = flags; *p; ) {
+            while (*p == ' ' || *p == '\t') p++;
+            const char *start = p;
+            while (*p && *p != ' ' && *p != '\t') p++;
+            int len = (int)(p - start);
+            if (len > 0 && (*start == '\'' || *start == '"')) start++, len--;
+            if (len > 0 && (start[len - 1] == '\'' || start[len - 1] == '"')) len--;
+            if (len <= 0) continue;
+            char arg[PATH_MAX];
+            snprintf(arg, sizeof(arg), "%s%.*s", opt, len, start);
+            opt[0] = '\0';
+            if (strcmp(arg, "-I") == 0 || strcmp(arg, "-L") == 0) {
+                strcpy(opt, arg);
+                continue;
+            }
+            if (pass == 0) {
+                if (strncmp(arg, "-I", 2) == 0 && arg[2]) dep_dir(&d, arg + 2, strlen(arg + 2));
+                else if (strncmp(arg, "-L", 2) == 0 && arg[2] && nlibdirs < 64)
+                    libdirs[nlibdirs++] = strdup(arg + 2);
+            } else if (strncmp(arg, "-l", 2) == 0 && arg[2]) {
+                for (int i = 0; i < nlibdirs * 2; i++) {
+                    char lib[PATH_MAX];
+                    int n = snprintf(lib, sizeof(lib), "%s/lib%s.%s", libdirs[i / 2], arg + 2,
+                                     i % 2 ? "a" : "so");
+                    if (n > 0 && n < (int)sizeof(lib)) free(dep_file(&d, lib));
+                }
+            } else if (arg[0] != '-') {
+                free(dep_file(&d, arg));
+            }
+        }
+    }
+    dep_includes(&d, c_code, NULL);
+
+    for (int i = 0; i < d.ndirs; i++) free(d.dirs[i]);
+    for (int i = 0; i < d.nseen; i++) free(d.seen[i]);
+    for (int i = 0; i < nlibdirs; i++) free(libdirs[i]);
+    *h = d.h;
+    return !d.untracked;
+}
+
+/* puts the path of a binary built from c_code in binpath, compiling it
+   only on a cache miss. Without a usable cache it is built in a new temp
+   directory left in tmpdir for the caller to remove; otherwise tmpdir is
+   set to "". */
+static int cached_binary(const char *c_code, const char *srcpath, const char *srcdir,
+                         char *binpath, size_t size, char *tmpdir) {
+    CompileCmd cc_cmd;
+    compile_cmd(srcdir, &cc_cmd);
+    PassClock pc;
+    pass_begin(&pc);
+
+    char dir[1024];
+    unsigned long long h = pp_hash(PP_HASH_INIT, c_code, strlen(c_code));
+    h = pp_hash(h, cc_cmd.pre, strlen(cc_cmd.pre) + 1);
+    h = pp_hash(h, cc_cmd.post, strlen(cc_cmd.post) + 1);
+    int cached = !getenv("MOXY_NO_CACHE") && binary_cache_dir(dir, sizeof(dir)) == 0
+                 && dep_hash(c_code, srcdir, &cc_cmd, &h);
+    if (cached) {
+        int n = snprintf(binpath, size, "%s/%016llx", dir, h);
+        cached = n > 0 && (size_t)n < size;
+    }
+    if (!cached) {
+        if (!mkdtemp(tmpdir)) {
+            fprintf(stderr, "moxy: failed to create temp directory\n");
+            return 1;
+        }
+        snprintf(binpath, size, "%s/out", tmpdir);
+        int rc = compile_code(c_code, &cc_cmd, binpath, binpath);
+        pass_mark(&pc, PASS_CC);
+        pass_end(&pc, srcpath);
+        return rc;
+    }
+    tmpdir[0] = '\0';
+    if (access(binpath, X_OK) == 0) return 0;
+
+    char scratch[1100];
+    int n = snprintf(scratch, sizeof(scratch), "%s.%d.tmp", binpath, (int)getpid());
+    if (n < 0 || (size_t)n >= sizeof(scratch)) {
+        fprintf(stderr, "moxy: cache path too long: '%s'\n", binpath);
+        return 1;
+    }
+    pass_begin(&pc);
+    int rc = compile_code(c_code, &cc_cmd, scratch, scratch);
+    pass_mark(&pc, PASS_CC);
+    pass_end(&pc, srcpath);
+    if (rc == 0 && rename(scratch, binpath) != 0) {
+        fprintf(stderr, "moxy: cannot write '%s'\n", binpath);
+        rc = 1;
+    }
+    if (rc != 0) remove(scratch);
+    return rc;
+}
+
+static int copy_binary(const char *from, const char *to) {
+    FILE *in = fopen(from, "rb");
+    if (!in) return -1;
+    char tmp_path[1024];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", to);
+    FILE *out = fopen(tmp_path, "wb");
+    if (!out) {
+        fclose(in);
+        return -1;
+    }
+    char buf[65536];
+    size_t n;
+    int failed = 0;
+    while ((n = fread(buf, 1, sizeof(buf), in)) > 0)
+        if (fwrite(buf, 1, n, out) != n) failed = 1;
+    fclose(in);
+    if (fclose(out) != 0 || failed || chmod(tmp_path, 0755) != 0 || rename(tmp_path, to) != 0) {
+        remove(tmp_path);
+        return -1;
     }
     return 0;
 }
 
 /* ── project-mode transpile all .mxy to build/gen/ ───────── */
 
-static void collect_mxy_files(const char *dir, char files[][512], int *count, int max) {
+/* paths found by a directory walk, malloc'd */
+typedef struct {
+    char **paths;
+    int count, cap;
+} FileList;
+
+static void file_list_add(FileList *l, const char *path) {
+    if (l->count == l->cap) {
+        l->cap = l->cap ? l->cap * 2 : 64;
+        l->paths = realloc(l->paths, l->cap * sizeof(char *));
+    }
+    l->paths[l->count++] = strdup(path);
+}
+
+static void file_list_free(FileList *l) {
+    for (int i = 0; i < l->count; i++) free(l->paths[i]);
+    free(l->paths);
+    memset(l, 0, sizeof(*l));
+}
+
+static void collect_mxy_files(const char *dir, FileList *files) {
     DIR *d = opendir(dir);
     if (!d) return;
 
     struct dirent *ent;
-    while ((ent = readdir(d)) != NULL && *count < max) {
+    while ((ent = readdir(d)) != NULL) {
         if (ent->d_name[0] == '.') continue;
 
         char path[512];
         snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name);
 
-        if (ent->d_type == DT_DIR) {
-            collect_mxy_files(path, files, count, max);
-        } else if (ends_with(ent->d_name, ".mxy")) {
-            strncpy(files[*count], path, 511);
-            files[*count][511] = '\0';
-            (*count)++;
-        }
+        if (ent->d_type == DT_DIR)
+            collect_mxy_files(path, files);
+        else if (ends_with(ent->d_name, ".mxy"))
+            file_list_add(files, path);
     }
     closedir(d);
 }
 
+/* ── incremental transpile ──────────────────────────────────── */
+
+/* <gen_dir>/.manifest records, per generated .c, a hash of its .mxy sources
+   (the file and everything it includes), the compiler build and the feature
+   flags. A file whose hash still matches and whose .c exists is not
+   transpiled again, so the .c keeps its mtime and the C build can skip it.
+   Each entry also lists the moxyrt types its file uses. */
+#define GEN_MANIFEST ".manifest"
+
+typedef struct {
+    char name[264];
+    unsigned long long hash;
+    char *rt;       /* space-separated, malloc'd; NULL for none */
+} GenEntry;
+
+static unsigned long long build_id_hash(void) {
+    static const char stamp[] = __DATE__ " " __TIME__;
+    unsigned long long h = pp_hash(PP_HASH_INIT, stamp, sizeof(stamp));
+    /* a rebuilt compiler whose main.c did not change still gets a new id */
+    struct stat st;
+    if (stat("/proc/self/exe", &st) == 0) {
+        long long sig[2] = { (long long)st.st_size, (long long)st.st_mtime };
+        h = pp_hash(h, sig, sizeof(sig));
+    }
+    return h;
+}
+
+static void gen_entries_free(GenEntry *entries, int n) {
+    for (int i = 0; i < n; i++) {
+        free(entries[i].rt);
+        entries[i].rt = NULL;
+    }
+}
+
+/* the entries of a manifest, malloc'd, or NULL with *count 0 */
+static GenEntry *manifest_load(const char *path, int *count) {
+    *count = 0;
+    FILE *f = fopen(path, "r");
+    if (!f) return NULL;
+    GenEntry *entries = NULL;
+    int n = 0, max = 0;
+    char *line = NULL;
+    size_t cap = 0;
+    while (getline(&line, &cap, f) != -1) {
+        if (n == max) {
+            max = max ? max * 2 : 64;
+            entries = realloc(entries, max * sizeof(GenEntry));
+        }
+        int end = 0;
+        if (sscanf(line, "%llx %263s%n", &entries[n].hash, entries[n].name, &end) != 2)
+            continue;
+        const char *rt = line + end;
+        while (*rt == ' ') rt++;
+        size_t len = strcspn(rt, "\n");
+        entries[n].rt = len ? strndup(rt, len) : NULL;
+        n++;
+    }
+    free(line);
+    fclose(f);
+    *count = n;
+    return entries;
+}
+
+static void manifest_save(const char *path, const GenEntry *entries, int n) {
+    char tmp_path[1024];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    FILE *f = fopen(tmp_path, "w");
+    if (!f) return;
+    for (int i = 0; i < n; i++)
+        if (entries[i].name[0])
+            fprintf(f, "%016llx %s%s%s\n", entries[i].hash, entries[i].name,
+                    entries[i].rt ? " " : "", entries[i].rt ? entries[i].rt : "");
+    if (fclose(f) != 0 || rename(tmp_path, path) != 0)
+        remove(tmp_path);
+}
+
+/* ── parallel transpile ─────────────────────────────────────── */
+
+/* -j for project builds and tests; 0 means one thread per online CPU */
+static int build_jobs;
+
+#define MAX_TRANSPILE_THREADS 64
+
+/* threads to use for njobs jobs under -j */
+static int worker_count(int njobs) {
+    int n = build_jobs > 0 ? build_jobs : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (n > njobs) n = njobs;
+    if (n > MAX_TRANSPILE_THREADS) n = MAX_TRANSPILE_THREADS;
+    return n < 1 ? 1 : n;
+}
+
+/* -j slots while a workspace builds: each building member holds one, and
+   transpiling borrows idle ones for its extra threads. -1 when no
+   workspace build is limiting them. */
+static int job_slots = -1;
+static pthread_mutex_t job_slots_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t job_slots_cond = PTHREAD_COND_INITIALIZER;
+
+static void job_slot_acquire(void) {
+    pthread_mutex_lock(&job_slots_lock);
+    while (job_slots == 0)
+        pthread_cond_wait(&job_slots_cond, &job_slots_lock);
+    if (job_slots > 0) job_slots--;
+    pthread_mutex_unlock(&job_slots_lock);
+}
+
+/* takes up to max free slots without waiting */
+static int job_slots_take(int max) {
+    if (max <= 0) return 0;
+    pthread_mutex_lock(&job_slots_lock);
+    int n = max;
+    if (job_slots >= 0) {
+        if (n > job_slots) n = job_slots;
+        job_slots -= n;
+    }
+    pthread_mutex_unlock(&job_slots_lock);
+    return n;
+}
+
+static void job_slots_put(int n) {
+    pthread_mutex_lock(&job_slots_lock);
+    if (job_slots >= 0) job_slots += n;
+    pthread_cond_broadcast(&job_slots_cond);
+    pthread_mutex_unlock(&job_slots_lock);
+}
+
+/* starts up to n threads running fn and returns how many started */
+static int start_workers(pthread_t *threads, int n, void *(*fn)(void *)) {
+    /* the parser and codegen recurse; don't depend on the platform's
+       default thread stack, which is 512 KB on macOS */
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, 8 * 1024 * 1024);
+    int nstarted = 0;
+    for (int t = 0; t < n; t++)
+        if (pthread_create(&threads[nstarted], &attr, fn, NULL) == 0)
+            nstarted++;
+    pthread_attr_destroy(&attr);
+    return nstarted;
+}
+
+/* a file of a project build that needs transpiling; the feature flags are
+   the ones in effect for it when files are transpiled in order */
+typedef struct {
+    const char *mxy_path;   /* NULL once a later source took over its .c */
+    const char *base;
+    char out_path[512];
+    int async_enabled;
+    int arc_enabled;
+    int entry;      /* its manifest entry */
+    int failed;
+    char *rt;       /* moxyrt types it used, as in GenEntry */
+} TranspileJob;
+
+/* --shared-rt turns moxyrt on. It is off by default: its definitions are
+   weak, out of line in moxyrt.c, so the C compiler cannot inline them into
+   the files that call them. */
+static int shared_rt = 0;
+
+static TranspileJob *tjobs;
+static int ntjobs;
+static int tjobs_next;
+static pthread_mutex_t tjobs_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* the calling thread works through jobs too, so the thread-local flags a
+   worker sets are put back when it runs out */
+static void *transpile_worker(void *arg) {
+    (void)arg;
+    int saved_async = moxy_async_enabled;
+    int saved_arc = moxy_arc_enabled;
+    int saved_shared_rt = moxy_shared_rt;
+    for (;;) {
+        pthread_mutex_lock(&tjobs_lock);
+        int i = tjobs_next++;
+        pthread_mutex_unlock(&tjobs_lock);
+        if (i >= ntjobs) break;
+        if (!tjobs[i].mxy_path) continue;
+
+        /* every compilation has its own names, codegen and diag state on
+           its thread, so only the flags need setting per job */
+        moxy_async_enabled = tjobs[i].async_enabled;
+        moxy_arc_enabled = tjobs[i].arc_enabled;
+        moxy_shared_rt = shared_rt;
+        tjobs[i].failed = transpile_to_file(tjobs[i].mxy_path, NULL, tjobs[i].out_path) != 0;
+
+        size_t size = 0;
+        for (int t = 0; t < codegen_rt_count(); t++)
+            size += strlen(codegen_rt_type(t)) + 1;
+        if (size == 0) continue;
+        char *rt = malloc(size);
+        if (!rt) abort();
+        size_t len = 0;
+        for (int t = 0; t < codegen_rt_count(); t++)
+            len += (size_t)sprintf(rt + len, "%s%s", len ? " " : "", codegen_rt_type(t));
+        tjobs[i].rt = rt;
+    }
+    moxy_async_enabled = saved_async;
+    moxy_arc_enabled = saved_arc;
+    moxy_shared_rt = saved_shared_rt;
+    return NULL;
+}
+
+/* runs tjobs on up to build_jobs threads, the calling thread included;
+   during a workspace build, only on as many as there are free slots */
+static void run_transpile_jobs(void) {
+    tjobs_next = 0;
+
+    pthread_t threads[MAX_TRANSPILE_THREADS];
+    int extra = job_slots_take(worker_count(ntjobs) - 1);
+    int nstarted = start_workers(threads, extra, transpile_worker);
+    transpile_worker(NULL);
+    for (int t = 0; t < nstarted; t++)
+        pthread_join(threads[t], NULL);
+    job_slots_put(extra);
+}
+
+/* writes path only if its content changed, keeping the mtime otherwise */
+static int write_if_changed(const char *path, const char *text) {
+    size_t len = strlen(text);
+    FILE *f = fopen(path, "rb");
+    if (f) {
+        char *old = malloc(len + 1);
+        size_t n = old ? fread(old, 1, len + 1, f) : 0;
+        int same = old && n == len && memcmp(old, text, len) == 0;
+        free(old);
+        fclose(f);
+        if (same) return 0;
+    }
+    char tmp_path[1024];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    f = fopen(tmp_path, "w");
+    if (!f) {
+        fprintf(stderr, "moxy: cannot write '%s'\n", path);
+        return -1;
+    }
+    fputs(text, f);
+    if (fclose(f) != 0 || rename(tmp_path, path) != 0) {
+        fprintf(stderr, "moxy: cannot write '%s'\n", path);
+        remove(tmp_path);
+        return -1;
+    }
+    return 0;
+}
+
+static int cmp_str(const void *a, const void *b) {
+    return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+/* gen/moxyrt.h and moxyrt.c define, once per build, the list and map
+   types the generated files left to them; the C build compiles them like
+   any other generated file */
+static int write_runtime(const char *gen_dir, const GenEntry *entries, int n) {
+    char hpath[768], cpath[768];
+    snprintf(hpath, sizeof(hpath), "%s/moxyrt.h", gen_dir);
+    snprintf(cpath, sizeof(cpath), "%s/moxyrt.c", gen_dir);
+
+    size_t size = 1;
+    for (int i = 0; i < n; i++)
+        if (entries[i].name[0] && entries[i].rt) size += strlen(entries[i].rt) + 1;
+    char *names = malloc(size);
+    const char **types = NULL;
+    int ntypes = 0, types_cap = 0;
+    size_t used = 0;
+    if (!names) abort();
+    for (int i = 0; i < n; i++) {
+        if (!entries[i].name[0] || !entries[i].rt) continue;
+        size_t len = strlen(entries[i].rt) + 1;
+        char *p = names + used;
+        memcpy(p, entries[i].rt, len);
+        used += len;
+        for (char *tok = strtok(p, " "); tok; tok = strtok(NULL, " ")) {
+            int seen = 0;
+            for (int t = 0; t < ntypes && !seen; t++) seen = strcmp(types[t], tok) == 0;
+            if (seen) continue;
+            if (ntypes == types_cap) {
+                types_cap = types_cap ? types_cap * 2 : 64;
+                types = realloc(types, types_cap * sizeof(types[0]));
+                if (!types) abort();
+            }
+            types[ntypes++] = tok;
+        }
+    }
+
+    if (ntypes == 0) {
+        free(names);
+        remove(hpath);
+        remove(cpath);
+        return 0;
+    }
+    /* the same set always gives the same text */
+    qsort(types, ntypes, sizeof(types[0]), cmp_str);
+
+    InternTable *names_tab = intern_table_new();
+    InternTable *prev_names = intern_use(names_tab);
+    int rc = write_if_changed(hpath, codegen_runtime(types, ntypes, 0));
+    if (rc == 0) rc = write_if_changed(cpath, codegen_runtime(types, ntypes, 1));
+    intern_use(prev_names);
+    intern_table_free(names_tab);
+    free(types);
+    free(names);
+    return rc;
+}
+
 static int transpile_project_to(const Config *cfg, const char *gen_dir) {
     fs_mkdir(GOOSE_BUILD);
     fs_mkdir(gen_dir);
 
-    char mxy_files[256][512];
-    int mxy_count = 0;
-    collect_mxy_files(cfg->src_dir, mxy_files, &mxy_count, 256);
+    FileList files = {0};
+    collect_mxy_files(cfg->src_dir, &files);
+    char **mxy_files = files.paths;
+    int mxy_count = files.count;
 
     if (mxy_count == 0) return 0;
 
+    /* at most one job and one entry per file */
+    ntjobs = 0;
+    tjobs = calloc(mxy_count, sizeof(TranspileJob));
+
+    char manifest_path[768];
+    snprintf(manifest_path, sizeof(manifest_path), "%s/%s", gen_dir, GEN_MANIFEST);
+    int nold;
+    GenEntry *old = manifest_load(manifest_path, &nold);
+    GenEntry *cur = calloc(mxy_count, sizeof(GenEntry));
+    int ncur = 0;
+    unsigned long long build_id = build_id_hash();
+
     for (int i = 0; i < mxy_count; i++) {
         const char *base = strrchr(mxy_files[i], '/');
         base = base ? base + 1 : mxy_files[i];
@@ -376,64 +1106,471 @@ static int transpile_project_to(const Config *cfg, const char *gen_dir) {
         snprintf(out_path, sizeof(out_path), "%s/%s.c", gen_dir, stem);
 
         /* detect feature flags from source */
-        char *test_src = read_file(mxy_files[i]);
-        if (strstr(test_src, "Future<") || strstr(test_src, "await "))
+        int fi = pp_load(shared_pp(), mxy_files[i]);
+        unsigned features = pp_features(shared_pp(), fi);
+        if (features & PP_USES_ASYNC)
             moxy_async_enabled = 1;
-        if (strstr(test_src, "[]") || strstr(test_src, "map["))
+        if (features & PP_USES_ARC)
             moxy_arc_enabled = 1;
-        free(test_src);
 
-        info("Transpiling", "%s", base);
-        if (transpile_to_file(mxy_files[i], out_path) != 0)
-            return -1;
-    }
+        unsigned long long h = pp_deps_hash(shared_pp(), fi, build_id);
+        int flags[3] = { moxy_async_enabled, moxy_arc_enabled, shared_rt };
+        h = pp_hash(h, flags, sizeof(flags));
+
+        /* sources sharing a stem share a .c, and the later one wins */
+        char name[264];
+        snprintf(name, sizeof(name), "%s.c", stem);
+        int entry = 0;
+        while (entry < ncur && strcmp(cur[entry].name, name) != 0) entry++;
+        if (entry == ncur) ncur++;
+        GenEntry *e = &cur[entry];
+        snprintf(e->name, sizeof(e->name), "%s", name);
+        e->hash = h;
+
+        int fresh = 0;
+        free(e->rt);
+        e->rt = NULL;
+        for (int j = 0; j < nold; j++)
+            if (strcmp(old[j].name, e->name) == 0) {
+                fresh = old[j].hash == h && fs_exists(out_path);
+                if (fresh && old[j].rt) e->rt = strdup(old[j].rt);
+                break;
+            }
+        int j = 0;
+        while (j < ntjobs && tjobs[j].entry != entry) j++;
+        if (fresh) {
+            if (j < ntjobs) tjobs[j].mxy_path = NULL;
+            continue;
+        }
 
-    return 0;
+        if (j == ntjobs) ntjobs++;
+        TranspileJob *job = &tjobs[j];
+        job->mxy_path = mxy_files[i];
+        job->base = base;
+        snprintf(job->out_path, sizeof(job->out_path), "%s", out_path);
+        job->async_enabled = moxy_async_enabled;
+        job->arc_enabled = moxy_arc_enabled;
+        job->entry = entry;
+        job->failed = 0;
+    }
+
+    for (int j = 0; j < ntjobs; j++)
+        if (tjobs[j].mxy_path) info("Transpiling", "%s", tjobs[j].base);
+    run_transpile_jobs();
+
+    int failed = 0;
+    for (int j = 0; j < ntjobs; j++) {
+        if (!tjobs[j].mxy_path) continue;
+        if (!tjobs[j].failed) {
+            cur[tjobs[j].entry].rt = tjobs[j].rt;
+            tjobs[j].rt = NULL;
+            continue;
+        }
+        cur[tjobs[j].entry].name[0] = '\0';  /* not up to date: retry next build */
+        free(tjobs[j].rt);
+        tjobs[j].rt = NULL;
+        failed = 1;
+    }
+    manifest_save(manifest_path, cur, ncur);
+    if (!failed && write_runtime(gen_dir, cur, ncur) != 0) failed = 1;
+    gen_entries_free(old, nold);
+    gen_entries_free(cur, ncur);
+    free(old);
+    free(cur);
+    free(tjobs);
+    tjobs = NULL;
+    ntjobs = 0;
+    file_list_free(&files);
+    return failed ? -1 : 0;
 }
 
-static int transpile_project(const Config *cfg) {
-    char gen_dir[512];
-    snprintf(gen_dir, sizeof(gen_dir), "%s/gen", GOOSE_BUILD);
-    return transpile_project_to(cfg, gen_dir);
+/* ── unity and LTO builds ───────────────────────────────────── */
+
+/* --unity: a project is transpiled as one compilation into
+   <build>/unity/<name>.c, as if one file included all the others. In a
+   binary every function but main gets internal linkage, so the C compiler
+   can inline across what were separate files. A library keeps external
+   linkage: its functions are its interface. */
+static int unity_build;
+
+static int transpile_unity(const Config *cfg, const char *unity_dir) {
+    fs_mkdir(GOOSE_BUILD);
+    char parent[512];
+    snprintf(parent, sizeof(parent), "%s/unity", GOOSE_BUILD);
+    fs_mkdir(parent);
+    fs_mkdir(unity_dir);
+
+    FileList files = {0};
+    collect_mxy_files(cfg->src_dir, &files);
+    char **mxy_files = files.paths;
+    int mxy_count = files.count;
+    if (mxy_count == 0) return 0;
+
+    int is_lib = strcmp(cfg->type, "lib") == 0;
+
+    /* includes resolve against the root's directory, which is src_dir */
+    size_t textcap = (size_t)mxy_count * 540;
+    char *text = malloc(textcap);
+    size_t len = 0;
+    size_t prefix = strlen(cfg->src_dir) + 1;
+    unsigned long long h = build_id_hash();
+    for (int i = 0; i < mxy_count; i++) {
+        const char *rel = strncmp(mxy_files[i], cfg->src_dir, prefix - 1) == 0
+                          && mxy_files[i][prefix - 1] == '/' ? mxy_files[i] + prefix : mxy_files[i];
+        len += snprintf(text + len, textcap - len, "#include \"%s\"\n", rel);
+
+        int fi = pp_load(shared_pp(), mxy_files[i]);
+        unsigned features = pp_features(shared_pp(), fi);
+        if (features & PP_USES_ASYNC)
+            moxy_async_enabled = 1;
+        if (features & PP_USES_ARC)
+            moxy_arc_enabled = 1;
+        h = pp_deps_hash(shared_pp(), fi, h);
+    }
+    int flags[3] = { moxy_async_enabled, moxy_arc_enabled, is_lib };
+    h = pp_hash(h, flags, sizeof(flags));
+
+    char root[768], out_path[768], manifest_path[768];
+    snprintf(root, sizeof(root), "%s/.unity.mxy", cfg->src_dir);
+    snprintf(out_path, sizeof(out_path), "%s/%s.c", unity_dir, cfg->name);
+    snprintf(manifest_path, sizeof(manifest_path), "%s/%s", unity_dir, GEN_MANIFEST);
+
+    int loaded;
+    GenEntry *old = manifest_load(manifest_path, &loaded);
+    int fresh = loaded == 1 && old[0].hash == h && fs_exists(out_path);
+    gen_entries_free(old, loaded);
+    free(old);
+
+    int rc = 0;
+    if (!fresh) {
+        info("Transpiling", "%s (unity, %d file%s)", cfg->name, mxy_count, mxy_count == 1 ? "" : "s");
+        moxy_internal_linkage = !is_lib;
+        rc = transpile_to_file(root, text, out_path);
+        moxy_internal_linkage = 0;
+    }
+    if (!fresh && rc == 0) {
+        GenEntry entry = { .hash = h };
+        snprintf(entry.name, sizeof(entry.name), "%s.c", cfg->name);
+        manifest_save(manifest_path, &entry, 1);
+    }
+    free(text);
+    file_list_free(&files);
+    return rc != 0 ? -1 : 0;
 }
 
-/* ── commands ────────────────────────────────────────────────── */
+/* --lto: link-time optimization for every member, libraries included.
+   The flag goes into each config and into CFLAGS, which the C build
+   applies to every object it compiles. Workspaces set CFLAGS only in the
+   child process that builds a member. */
+static int lto_build;
 
-static double now_ms(void) {
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+static void append_flag(char *flags, size_t size, const char *flag) {
+    size_t len = strlen(flags);
+    snprintf(flags + len, size - len, "%s%s", len ? " " : "", flag);
 }
 
-/* ── single-file commands ────────────────────────────────────── */
+static void apply_lto(Config *cfg) {
+    append_flag(cfg->cflags, sizeof(cfg->cflags), "-flto");
+    append_flag(cfg->ldflags, sizeof(cfg->ldflags), "-flto");
+}
 
-static int cmd_run_file(const char *srcpath, int argc, char **argv, int arg_offset) {
-    char srcdir[512];
-    dir_of(srcpath, srcdir, sizeof(srcdir));
-    const char *c_code = transpile(srcpath);
+static void export_lto_cflags(void) {
+    const char *cflags = getenv("CFLAGS");
+    char buf[1024];
+    snprintf(buf, sizeof(buf), "%s%s-flto", cflags ? cflags : "", cflags && *cflags ? " " : "");
+    setenv("CFLAGS", buf, 1);
+}
 
-    char tmpdir[] = "/tmp/moxy_XXXXXX";
-    if (!mkdtemp(tmpdir)) {
-        fprintf(stderr, "moxy: failed to create temp directory\n");
-        return 1;
+/* ── profile-guided builds ───────────────────────────────────── */
+
+/* --pgo: build an instrumented binary, run the training command, then
+   build again using the profile it wrote. The command is pgo.train in
+   moxy.yaml, with {bin} standing for the binary; without one the binary
+   runs with no arguments. Profiles are kept in build/pgo for projects
+   and next to the cached binary for single files. */
+static int pgo_build;
+
+/* the pgo.train value of a moxy.yaml, or "" */
+static void pgo_train_command(const char *yaml, char *buf, size_t size) {
+    buf[0] = '\0';
+    FILE *f = yaml ? fopen(yaml, "r") : NULL;
+    if (!f) return;
+    char line[1024];
+    int in_pgo = 0;
+    while (fgets(line, sizeof(line), f)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] != ' ' && line[0] != '\t') {
+            in_pgo = strncmp(line, "pgo:", 4) == 0;
+            continue;
+        }
+        const char *p = line + strspn(line, " \t");
+        if (!in_pgo || strncmp(p, "train:", 6) != 0) continue;
+        p += 6;
+        p += strspn(p, " \t");
+        size_t len = strlen(p);
+        if (len >= 2 && (p[0] == '"' || p[0] == '\'') && p[len - 1] == p[0]) {
+            p++;
+            len -= 2;
+        }
+        snprintf(buf, size, "%.*s", (int)len, p);
+        break;
     }
+    fclose(f);
+}
 
-    char cpath[512], binpath[512];
-    snprintf(cpath, sizeof(cpath), "%s/out.c", tmpdir);
-    snprintf(binpath, sizeof(binpath), "%s/out", tmpdir);
+static int pgo_train(const char *yaml, const char *binpath) {
+    char train[1024];
+    pgo_train_command(yaml, train, sizeof(train));
+    if (!train[0]) snprintf(train, sizeof(train), "{bin}");
 
-    FILE *f = fopen(cpath, "w");
+    char cmd[4096];
+    size_t len = 0;
+    for (const char *p = train; *p && len < sizeof(cmd) - 1; ) {
+        if (strncmp(p, "{bin}", 5) == 0) {
+            len += snprintf(cmd + len, sizeof(cmd) - len, "'%s'", binpath);
+            p += 5;
+        } else {
+            cmd[len++] = *p++;
+        }
+    }
+    cmd[len < sizeof(cmd) ? len : sizeof(cmd) - 1] = '\0';
+
+    info("Training", "%s", cmd);
+    int rc = exit_code(run_shell(cmd, -1));
+    if (rc != 0) err("training run failed (exit status %d)", rc);
+    return rc;
+}
+
+static int has_suffix_file(const char *dir, const char *suffix) {
+    DIR *d = opendir(dir);
+    if (!d) return 0;
+    struct dirent *ent;
+    int found = 0;
+    while (!found && (ent = readdir(d)) != NULL)
+        found = ends_with(ent->d_name, suffix);
+    closedir(d);
+    return found;
+}
+
+/* compiler flags for either build. GCC reads the .gcda files in the
+   profile directory; clang's raw profiles are merged first. */
+static int pgo_flags(const char *profile_dir, int use, char *buf, size_t size) {
+    if (!use) {
+        snprintf(buf, size, "-fprofile-generate=%s", profile_dir);
+        return 0;
+    }
+    if (!has_suffix_file(profile_dir, ".profraw")) {
+        snprintf(buf, size, "-fprofile-use=%s -fprofile-correction", profile_dir);
+        return 0;
+    }
+    const char *profdata = getenv("LLVM_PROFDATA");
+    char cmd[2048];
+    snprintf(cmd, sizeof(cmd), "%s merge -o '%s/default.profdata' '%s'/*.profraw",
+             profdata ? profdata : "llvm-profdata", profile_dir, profile_dir);
+    if (exit_code(run_shell(cmd, -1)) != 0) {
+        err("cannot merge the profile (set LLVM_PROFDATA to llvm-profdata)");
+        return -1;
+    }
+    snprintf(buf, size, "-fprofile-use=%s/default.profdata", profile_dir);
+    return 0;
+}
+
+/* a fresh profile directory as an absolute path, which the instrumented
+   binary needs wherever it runs */
+static int pgo_profile_dir(const char *parent, char *dir, size_t size) {
+    char real[PATH_MAX];
+    if (!realpath(parent, real)) return -1;
+    snprintf(dir, size, "%s/pgo", real);
+    fs_rmrf(dir);
+    return mkdir(dir, 0755);
+}
+
+/* single files, with the same contract as cached_binary. Each source file
+   has a cache directory, pgo-<hash of its path>, holding its optimized
+   binary named by a hash of the code, the compiler command and the
+   training command. Both builds and the training run happen in a
+   <pid>.tmp directory inside it, since GCC finds the profile by the
+   object's name and concurrent runs must not share one. The finished
+   binary is renamed into place and older ones are removed. */
+static int pgo_binary(const char *c_code, const char *srcpath, const char *srcdir,
+                      char *binpath, size_t size, char *tmpdir) {
+    tmpdir[0] = '\0';
+    CompileCmd cc_cmd;
+    compile_cmd(srcdir, &cc_cmd);
+
+    char cache[1024];
+    if (binary_cache_dir(cache, sizeof(cache)) != 0) {
+        err("--pgo needs a cache directory ($XDG_CACHE_HOME or $HOME)");
+        return 1;
+    }
+    char *yaml = find_project_yaml(srcdir);
+    char train[1024];
+    pgo_train_command(yaml, train, sizeof(train));
+
+    unsigned long long h = pp_hash(PP_HASH_INIT, c_code, strlen(c_code));
+    h = pp_hash(h, cc_cmd.pre, strlen(cc_cmd.pre) + 1);
+    h = pp_hash(h, cc_cmd.post, strlen(cc_cmd.post) + 1);
+    h = pp_hash(h, train, strlen(train) + 1);
+
+    char real[PATH_MAX];
+    const char *key = realpath(srcpath, real) ? real : srcpath;
+    char dir[PATH_MAX], work[PATH_MAX];
+    int n1 = snprintf(dir, sizeof(dir), "%s/pgo-%016llx", cache,
+                      pp_hash(PP_HASH_INIT, key, strlen(key)));
+    int n2 = snprintf(work, sizeof(work), "%s/%d.tmp", dir, (int)getpid());
+    int n3 = snprintf(binpath, size, "%s/%016llx", dir, h);
+    if (n1 < 0 || n1 >= (int)sizeof(dir) || n2 < 0 || n2 >= (int)sizeof(work) ||
+        n3 < 0 || (size_t)n3 >= size) {
+        err("cache path too long: '%s'", cache);
+        free(yaml);
+        return 1;
+    }
+    if (access(binpath, X_OK) == 0) {
+        free(yaml);
+        return 0;
+    }
+    mkdir(dir, 0755);
+    fs_rmrf(work);
+
+    char cpath[PATH_MAX + 8], out[PATH_MAX + 8], profile[PATH_MAX + 8];
+    snprintf(cpath, sizeof(cpath), "%s/out.c", work);
+    snprintf(out, sizeof(out), "%s/out", work);
+    FILE *f = mkdir(work, 0755) == 0 ? fopen(cpath, "w") : NULL;
     if (!f) {
-        fprintf(stderr, "moxy: failed to write temp file\n");
-        fs_rmrf(tmpdir);
+        fprintf(stderr, "moxy: cannot write '%s'\n", cpath);
+        free(yaml);
         return 1;
     }
     fputs(c_code, f);
     fclose(f);
 
-    int rc = compile_single(cpath, binpath, srcdir);
+    int rc = 0;
+    if (pgo_profile_dir(work, profile, sizeof(profile)) != 0) {
+        fprintf(stderr, "moxy: cannot create '%s/pgo'\n", work);
+        rc = 1;
+    }
+
+    const char *opt = strstr(cc_cmd.pre, " -O") ? "" : " -O2";
+    char flags[PATH_MAX + 64], cmd[16384];
+    for (int use = 0; use <= 1 && rc == 0; use++) {
+        if (pgo_flags(profile, use, flags, sizeof(flags)) != 0) {
+            rc = 1;
+            break;
+        }
+        snprintf(cmd, sizeof(cmd), "%s%s %s -o '%s' '%s'%s", cc_cmd.pre, opt, flags,
+                 out, cpath, cc_cmd.post);
+        PassClock pc;
+        pass_begin(&pc);
+        rc = exit_code(run_shell(cmd, -1));
+        pass_mark(&pc, PASS_CC);
+        pass_end(&pc, srcpath);
+        if (rc == 0 && !use) rc = pgo_train(yaml, out);
+    }
+    free(yaml);
+    if (rc == 0 && rename(out, binpath) != 0) {
+        fprintf(stderr, "moxy: cannot write '%s'\n", binpath);
+        rc = 1;
+    }
+
+    /* binaries of older code; other runs' work directories are theirs */
+    DIR *d = rc == 0 ? opendir(dir) : NULL;
+    struct dirent *ent;
+    while (d && (ent = readdir(d)) != NULL) {
+        if (ent->d_name[0] == '.' || ends_with(ent->d_name, ".tmp") ||
+            strcmp(ent->d_name, binpath + n1 + 1) == 0)
+            continue;
+        char path[PATH_MAX + 264];
+        snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name);
+        if (ent->d_type == DT_DIR) fs_rmrf(path);
+        else remove(path);
+    }
+    if (d) closedir(d);
+    fs_rmrf(work);
+    return rc;
+}
+
+/* marks the generated sources as changed, since the C build has no way
+   to know the flags did */
+static void touch_sources(const char *dir) {
+    DIR *d = opendir(dir);
+    if (!d) return;
+    struct dirent *ent;
+    while ((ent = readdir(d)) != NULL) {
+        if (!ends_with(ent->d_name, ".c")) continue;
+        char path[1024];
+        snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name);
+        utimes(path, NULL);
+    }
+    closedir(d);
+}
+
+/* projects: two release builds of gen_dir around a training run, with
+   the profile in build/pgo */
+static int pgo_build_project(Config *cfg, const char *gen_dir) {
+    char profile[1024];
+    if (pgo_profile_dir(GOOSE_BUILD, profile, sizeof(profile)) != 0) {
+        err("cannot create %s/pgo", GOOSE_BUILD);
+        return -1;
+    }
+
+    char cflags[sizeof(cfg->cflags)], ldflags[sizeof(cfg->ldflags)];
+    memcpy(cflags, cfg->cflags, sizeof(cflags));
+    memcpy(ldflags, cfg->ldflags, sizeof(ldflags));
+
+    char binpath[1024];
+    snprintf(binpath, sizeof(binpath), "%s/release/%s", GOOSE_BUILD, cfg->name);
+
+    int rc = 0;
+    for (int use = 0; use <= 1 && rc == 0; use++) {
+        char flags[1500];
+        if (pgo_flags(profile, use, flags, sizeof(flags)) != 0) {
+            rc = -1;
+            break;
+        }
+        if (strlen(cflags) + strlen(flags) + 2 > sizeof(cfg->cflags)
+            || strlen(ldflags) + strlen(flags) + 2 > sizeof(cfg->ldflags)) {
+            err("--pgo: cflags or ldflags too long to add %s", flags);
+            rc = -1;
+            break;
+        }
+        memcpy(cfg->cflags, cflags, sizeof(cflags));
+        memcpy(cfg->ldflags, ldflags, sizeof(ldflags));
+        append_flag(cfg->cflags, sizeof(cfg->cflags), flags);
+        /* linking instrumented objects needs the profiling runtime */
+        if (!use) append_flag(cfg->ldflags, sizeof(cfg->ldflags), flags);
+
+        info("Building", "%s (%s)", cfg->name, use ? "profile-optimized" : "instrumented");
+        touch_sources(gen_dir);
+        if (cc_build_project(cfg, 1, gen_dir) != 0)
+            rc = -1;
+        else if (!use && pgo_train(MOXY_CONFIG, binpath) != 0)
+            rc = -1;
+    }
+
+    memcpy(cfg->cflags, cflags, sizeof(cflags));
+    memcpy(cfg->ldflags, ldflags, sizeof(ldflags));
+    return rc;
+}
+
+static int transpile_project(const Config *cfg) {
+    char gen_dir[512];
+    snprintf(gen_dir, sizeof(gen_dir), "%s/gen", GOOSE_BUILD);
+    return transpile_project_to(cfg, gen_dir);
+}
+
+/* ── single-file commands ────────────────────────────────────── */
+
+static int cmd_run_file(const char *srcpath, int argc, char **argv, int arg_offset) {
+    char srcdir[512];
+    dir_of(srcpath, srcdir, sizeof(srcdir));
+    const char *c_code = transpile(srcpath);
+
+    char tmpdir[] = "/tmp/moxy_XXXXXX";
+    char binpath[1024];
+    int rc = pgo_build ? pgo_binary(c_code, srcpath, srcdir, binpath, sizeof(binpath), tmpdir)
+                       : cached_binary(c_code, srcpath, srcdir, binpath, sizeof(binpath), tmpdir);
     if (rc != 0) {
-        fs_rmrf(tmpdir);
+        if (tmpdir[0]) fs_rmrf(tmpdir);
         return rc;
     }
 
@@ -455,7 +1592,7 @@ static int cmd_run_file(const char *srcpath, int argc, char **argv, int arg_offs
     waitpid(pid, &status, 0);
 
     free(prog_argv);
-    fs_rmrf(tmpdir);
+    if (tmpdir[0]) fs_rmrf(tmpdir);
 
     if (WIFEXITED(status)) return WEXITSTATUS(status);
     return 1;
@@ -479,25 +1616,14 @@ static int cmd_build_file(const char *srcpath, const char *outpath) {
     const char *c_code = transpile(srcpath);
 
     char tmpdir[] = "/tmp/moxy_XXXXXX";
-    if (!mkdtemp(tmpdir)) {
-        fprintf(stderr, "moxy: failed to create temp directory\n");
-        return 1;
-    }
-
-    char cpath[512];
-    snprintf(cpath, sizeof(cpath), "%s/out.c", tmpdir);
-
-    FILE *f = fopen(cpath, "w");
-    if (!f) {
-        fprintf(stderr, "moxy: failed to write temp file\n");
-        fs_rmrf(tmpdir);
-        return 1;
+    char binpath[1024];
+    int rc = pgo_build ? pgo_binary(c_code, srcpath, srcdir, binpath, sizeof(binpath), tmpdir)
+                       : cached_binary(c_code, srcpath, srcdir, binpath, sizeof(binpath), tmpdir);
+    if (rc == 0 && copy_binary(binpath, outpath) != 0) {
+        fprintf(stderr, "moxy: cannot write '%s'\n", outpath);
+        rc = 1;
     }
-    fputs(c_code, f);
-    fclose(f);
-
-    int rc = compile_single(cpath, outpath, srcdir);
-    fs_rmrf(tmpdir);
+    if (tmpdir[0]) fs_rmrf(tmpdir);
 
     if (rc == 0)
         info("Built", "%s", outpath);
@@ -576,10 +1702,202 @@ static void ws_collect_deps(int idx, const Config members[], int n,
             ws_collect_deps(dep_idx, members, n, needed, need_count);
     }
 
-    needed[(*need_count)++] = idx;
+    needed[(*need_count)++] = idx;
+}
+
+/* ── workspace scheduler ─────────────────────────────────────── */
+
+/* Members build on up to -j threads, each as soon as the workspace members
+   it depends on have built. Transpiling is one member at a time: it has its
+   own -j threads and shares the transpile job table. The C builds, where
+   the time goes, overlap. Each runs in a forked child, so goose, which is
+   not written for threads, runs single-threaded, and --lto sets CFLAGS in
+   the child rather than in the environment the other threads share. */
+enum { WS_PENDING, WS_RUNNING, WS_DONE, WS_FAILED };
+
+static struct {
+    Config *members;
+    int n;
+    const int *set;     /* members to build, dependencies first */
+    int count;
+    int release;
+    int state[MAX_WS_MEMBERS];
+    double ms[MAX_WS_MEMBERS];
+    int running;
+    int failed;
+    int base_async, base_arc;   /* global flags, for every member's thread */
+} ws;
+static pthread_mutex_t ws_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ws_cond = PTHREAD_COND_INITIALIZER;
+static pthread_mutex_t ws_transpile_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* the first pending member whose workspace deps are all built, or -1 */
+static int ws_next_ready(void) {
+    for (int i = 0; i < ws.count; i++) {
+        int idx = ws.set[i];
+        if (ws.state[idx] != WS_PENDING) continue;
+        int ready = 1;
+        for (int d = 0; d < ws.members[idx].dep_count && ready; d++) {
+            int dep_idx = ws_find_member(ws.members, ws.n, ws.members[idx].deps[d].name);
+            if (dep_idx >= 0 && ws.state[dep_idx] != WS_DONE) ready = 0;
+        }
+        if (ready) return idx;
+    }
+    return -1;
+}
+
+/* goose's build of a member, in a child process. The child runs goose
+   without exec, and other threads may hold malloc or stdio locks at the
+   fork. POSIX only allows async-signal-safe calls in such a child; this
+   relies on glibc, whose fork resets its own locks in the child. */
+static int ws_cc_build(Config *cfg, int is_lib, const char *gen_dir) {
+    PassClock pc;
+    pass_begin(&pc);
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid < 0) return 1;
+    if (pid == 0) {
+        if (lto_build) export_lto_cflags();
+        int rc = is_lib ? build_library(cfg, ws.release, gen_dir)
+                        : build_project_at(cfg, ws.release, gen_dir);
+        fflush(NULL);
+        _exit(rc != 0);
+    }
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) return 1;
+    }
+    pass_mark(&pc, PASS_CC);
+    pass_end(&pc, cfg->name);
+    return !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+}
+
+static int ws_build_member(int idx) {
+    Config *members = ws.members;
+    int n = ws.n;
+    int is_lib = strcmp(members[idx].type, "lib") == 0;
+
+    info("Building", "%s (%s)", members[idx].name,
+         is_lib ? "library" : "binary");
+
+    char gen_dir[512];
+    snprintf(gen_dir, sizeof(gen_dir), "%s/%s/%s", GOOSE_BUILD,
+             unity_build ? "unity" : "gen", members[idx].name);
+    fs_mkdir(gen_dir);
+
+    moxy_async_enabled = ws.base_async;
+    moxy_arc_enabled = ws.base_arc;
+    pthread_mutex_lock(&ws_transpile_lock);
+    int rc = unity_build ? transpile_unity(&members[idx], gen_dir)
+                         : transpile_project_to(&members[idx], gen_dir);
+    pthread_mutex_unlock(&ws_transpile_lock);
+    if (rc != 0)
+        return 1;
+
+    if (is_lib)
+        return ws_cc_build(&members[idx], 1, gen_dir);
+
+    /* inject -L/-l and include paths from workspace library deps, which
+       have finished building and are no longer written to */
+    char lib_dir[512];
+    snprintf(lib_dir, sizeof(lib_dir), "%s/lib", GOOSE_BUILD);
+
+    int loff = (int)strlen(members[idx].ldflags);
+    for (int d = 0; d < members[idx].dep_count; d++) {
+        int dep_idx = ws_find_member(members, n, members[idx].deps[d].name);
+        if (dep_idx >= 0 && strcmp(members[dep_idx].type, "lib") == 0) {
+            loff += snprintf(members[idx].ldflags + loff, 256 - loff,
+                            "%s-L%s -l%s", loff > 0 ? " " : "",
+                            lib_dir, members[dep_idx].name);
+
+            for (int j = 0; j < members[dep_idx].include_count; j++) {
+                if (members[idx].include_count < MAX_INCLUDES) {
+                    strncpy(members[idx].includes[members[idx].include_count],
+                            members[dep_idx].includes[j], MAX_PATH_LEN - 1);
+                    members[idx].include_count++;
+                }
+            }
+        }
+    }
+
+    return ws_cc_build(&members[idx], 0, gen_dir);
+}
+
+static void *ws_worker(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&ws_lock);
+    for (;;) {
+        int idx = ws.failed ? -1 : ws_next_ready();
+        if (idx < 0) {
+            /* with nothing building, nothing will become ready */
+            if (ws.failed || ws.running == 0) break;
+            pthread_cond_wait(&ws_cond, &ws_lock);
+            continue;
+        }
+        ws.state[idx] = WS_RUNNING;
+        ws.running++;
+        pthread_mutex_unlock(&ws_lock);
+
+        job_slot_acquire();
+        double start = now_ms();
+        int failed = ws_build_member(idx);
+        double ms = now_ms() - start;
+        job_slots_put(1);
+
+        pthread_mutex_lock(&ws_lock);
+        ws.ms[idx] = ms;
+        ws.state[idx] = failed ? WS_FAILED : WS_DONE;
+        if (failed) ws.failed = 1;
+        ws.running--;
+        pthread_cond_broadcast(&ws_cond);
+    }
+    pthread_mutex_unlock(&ws_lock);
+    return NULL;
+}
+
+/* prints the wall time and the chain of dependent members that bounds it */
+static void ws_summary(double wall_ms) {
+    double path_ms[MAX_WS_MEMBERS];
+    int prev[MAX_WS_MEMBERS];
+    int last = -1;
+    for (int i = 0; i < ws.count; i++) {
+        int idx = ws.set[i];
+        path_ms[idx] = 0;
+        prev[idx] = -1;
+        for (int d = 0; d < ws.members[idx].dep_count; d++) {
+            int dep_idx = ws_find_member(ws.members, ws.n, ws.members[idx].deps[d].name);
+            if (dep_idx >= 0 && path_ms[dep_idx] > path_ms[idx]) {
+                path_ms[idx] = path_ms[dep_idx];
+                prev[idx] = dep_idx;
+            }
+        }
+        path_ms[idx] += ws.ms[idx];
+        if (last < 0 || path_ms[idx] > path_ms[last]) last = idx;
+    }
+    if (last < 0) return;
+
+    int chain[MAX_WS_MEMBERS];
+    int len = 0;
+    for (int idx = last; idx >= 0 && len < MAX_WS_MEMBERS; idx = prev[idx])
+        chain[len++] = idx;
+
+    char path[1024];
+    int off = 0;
+    for (int i = len - 1; i >= 0 && off < (int)sizeof(path); i--)
+        off += snprintf(path + off, sizeof(path) - off, "%s%s (%.0fms)",
+                        i < len - 1 ? " -> " : "", ws.members[chain[i]].name, ws.ms[chain[i]]);
+
+    info("Finished", "%d member%s in %.0fms", ws.count, ws.count == 1 ? "" : "s", wall_ms);
+    info("Critical", "path %.0fms: %s", path_ms[last], path);
 }
 
 static int build_workspace(int release, const char *target) {
+    if (pgo_build) {
+        err("--pgo does not support workspaces yet");
+        return 1;
+    }
+
     Config root;
     LockFile lf;
     if (load_project(&root, &lf) != 0) return 1;
@@ -600,6 +1918,7 @@ static int build_workspace(int release, const char *target) {
             return 1;
         }
         ws_adjust_config(&members[i], root.ws_members[i]);
+        if (lto_build) apply_lto(&members[i]);
     }
 
     /* fetch external deps */
@@ -634,52 +1953,34 @@ static int build_workspace(int release, const char *target) {
     snprintf(gen_parent, sizeof(gen_parent), "%s/gen", GOOSE_BUILD);
     fs_mkdir(gen_parent);
 
-    /* build each member in dependency order */
+    ws.members = members;
+    ws.n = n;
+    ws.set = build_set;
+    ws.count = build_count;
+    ws.release = release;
+    ws.running = 0;
+    ws.failed = 0;
+    ws.base_async = moxy_async_enabled;
+    ws.base_arc = moxy_arc_enabled;
+    for (int i = 0; i < n; i++) ws.state[i] = WS_PENDING;
+
+    double start = now_ms();
+    job_slots = worker_count(MAX_TRANSPILE_THREADS);
+    pthread_t threads[MAX_WS_MEMBERS];
+    int nstarted = start_workers(threads, worker_count(build_count) - 1, ws_worker);
+    ws_worker(NULL);
+    for (int t = 0; t < nstarted; t++)
+        pthread_join(threads[t], NULL);
+    job_slots = -1;
+
+    if (ws.failed) return 1;
     for (int i = 0; i < build_count; i++) {
-        int idx = build_set[i];
-        int is_lib = strcmp(members[idx].type, "lib") == 0;
-
-        info("Building", "%s (%s)", members[idx].name,
-             is_lib ? "library" : "binary");
-
-        char gen_dir[512];
-        snprintf(gen_dir, sizeof(gen_dir), "%s/gen/%s", GOOSE_BUILD, members[idx].name);
-        fs_mkdir(gen_dir);
-
-        if (transpile_project_to(&members[idx], gen_dir) != 0)
+        if (ws.state[build_set[i]] != WS_DONE) {
+            err("workspace member '%s' never became buildable", members[build_set[i]].name);
             return 1;
-
-        if (is_lib) {
-            if (build_library(&members[idx], release, gen_dir) != 0)
-                return 1;
-        } else {
-            /* inject -L/-l and include paths from workspace library deps */
-            char lib_dir[512];
-            snprintf(lib_dir, sizeof(lib_dir), "%s/lib", GOOSE_BUILD);
-
-            int loff = (int)strlen(members[idx].ldflags);
-            for (int d = 0; d < members[idx].dep_count; d++) {
-                int dep_idx = ws_find_member(members, n, members[idx].deps[d].name);
-                if (dep_idx >= 0 && strcmp(members[dep_idx].type, "lib") == 0) {
-                    loff += snprintf(members[idx].ldflags + loff, 256 - loff,
-                                    "%s-L%s -l%s", loff > 0 ? " " : "",
-                                    lib_dir, members[dep_idx].name);
-
-                    for (int j = 0; j < members[dep_idx].include_count; j++) {
-                        if (members[idx].include_count < MAX_INCLUDES) {
-                            strncpy(members[idx].includes[members[idx].include_count],
-                                    members[dep_idx].includes[j], MAX_PATH_LEN - 1);
-                            members[idx].include_count++;
-                        }
-                    }
-                }
-            }
-
-            if (build_project_at(&members[idx], release, gen_dir) != 0)
-                return 1;
         }
     }
-
+    ws_summary(now_ms() - start);
     return 0;
 }
 
@@ -696,10 +1997,22 @@ static int cmd_build_project(int release, const char *target) {
         lock_save(MOXY_LOCK, &lf);
     }
 
-    if (transpile_project(&cfg) != 0) return 1;
-    if (build_project(&cfg, release) != 0) return 1;
+    if (lto_build) {
+        apply_lto(&cfg);
+        export_lto_cflags();
+    }
+
+    char gen_dir[512];
+    if (unity_build) {
+        snprintf(gen_dir, sizeof(gen_dir), "%s/unity", GOOSE_BUILD);
+        if (transpile_unity(&cfg, gen_dir) != 0) return 1;
+    } else {
+        snprintf(gen_dir, sizeof(gen_dir), "%s/gen", GOOSE_BUILD);
+        if (transpile_project(&cfg) != 0) return 1;
+    }
 
-    return 0;
+    if (pgo_build) return pgo_build_project(&cfg, gen_dir) != 0;
+    return cc_build_project(&cfg, release, gen_dir) != 0;
 }
 
 static int cmd_run_project(int release, const char *target, int argc, char **argv, int arg_offset) {
@@ -803,6 +2116,18 @@ static int cmd_run(int argc, char **argv) {
             release = 1;
             for (int j = i; j < argc - 1; j++) argv[j] = argv[j + 1];
             argc--; i--;
+        } else if (strcmp(argv[i], "--lto") == 0) {
+            release = lto_build = 1;
+            for (int j = i; j < argc - 1; j++) argv[j] = argv[j + 1];
+            argc--; i--;
+        } else if (strcmp(argv[i], "--unity") == 0) {
+            unity_build = 1;
+            for (int j = i; j < argc - 1; j++) argv[j] = argv[j + 1];
+            argc--; i--;
+        } else if (strcmp(argv[i], "--pgo") == 0) {
+            release = pgo_build = 1;
+            for (int j = i; j < argc - 1; j++) argv[j] = argv[j + 1];
+            argc--; i--;
         } else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
             target = argv[i + 1];
             for (int j = i; j < argc - 2; j++) argv[j] = argv[j + 2];
@@ -817,7 +2142,7 @@ static int cmd_run(int argc, char **argv) {
     /* project mode */
     if (!is_project_mode()) {
         fprintf(stderr, "usage: moxy run <file.mxy> [args]\n");
-        fprintf(stderr, "   or: moxy run [--release] [-p member] (in a project with %s)\n", MOXY_CONFIG);
+        fprintf(stderr, "   or: moxy run [--release] [--unity] [--lto] [--pgo] [-p member] (in a project with %s)\n", MOXY_CONFIG);
         return 1;
     }
 
@@ -832,21 +2157,32 @@ static int cmd_build(int argc, char **argv) {
     for (int i = 2; i < argc; i++) {
         if (strcmp(argv[i], "--release") == 0 || strcmp(argv[i], "-r") == 0) {
             release = 1;
+        } else if (strcmp(argv[i], "--lto") == 0) {
+            release = lto_build = 1;
+        } else if (strcmp(argv[i], "--unity") == 0) {
+            unity_build = 1;
+        } else if (strcmp(argv[i], "--pgo") == 0) {
+            release = pgo_build = 1;
         } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
             outpath = argv[++i];
         } else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
             target = argv[++i];
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            build_jobs = atoi(argv[++i]);
+        } else if (strncmp(argv[i], "-j", 2) == 0 && argv[i][2]) {
+            build_jobs = atoi(argv[i] + 2);
         }
     }
 
     /* if a .mxy file is specified → single-file mode */
-    if (argc > 2 && ends_with(argv[2], ".mxy"))
-        return cmd_build_file(argv[2], outpath);
+    for (int i = 2; i < argc; i++)
+        if (ends_with(argv[i], ".mxy") && strcmp(argv[i - 1], "-o") != 0)
+            return cmd_build_file(argv[i], outpath);
 
     /* project mode */
     if (!is_project_mode()) {
         fprintf(stderr, "usage: moxy build <file.mxy> [-o out]\n");
-        fprintf(stderr, "   or: moxy build [--release] [-p member] (in a project with %s)\n", MOXY_CONFIG);
+        fprintf(stderr, "   or: moxy build [--release] [--unity] [--lto] [--pgo] [-p member] [-j N] (in a project with %s)\n", MOXY_CONFIG);
         return 1;
     }
 
@@ -855,7 +2191,25 @@ static int cmd_build(int argc, char **argv) {
 
 /* ── test ────────────────────────────────────────────────────── */
 
-static int run_one_test(const char *srcpath) {
+/* one test file of a run; workers fill in the result, and the main
+   thread prints results in file order as they complete */
+typedef struct {
+    const char *path;
+    int rc;
+    double ms;
+    char *log;      /* what its transpile, compile and run printed */
+    size_t loglen;
+    int done;
+} TestJob;
+
+static TestJob *test_jobs;
+static int ntest_jobs;
+static int test_next;
+static int test_async, test_arc;    /* global flags when the run started */
+static pthread_mutex_t test_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t test_cond = PTHREAD_COND_INITIALIZER;
+
+static int run_one_test(const char *srcpath, int log_fd, FILE *log) {
     char *test_src = read_file(srcpath);
     int needs_async = (strstr(test_src, "Future<") != NULL ||
                        strstr(test_src, "await ") != NULL);
@@ -864,12 +2218,9 @@ static int run_one_test(const char *srcpath) {
                       strstr(test_src, "map[") != NULL));
     free(test_src);
 
-    int saved_async = moxy_async_enabled;
-    int saved_arc = moxy_arc_enabled;
-    if (needs_async) moxy_async_enabled = 1;
-    if (needs_arc) moxy_arc_enabled = 1;
-
-    const char *c_code = transpile(srcpath);
+    /* the flags are thread-local, so each job sets its own */
+    moxy_async_enabled = test_async || needs_async;
+    moxy_arc_enabled = test_arc || needs_arc;
 
     char tmpdir[] = "/tmp/moxy_XXXXXX";
     if (!mkdtemp(tmpdir)) return 1;
@@ -878,105 +2229,643 @@ static int run_one_test(const char *srcpath) {
     snprintf(cpath, sizeof(cpath), "%s/out.c", tmpdir);
     snprintf(binpath, sizeof(binpath), "%s/out", tmpdir);
 
-    FILE *f = fopen(cpath, "w");
-    if (!f) { fs_rmrf(tmpdir); return 1; }
-    fputs(c_code, f);
-    fclose(f);
+    /* a transpile error fails this test instead of exiting the run. The
+       unwound compilation leaves its names installed and the C file open,
+       which are put right here so the worker's next test starts clean; its
+       other memory is not reclaimed. */
+    FILE *out = fopen(cpath, "w");
+    if (!out) { fs_rmrf(tmpdir); return 1; }
+    InternTable *names = intern_use(NULL);
+    intern_use(names);
+    DiagCapture cap = {0};
+    cap.print = log;
+    DiagCapture *prev_cap = diag_capture(&cap);
+    volatile int transpiled = 0;
+    if (setjmp(cap.bail) == 0) {
+        transpile_into(srcpath, NULL, out);
+        transpiled = 1;
+    } else {
+        InternTable *left = intern_use(names);
+        if (left != names) intern_table_free(left);
+    }
+    diag_capture(prev_cap);
+    fflush(log);
+    if (fclose(out) != 0) transpiled = 0;
+    if (!transpiled) { fs_rmrf(tmpdir); return 1; }
 
     char testdir[512];
     dir_of(srcpath, testdir, sizeof(testdir));
-    int rc = compile_single(cpath, binpath, testdir);
+    PassClock pc;
+    pass_begin(&pc);
+    int rc = compile_single(cpath, binpath, testdir, log_fd);
+    pass_mark(&pc, PASS_CC);
+    pass_end(&pc, srcpath);
     if (rc != 0) { fs_rmrf(tmpdir); return rc; }
 
     pid_t pid = fork();
     if (pid == 0) {
+        dup2(log_fd, STDOUT_FILENO);
+        dup2(log_fd, STDERR_FILENO);
         execl(binpath, binpath, (char *)NULL);
         _exit(127);
     }
 
-    int status;
-    waitpid(pid, &status, 0);
+    int status = 0;
+    if (pid > 0)
+        while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
     fs_rmrf(tmpdir);
 
+    if (pid > 0 && WIFEXITED(status)) return WEXITSTATUS(status);
+    return 1;
+}
+
+/* run on the calling thread when no thread starts, so it puts back the
+   flags run_one_test sets */
+static void *test_worker(void *arg) {
+    (void)arg;
+    int saved_async = moxy_async_enabled;
+    int saved_arc = moxy_arc_enabled;
+    for (;;) {
+        pthread_mutex_lock(&test_lock);
+        int i = test_next++;
+        pthread_mutex_unlock(&test_lock);
+        if (i >= ntest_jobs) break;
+
+        TestJob *job = &test_jobs[i];
+        double start = now_ms();
+        FILE *log = tmpfile();
+        if (log) {
+            job->rc = run_one_test(job->path, fileno(log), log);
+            fseek(log, 0, SEEK_END);
+            long len = ftell(log);
+            if (len < 0) len = 0;
+            job->log = malloc(len + 1);
+            rewind(log);
+            job->loglen = job->log ? fread(job->log, 1, len, log) : 0;
+            fclose(log);
+        } else {
+            job->rc = 1;
+        }
+        job->ms = now_ms() - start;
+
+        pthread_mutex_lock(&test_lock);
+        job->done = 1;
+        pthread_cond_broadcast(&test_cond);
+        pthread_mutex_unlock(&test_lock);
+    }
     moxy_async_enabled = saved_async;
     moxy_arc_enabled = saved_arc;
-
-    if (WIFEXITED(status)) return WEXITSTATUS(status);
-    return 1;
+    return NULL;
 }
 
-static void collect_files(const char *dir, const char *suffix, char files[][512], int *count, int max) {
+static void collect_files(const char *dir, const char *suffix, FileList *files) {
     DIR *d = opendir(dir);
     if (!d) return;
 
     struct dirent *ent;
-    while ((ent = readdir(d)) != NULL && *count < max) {
+    while ((ent = readdir(d)) != NULL) {
         if (ent->d_name[0] == '.') continue;
 
         char path[512];
         snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name);
 
-        if (ent->d_type == DT_DIR) {
-            collect_files(path, suffix, files, count, max);
-        } else if (ends_with(ent->d_name, suffix)) {
-            strncpy(files[*count], path, 511);
-            files[*count][511] = '\0';
-            (*count)++;
-        }
+        if (ent->d_type == DT_DIR)
+            collect_files(path, suffix, files);
+        else if (ends_with(ent->d_name, suffix))
+            file_list_add(files, path);
     }
     closedir(d);
 }
 
 static int cmd_test(int argc, char **argv) {
-    char files[256][512];
-    int nfiles = 0;
+    FileList list = {0};
 
-    if (argc >= 3) {
-        for (int i = 2; i < argc && nfiles < 256; i++) {
-            strncpy(files[nfiles], argv[i], 511);
-            files[nfiles][511] = '\0';
-            nfiles++;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            build_jobs = atoi(argv[++i]);
+        } else if (strncmp(argv[i], "-j", 2) == 0 && argv[i][2]) {
+            build_jobs = atoi(argv[i] + 2);
+        } else {
+            file_list_add(&list, argv[i]);
         }
-    } else {
-        collect_files(".", "_test.mxy", files, &nfiles, 256);
     }
 
+    if (list.count == 0)
+        collect_files(".", "_test.mxy", &list);
+    char **files = list.paths;
+    int nfiles = list.count;
+
     if (nfiles == 0) {
         fprintf(stderr, "moxy: no test files found\n");
         fprintf(stderr, "  name test files with _test.mxy suffix (e.g. math_test.mxy)\n");
         return 1;
     }
 
-    int passed = 0, failed = 0;
-    double total_ms = 0;
+    test_jobs = calloc(nfiles, sizeof(TestJob));
+    ntest_jobs = nfiles;
+    test_next = 0;
+    test_async = moxy_async_enabled;
+    test_arc = moxy_arc_enabled;
+    for (int i = 0; i < nfiles; i++)
+        test_jobs[i] = (TestJob){ .path = files[i] };
 
+    /* workers transpile, compile and run tests while this thread reports
+       them in order; with no worker started it runs them itself */
+    double start = now_ms();
+    pthread_t threads[MAX_TRANSPILE_THREADS];
+    int nstarted = start_workers(threads, worker_count(nfiles), test_worker);
+    if (nstarted == 0) test_worker(NULL);
+
+    int passed = 0, failed = 0;
     for (int i = 0; i < nfiles; i++) {
+        TestJob *job = &test_jobs[i];
+        pthread_mutex_lock(&test_lock);
+        while (!job->done)
+            pthread_cond_wait(&test_cond, &test_lock);
+        pthread_mutex_unlock(&test_lock);
+
         const char *display = files[i];
         if (display[0] == '.' && display[1] == '/') display += 2;
 
         fprintf(stderr, "  test %s ... ", display);
-        fflush(stderr);
-
-        double start = now_ms();
-        int rc = run_one_test(files[i]);
-        double elapsed = now_ms() - start;
-        total_ms += elapsed;
+        if (job->loglen) fwrite(job->log, 1, job->loglen, stderr);
+        free(job->log);
 
-        if (rc == 0) {
-            fprintf(stderr, "ok (%.0fms)\n", elapsed);
+        if (job->rc == 0) {
+            fprintf(stderr, "ok (%.0fms)\n", job->ms);
             passed++;
         } else {
-            fprintf(stderr, "FAIL (exit %d, %.0fms)\n", rc, elapsed);
+            fprintf(stderr, "FAIL (exit %d, %.0fms)\n", job->rc, job->ms);
             failed++;
         }
     }
+    for (int t = 0; t < nstarted; t++)
+        pthread_join(threads[t], NULL);
+    double total_ms = now_ms() - start;
 
     fprintf(stderr, "\n  %d passed, %d failed (%d total) in %.1fs\n",
             passed, failed, nfiles, total_ms / 1000.0);
 
+    free(test_jobs);
+    test_jobs = NULL;
+    ntest_jobs = 0;
+    file_list_free(&list);
     return failed > 0 ? 1 : 0;
 }
 
+/* ── bench ───────────────────────────────────────────────────── */
+
+/* A *_bench.mxy file defines `void bench_name()` functions instead of
+   main. Each file is compiled with -O2 along with a small driver that
+   warms every function up, sizes batches so one sample takes about
+   --sample-ms, and writes the per-call time of each sample to a results
+   file. Statistics, JSON and the baseline comparison are done here.
+   Files run one at a time so they don't disturb each other's timings. */
+
+#define MAX_BENCH_FUNCS 64
+#define MAX_BENCHES     512
+
+typedef struct {
+    char file[512];
+    char name[128];
+    long iters;
+    int samples;
+    double median, mad, p5, p95, min, max;   /* ns per call */
+} BenchResult;
+
+static BenchResult bench_results[MAX_BENCHES];
+static int nbench_results;
+
+/* the top-level `void bench_*()` functions of a file; sets *has_main when
+   the file defines main, which the driver would clash with */
+static int bench_functions(const char *path, char names[][128], int max, int *has_main) {
+    InternTable *table = intern_table_new();
+    InternTable *prev_names = intern_use(table);
+    char *src = preprocess_file(shared_pp(), path);
+
+    Lexer lexer;
+    lexer_init(&lexer, src);
+    TokenList tl = {0};
+    lexer_lex_all(&lexer, &tl);
+
+    int n = 0, depth = 0;
+    *has_main = 0;
+    for (int i = 0; i < tl.count; i++) {
+        Token *t = &tl.toks[i];
+        if (t->kind == TOK_LBRACE) depth++;
+        else if (t->kind == TOK_RBRACE) depth--;
+        if (depth != 0 || t->kind != TOK_IDENT || i + 1 >= tl.count ||
+            tl.toks[i + 1].kind != TOK_LPAREN)
+            continue;
+        const char *name = src + t->off;
+        if (t->len == 4 && strncmp(name, "main", 4) == 0) {
+            *has_main = 1;
+        } else if (t->len > 6 && t->len < 128 && strncmp(name, "bench_", 6) == 0 &&
+                   i > 0 && tl.toks[i - 1].kind == TOK_VOID_KW &&
+                   i + 2 < tl.count && tl.toks[i + 2].kind == TOK_RPAREN && n < max) {
+            memcpy(names[n], name, t->len);
+            names[n][t->len] = '\0';
+            n++;
+        }
+    }
+
+    token_list_free(&tl);
+    free(src);
+    intern_use(prev_names);
+    intern_table_free(table);
+    return n;
+}
+
+/* appended to the generated C: main(results, samples, warmup ms, sample ms) */
+static const char bench_driver_head[] =
+    "\n/* moxy bench driver */\n"
+    "#include <stdio.h>\n"
+    "#include <stdlib.h>\n"
+    "#include <time.h>\n"
+    "\n"
+    "static double moxy_bench_now(void) {\n"
+    "    struct timespec ts;\n"
+    "    timespec_get(&ts, TIME_UTC);\n"
+    "    return ts.tv_sec * 1e9 + ts.tv_nsec;\n"
+    "}\n"
+    "\n"
+    "static void moxy_bench_run(FILE *out, const char *name, void (*fn)(void),\n"
+    "                           int samples, double warmup_ns, double sample_ns) {\n"
+    "    /* warm up with doubling batches, which also measures a call */\n"
+    "    long batch = 1, done = 0;\n"
+    "    double start = moxy_bench_now(), elapsed;\n"
+    "    do {\n"
+    "        for (long i = 0; i < batch; i++) fn();\n"
+    "        done += batch;\n"
+    "        batch *= 2;\n"
+    "        elapsed = moxy_bench_now() - start;\n"
+    "    } while (elapsed < warmup_ns);\n"
+    "    double per_call = elapsed / done;\n"
+    "    long iters = per_call > 0 ? (long)(sample_ns / per_call) : 1;\n"
+    "    if (iters < 1) iters = 1;\n"
+    "    fprintf(out, \"%s %ld\", name, iters);\n"
+    "    for (int s = 0; s < samples; s++) {\n"
+    "        double t0 = moxy_bench_now();\n"
+    "        for (long i = 0; i < iters; i++) fn();\n"
+    "        fprintf(out, \" %.3f\", (moxy_bench_now() - t0) / iters);\n"
+    "    }\n"
+    "    fprintf(out, \"\\n\");\n"
+    "    fflush(out);\n"
+    "}\n"
+    "\n"
+    "int main(int argc, char **argv) {\n"
+    "    if (argc < 5) return 2;\n"
+    "    FILE *out = fopen(argv[1], \"w\");\n"
+    "    if (!out) return 2;\n"
+    "    int samples = atoi(argv[2]);\n"
+    "    double warmup_ns = atof(argv[3]) * 1e6, sample_ns = atof(argv[4]) * 1e6;\n";
+
+static char *bench_program(const char *c_code, char names[][128], int n) {
+    size_t size = strlen(c_code) + sizeof(bench_driver_head) + n * 320 + 64;
+    char *prog = malloc(size);
+    if (!prog) return NULL;
+    size_t off = snprintf(prog, size, "%s%s", c_code, bench_driver_head);
+    for (int i = 0; i < n; i++)
+        off += snprintf(prog + off, size - off,
+                        "    moxy_bench_run(out, \"%s\", %s, samples, warmup_ns, sample_ns);\n",
+                        names[i], names[i]);
+    snprintf(prog + off, size - off, "    fclose(out);\n    return 0;\n}\n");
+    return prog;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+/* p in [0, 1], interpolating between the two nearest samples */
+static double percentile(const double *sorted, int n, double p) {
+    double pos = p * (n - 1);
+    int lo = (int)pos;
+    if (lo >= n - 1) return sorted[n - 1];
+    return sorted[lo] + (sorted[lo + 1] - sorted[lo]) * (pos - lo);
+}
+
+static void bench_stats(BenchResult *r, double *v, int n) {
+    qsort(v, n, sizeof(double), cmp_double);
+    r->samples = n;
+    r->median = percentile(v, n, 0.5);
+    r->p5 = percentile(v, n, 0.05);
+    r->p95 = percentile(v, n, 0.95);
+    r->min = v[0];
+    r->max = v[n - 1];
+    for (int i = 0; i < n; i++)
+        v[i] = v[i] > r->median ? v[i] - r->median : r->median - v[i];
+    qsort(v, n, sizeof(double), cmp_double);
+    r->mad = percentile(v, n, 0.5);
+}
+
+/* reads the driver's lines: name, iterations per sample, then samples */
+static int bench_read_results(const char *path, const char *display) {
+    FILE *f = fopen(path, "r");
+    if (!f) return 0;
+    int n = 0;
+    char line[65536];
+    while (fgets(line, sizeof(line), f) && nbench_results < MAX_BENCHES) {
+        BenchResult *r = &bench_results[nbench_results];
+        memset(r, 0, sizeof(*r));
+        char *p = line;
+        int used = 0;
+        if (sscanf(p, "%127s %ld%n", r->name, &r->iters, &used) != 2) continue;
+        p += used;
+        double v[1024];
+        int nv = 0;
+        while (nv < 1024 && sscanf(p, "%lf%n", &v[nv], &used) == 1) {
+            p += used;
+            nv++;
+        }
+        if (nv == 0) continue;
+        snprintf(r->file, sizeof(r->file), "%s", display);
+        bench_stats(r, v, nv);
+        nbench_results++;
+        n++;
+    }
+    fclose(f);
+    return n;
+}
+
+static int bench_samples = 30;
+static double bench_warmup_ms = 100, bench_sample_ms = 10;
+
+/* compiles and runs one file, appending its results; returns 0 on success */
+static int bench_file(const char *srcpath, const char *display, const char *filter) {
+    char names[MAX_BENCH_FUNCS][128];
+    int has_main = 0;
+    int n = bench_functions(srcpath, names, MAX_BENCH_FUNCS, &has_main);
+    if (filter) {
+        int kept = 0;
+        for (int i = 0; i < n; i++)
+            if (strstr(names[i], filter)) memmove(names[kept++], names[i], 128);
+        if (kept == 0) return 0;
+        n = kept;
+    }
+    if (has_main) {
+        fprintf(stderr, "moxy: %s: bench files define bench_ functions, not main\n", display);
+        return 1;
+    }
+    if (n == 0) {
+        fprintf(stderr, "moxy: %s: no `void bench_...()` functions\n", display);
+        return 1;
+    }
+
+    int file = pp_load(shared_pp(), srcpath);
+    unsigned features = pp_features(shared_pp(), file);
+    moxy_async_enabled = moxy_async_enabled || (features & PP_USES_ASYNC);
+    moxy_arc_enabled = moxy_arc_enabled || (features & PP_USES_ARC);
+
+    char srcdir[512];
+    dir_of(srcpath, srcdir, sizeof(srcdir));
+    char *prog = bench_program(transpile(srcpath), names, n);
+    if (!prog) return 1;
+
+    char tmpdir[] = "/tmp/moxy_XXXXXX";
+    char binpath[1024];
+    int rc = cached_binary(prog, srcpath, srcdir, binpath, sizeof(binpath), tmpdir);
+    free(prog);
+    if (rc != 0) {
+        if (tmpdir[0]) fs_rmrf(tmpdir);
+        return rc;
+    }
+
+    char results[] = "/tmp/moxy_bench_XXXXXX";
+    int fd = mkstemp(results);
+    if (fd < 0) {
+        if (tmpdir[0]) fs_rmrf(tmpdir);
+        return 1;
+    }
+    close(fd);
+
+    char samples[32], warmup[32], sample[32];
+    snprintf(samples, sizeof(samples), "%d", bench_samples);
+    snprintf(warmup, sizeof(warmup), "%g", bench_warmup_ms);
+    snprintf(sample, sizeof(sample), "%g", bench_sample_ms);
+
+    /* what the benchmarks print would repeat on every call */
+    pid_t pid = fork();
+    if (pid == 0) {
+        int null_fd = open("/dev/null", O_WRONLY);
+        if (null_fd >= 0) dup2(null_fd, STDOUT_FILENO);
+        execl(binpath, binpath, results, samples, warmup, sample, (char *)NULL);
+        _exit(127);
+    }
+    int status = 0;
+    if (pid > 0)
+        while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+    rc = pid > 0 && WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+
+    int got = bench_read_results(results, display);
+    remove(results);
+    if (tmpdir[0]) fs_rmrf(tmpdir);
+    if (rc == 0 && got < n) rc = 1;
+    return rc;
+}
+
+/* a transpile error fails this file instead of exiting the run; the
+   unwound compilation's memory is not reclaimed */
+static int bench_file_captured(const char *srcpath, const char *display, const char *filter) {
+    DiagCapture cap = {0};
+    cap.print = stderr;
+    DiagCapture *prev_cap = diag_capture(&cap);
+    volatile int rc = 1;
+    if (setjmp(cap.bail) == 0)
+        rc = bench_file(srcpath, display, filter);
+    diag_capture(prev_cap);
+    return rc;
+}
+
+static void format_ns(char *buf, size_t size, double ns) {
+    if (ns < 1e3)      snprintf(buf, size, "%.1fns", ns);
+    else if (ns < 1e6) snprintf(buf, size, "%.2fus", ns / 1e3);
+    else if (ns < 1e9) snprintf(buf, size, "%.2fms", ns / 1e6);
+    else               snprintf(buf, size, "%.2fs", ns / 1e9);
+}
+
+/* one benchmark per line, which is also what bench_load_baseline reads */
+static int bench_write_json(const char *path) {
+    FILE *f = strcmp(path, "-") == 0 ? stdout : fopen(path, "w");
+    if (!f) {
+        fprintf(stderr, "moxy: cannot write '%s'\n", path);
+        return 1;
+    }
+    fprintf(f, "{\n  \"benchmarks\": [\n");
+    for (int i = 0; i < nbench_results; i++) {
+        BenchResult *r = &bench_results[i];
+        fprintf(f, "    {\"file\": ");
+        json_string(f, r->file);
+        fprintf(f, ", \"name\": ");
+        json_string(f, r->name);
+        fprintf(f, ", \"iters\": %ld, \"samples\": %d, \"median_ns\": %.3f, \"mad_ns\": %.3f, "
+                   "\"p5_ns\": %.3f, \"p95_ns\": %.3f, \"min_ns\": %.3f, \"max_ns\": %.3f}%s\n",
+                r->iters, r->samples, r->median, r->mad, r->p5, r->p95, r->min, r->max,
+                i + 1 < nbench_results ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+    if (f == stdout) return 0;
+    return fclose(f) == 0 ? 0 : 1;
+}
+
+static int json_field_str(const char *line, const char *key, char *out, size_t size) {
+    char pat[64];
+    snprintf(pat, sizeof(pat), "\"%s\": \"", key);
+    const char *p = strstr(line, pat);
+    if (!p) return 0;
+    p += strlen(pat);
+    size_t n = 0;
+    for (; *p && *p != '"' && n + 1 < size; p++) {
+        if (*p == '\\' && p[1]) p++;
+        out[n++] = *p;
+    }
+    out[n] = '\0';
+    return 1;
+}
+
+static int json_field_num(const char *line, const char *key, double *out) {
+    char pat[64];
+    snprintf(pat, sizeof(pat), "\"%s\": ", key);
+    const char *p = strstr(line, pat);
+    return p && sscanf(p + strlen(pat), "%lf", out) == 1;
+}
+
+static BenchResult *baseline;
+static int nbaseline;
+
+static int bench_load_baseline(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "moxy: cannot read baseline '%s'\n", path);
+        return 1;
+    }
+    int cap = 0;
+    char line[2048];
+    while (fgets(line, sizeof(line), f)) {
+        BenchResult r = {0};
+        if (!json_field_str(line, "file", r.file, sizeof(r.file)) ||
+            !json_field_str(line, "name", r.name, sizeof(r.name)) ||
+            !json_field_num(line, "median_ns", &r.median))
+            continue;
+        json_field_num(line, "mad_ns", &r.mad);
+        if (nbaseline == cap) {
+            cap = cap ? cap * 2 : 64;
+            BenchResult *grown = realloc(baseline, cap * sizeof(BenchResult));
+            if (!grown) break;
+            baseline = grown;
+        }
+        baseline[nbaseline++] = r;
+    }
+    fclose(f);
+    return 0;
+}
+
+static const BenchResult *bench_find_baseline(const BenchResult *r) {
+    for (int i = 0; i < nbaseline; i++)
+        if (strcmp(baseline[i].file, r->file) == 0 && strcmp(baseline[i].name, r->name) == 0)
+            return &baseline[i];
+    return NULL;
+}
+
+/* prints a result, with its change against the baseline if there is one;
+   returns 1 if it regressed: slower by more than threshold percent and by
+   more than the noise of both runs (three times their summed MADs) */
+static int bench_report(const BenchResult *r, double threshold) {
+    char med[32], mad[32], p5[32], p95[32];
+    format_ns(med, sizeof(med), r->median);
+    format_ns(mad, sizeof(mad), r->mad);
+    format_ns(p5, sizeof(p5), r->p5);
+    format_ns(p95, sizeof(p95), r->p95);
+    fprintf(stderr, "    %-24s %10s ± %-9s p5 %-9s p95 %-9s (%d x %ld)",
+            r->name, med, mad, p5, p95, r->samples, r->iters);
+
+    const BenchResult *base = baseline ? bench_find_baseline(r) : NULL;
+    int regressed = 0;
+    if (base && base->median > 0) {
+        double change = (r->median - base->median) / base->median * 100.0;
+        regressed = change > threshold && r->median - base->median > 3 * (r->mad + base->mad);
+        fprintf(stderr, "  %+.1f%%%s", change, regressed ? " REGRESSED" : "");
+    } else if (baseline) {
+        fprintf(stderr, "  (new)");
+    }
+    fprintf(stderr, "\n");
+    return regressed;
+}
+
+static int cmd_bench(int argc, char **argv) {
+    FileList list = {0};
+    const char *json_path = NULL, *baseline_path = NULL, *filter = NULL;
+    double threshold = 10.0;
+
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            json_path = argv[++i];
+        } else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+            baseline_path = argv[++i];
+        } else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+            threshold = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (strcmp(argv[i], "--samples") == 0 && i + 1 < argc) {
+            bench_samples = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--warmup-ms") == 0 && i + 1 < argc) {
+            bench_warmup_ms = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--sample-ms") == 0 && i + 1 < argc) {
+            bench_sample_ms = atof(argv[++i]);
+        } else {
+            file_list_add(&list, argv[i]);
+        }
+    }
+    if (bench_samples < 1) bench_samples = 1;
+    if (bench_samples > 1024) bench_samples = 1024;
+
+    if (list.count == 0)
+        collect_files(".", "_bench.mxy", &list);
+    char **files = list.paths;
+    int nfiles = list.count;
+
+    if (nfiles == 0) {
+        fprintf(stderr, "moxy: no bench files found\n");
+        fprintf(stderr, "  name bench files with _bench.mxy suffix (e.g. sort_bench.mxy)\n");
+        return 1;
+    }
+    if (baseline_path && bench_load_baseline(baseline_path) != 0) return 1;
+
+    cc_opt = " -O2";
+    int saved_async = moxy_async_enabled, saved_arc = moxy_arc_enabled;
+    double start = now_ms();
+    int failed = 0, regressed = 0;
+    for (int i = 0; i < nfiles; i++) {
+        const char *display = files[i];
+        if (display[0] == '.' && display[1] == '/') display += 2;
+
+        fprintf(stderr, "  bench %s\n", display);
+        int first = nbench_results;
+        moxy_async_enabled = saved_async;
+        moxy_arc_enabled = saved_arc;
+
+        int rc = bench_file_captured(files[i], display, filter);
+        for (int r = first; r < nbench_results; r++)
+            regressed += bench_report(&bench_results[r], threshold);
+        if (rc != 0) {
+            fprintf(stderr, "    FAIL (exit %d)\n", rc);
+            failed++;
+        }
+    }
+    double total_ms = now_ms() - start;
+
+    fprintf(stderr, "\n  %d benchmarks in %d files", nbench_results, nfiles);
+    if (failed) fprintf(stderr, ", %d failed", failed);
+    if (baseline) fprintf(stderr, ", %d regressed (threshold %g%%)", regressed, threshold);
+    fprintf(stderr, " in %.1fs\n", total_ms / 1000.0);
+
+    if (json_path && bench_write_json(json_path) != 0) failed++;
+    free(baseline);
+    file_list_free(&list);
+    return failed > 0 || regressed > 0 ? 1 : 0;
+}
+
 /* ── fmt / lint ──────────────────────────────────────────────── */
 
 static MoxyConfig load_config_for(const char *filepath) {
@@ -995,21 +2884,20 @@ static MoxyConfig load_config_for(const char *filepath) {
 
 static int cmd_fmt(int argc, char **argv) {
     int check_only = 0;
-    char files[256][512];
-    int nfiles = 0;
+    FileList list = {0};
 
     for (int i = 2; i < argc; i++) {
         if (strcmp(argv[i], "--check") == 0) {
             check_only = 1;
-        } else if (nfiles < 256) {
-            strncpy(files[nfiles], argv[i], 511);
-            files[nfiles][511] = '\0';
-            nfiles++;
+        } else {
+            file_list_add(&list, argv[i]);
         }
     }
 
-    if (nfiles == 0)
-        collect_files(".", ".mxy", files, &nfiles, 256);
+    if (list.count == 0)
+        collect_files(".", ".mxy", &list);
+    char **files = list.paths;
+    int nfiles = list.count;
 
     if (nfiles == 0) {
         fprintf(stderr, "moxy: no .mxy files found\n");
@@ -1045,21 +2933,20 @@ static int cmd_fmt(int argc, char **argv) {
         free(src);
     }
 
+    file_list_free(&list);
     return any_diff ? 1 : 0;
 }
 
 static int cmd_lint(int argc, char **argv) {
-    char files[256][512];
-    int nfiles = 0;
+    FileList list = {0};
 
-    for (int i = 2; i < argc && nfiles < 256; i++) {
-        strncpy(files[nfiles], argv[i], 511);
-        files[nfiles][511] = '\0';
-        nfiles++;
-    }
+    for (int i = 2; i < argc; i++)
+        file_list_add(&list, argv[i]);
 
-    if (nfiles == 0)
-        collect_files(".", ".mxy", files, &nfiles, 256);
+    if (list.count == 0)
+        collect_files(".", ".mxy", &list);
+    char **files = list.paths;
+    int nfiles = list.count;
 
     if (nfiles == 0) {
         fprintf(stderr, "moxy: no .mxy files found\n");
@@ -1068,29 +2955,28 @@ static int cmd_lint(int argc, char **argv) {
 
     int total_warnings = 0;
     for (int i = 0; i < nfiles; i++) {
-        char *raw = read_file(files[i]);
-        char *src = preprocess(raw, files[i]);
-        free(raw);
+        InternTable *names = intern_table_new();
+        InternTable *prev_names = intern_use(names);
+        char *src = preprocess_file(shared_pp(), files[i]);
 
         diag_init(src, files[i]);
 
         Lexer lexer;
         lexer_init(&lexer, src);
 
-        Token tokens[16384];
-        int ntokens = 0;
-        for (;;) {
-            tokens[ntokens] = lexer_next(&lexer);
-            if (tokens[ntokens].kind == TOK_EOF) { ntokens++; break; }
-            ntokens++;
-        }
-
-        Node *program = parse(tokens, ntokens);
+        TokenList tl = {0};
+        lexer_lex_all(&lexer, &tl);
+        Arena arena = {0};
+        Node *program = parse(&arena, src, tl.toks, tl.count);
+        token_list_free(&tl);
         MoxyConfig cfg = load_config_for(files[i]);
         int warnings = lint_check(program, &cfg, src, files[i]);
         total_warnings += warnings;
+        arena_free(&arena);
 
         free(src);
+        intern_use(prev_names);
+        intern_table_free(names);
     }
 
     if (total_warnings > 0) {
@@ -1098,23 +2984,22 @@ static int cmd_lint(int argc, char **argv) {
                 total_warnings == 1 ? "" : "s");
     }
 
+    file_list_free(&list);
     return total_warnings > 0 ? 1 : 0;
 }
 
 /* ── check ───────────────────────────────────────────────────── */
 
 static int cmd_check(int argc, char **argv) {
-    char files[256][512];
-    int nfiles = 0;
+    FileList list = {0};
 
-    for (int i = 2; i < argc && nfiles < 256; i++) {
-        strncpy(files[nfiles], argv[i], 511);
-        files[nfiles][511] = '\0';
-        nfiles++;
-    }
+    for (int i = 2; i < argc; i++)
+        file_list_add(&list, argv[i]);
 
-    if (nfiles == 0)
-        collect_files(".", ".mxy", files, &nfiles, 256);
+    if (list.count == 0)
+        collect_files(".", ".mxy", &list);
+    char **files = list.paths;
+    int nfiles = list.count;
 
     if (nfiles == 0) {
         fprintf(stderr, "moxy: no .mxy files found\n");
@@ -1129,28 +3014,7 @@ static int cmd_check(int argc, char **argv) {
         if (display[0] == '.' && display[1] == '/') display += 2;
 
         /* transpile validates the full pipeline */
-        codegen_reset_includes();
-        char *raw = read_file(files[i]);
-        char *src = preprocess(raw, files[i]);
-        free(raw);
-
-        diag_init(src, files[i]);
-
-        Lexer lexer;
-        lexer_init(&lexer, src);
-
-        Token tokens[16384];
-        int ntokens = 0;
-        for (;;) {
-            tokens[ntokens] = lexer_next(&lexer);
-            if (tokens[ntokens].kind == TOK_EOF) { ntokens++; break; }
-            ntokens++;
-        }
-
-        Node *program = parse(tokens, ntokens);
-        codegen(program);
-
-        free(src);
+        transpile(files[i]);
 
         fprintf(stderr, "  ok %s\n", display);
         checked++;
@@ -1159,6 +3023,7 @@ static int cmd_check(int argc, char **argv) {
     fprintf(stderr, "\n  %d file%s checked, all ok\n", checked,
             checked == 1 ? "" : "s");
 
+    file_list_free(&list);
     return errors > 0 ? 1 : 0;
 }
 
@@ -1435,12 +3300,26 @@ static void print_usage(void) {
         "  <file.mxy>                 transpile to C on stdout\n"
         "  run <file.mxy> [args]      transpile, compile, and execute\n"
         "  build <file.mxy> [-o out]  transpile and compile to binary\n"
-        "  test [files...]            discover and run *_test.mxy files\n"
+        "                             (binaries are cached in $XDG_CACHE_HOME/moxy;\n"
+        "                             --pipe feeds the C to cc on stdin;\n"
+        "                             --pgo builds with a profile from a training run)\n"
+        "  test [-j N] [files...]     discover and run *_test.mxy files\n"
+        "                             (-j: tests at once, default: one per CPU)\n"
+        "  bench [files...]           discover and run *_bench.mxy benchmarks\n"
+        "                             (--json FILE writes results, --baseline FILE\n"
+        "                             fails on regressions over --threshold PCT;\n"
+        "                             --filter STR, --samples N, --warmup-ms MS,\n"
+        "                             --sample-ms MS)\n"
         "\n"
         "project:\n"
         "  new <name>                 create new project\n"
         "  init                       initialize project in current directory\n"
-        "  build [--release] [-p member]  build project or workspace member\n"
+        "  build [--release] [-p member] [-j N]  build project or workspace member\n"
+        "                             (-j: parallel jobs, default: one per CPU;\n"
+        "                             --shared-rt defines lists and maps once, in moxyrt.c;\n"
+        "                             --unity: one translation unit, --lto: release\n"
+        "                             build with -flto for every member, --pgo:\n"
+        "                             profile-guided build, see pgo.train)\n"
         "  run [--release] [-p member]    build and run project or member\n"
         "  clean                      remove build directory\n"
         "  install [--prefix PATH]    release build and install\n"
@@ -1454,38 +3333,20 @@ static void print_usage(void) {
         "  fmt [file.mxy] [--check]   format source files\n"
         "  lint [file.mxy]            lint source files for issues\n"
         "  check [file.mxy]           check syntax without compiling\n"
+        "\n"
+        "  --time-passes              before a command: time each compiler phase\n"
+        "                             and C compile, with allocations and peak RSS\n"
+        "                             (--time-passes-json FILE writes them as JSON)\n"
     );
 }
 
-int main(int argc, char **argv) {
-    if (argc < 2) {
-        print_usage();
-        return 1;
-    }
-
-    /* parse global flags */
-    for (int i = 1; i < argc; i++) {
-        if (strcmp(argv[i], "--enable-async") == 0) {
-            moxy_async_enabled = 1;
-            for (int j = i; j < argc - 1; j++) argv[j] = argv[j + 1];
-            argc--; i--;
-        } else if (strcmp(argv[i], "--enable-arc") == 0) {
-            moxy_arc_enabled = 1;
-            for (int j = i; j < argc - 1; j++) argv[j] = argv[j + 1];
-            argc--; i--;
-        }
-    }
-
-    if (argc < 2) {
-        print_usage();
-        return 1;
-    }
-
+static int run_command(int argc, char **argv) {
     const char *cmd = argv[1];
 
     if (strcmp(cmd, "run") == 0)     return cmd_run(argc, argv);
     if (strcmp(cmd, "build") == 0)   return cmd_build(argc, argv);
     if (strcmp(cmd, "test") == 0)    return cmd_test(argc, argv);
+    if (strcmp(cmd, "bench") == 0)   return cmd_bench(argc, argv);
     if (strcmp(cmd, "fmt") == 0)     return cmd_fmt(argc, argv);
     if (strcmp(cmd, "lint") == 0)    return cmd_lint(argc, argv);
     if (strcmp(cmd, "check") == 0)   return cmd_check(argc, argv);
@@ -1504,8 +3365,7 @@ int main(int argc, char **argv) {
 
     /* bare .mxy file → transpile to stdout */
     if (ends_with(cmd, ".mxy")) {
-        const char *c_code = transpile(cmd);
-        printf("%s", c_code);
+        transpile_into(cmd, NULL, stdout);
         return 0;
     }
 
@@ -1513,3 +3373,50 @@ int main(int argc, char **argv) {
     print_usage();
     return 1;
 }
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        print_usage();
+        return 1;
+    }
+
+    /* parse global flags */
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--enable-async") == 0) {
+            moxy_async_enabled = 1;
+            for (int j = i; j < argc - 1; j++) argv[j] = argv[j + 1];
+            argc--; i--;
+        } else if (strcmp(argv[i], "--enable-arc") == 0) {
+            moxy_arc_enabled = 1;
+            for (int j = i; j < argc - 1; j++) argv[j] = argv[j + 1];
+            argc--; i--;
+        } else if (strcmp(argv[i], "--pipe") == 0) {
+            pipe_cc = 1;
+            for (int j = i; j < argc - 1; j++) argv[j] = argv[j + 1];
+            argc--; i--;
+        } else if (strcmp(argv[i], "--shared-rt") == 0) {
+            shared_rt = 1;
+            for (int j = i; j < argc - 1; j++) argv[j] = argv[j + 1];
+            argc--; i--;
+        } else if (strcmp(argv[i], "--time-passes") == 0) {
+            time_passes = 1;
+            for (int j = i; j < argc - 1; j++) argv[j] = argv[j + 1];
+            argc--; i--;
+        } else if (strcmp(argv[i], "--time-passes-json") == 0 && i + 1 < argc) {
+            time_passes = 1;
+            time_passes_json = argv[i + 1];
+            for (int j = i; j < argc - 2; j++) argv[j] = argv[j + 2];
+            argc -= 2; i--;
+        }
+    }
+
+    if (argc < 2) {
+        print_usage();
+        return 1;
+    }
+
+    pass_start_ms = now_ms();
+    int rc = run_command(argc, argv);
+    if (pass_report() != 0 && rc == 0) rc = 1;
+    return rc;
+}
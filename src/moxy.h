@@ -0,0 +1,41 @@
+#ifndef MOXY_H
+#define MOXY_H
+
+/* libmoxy: the moxy transpiler as a library. Every call works on its own
+   state, so calls may run concurrently on different threads; nothing is
+   printed and errors never exit the process. */
+
+#include <stddef.h>
+
+typedef struct {
+    const char *path;     /* names the source in diagnostics and anchors
+                             relative #includes; NULL means the cwd */
+    int enable_async;     /* same as --enable-async */
+    int enable_arc;       /* same as --enable-arc */
+} MoxyOptions;
+
+typedef enum { MOXY_ERROR, MOXY_WARNING, MOXY_HINT } MoxyDiagKind;
+
+/* line and col are 1-based, and 0 for hints and for errors not tied to
+   the source (such as a missing include); a hint follows the error it
+   belongs to */
+typedef struct {
+    MoxyDiagKind kind;
+    int line, col, span;
+    char *message;
+} MoxyDiagnostic;
+
+typedef struct {
+    char *c_code;         /* NULL when transpiling failed */
+    size_t c_len;
+    MoxyDiagnostic *diags;
+    int ndiags;
+} MoxyResult;
+
+/* transpiles len bytes of moxy source; opts may be NULL. Returns 0 and
+   sets out->c_code on success, -1 on error. Either way out holds any
+   diagnostics and must be released with moxy_result_free. */
+int moxy_transpile(const char *src, size_t len, const MoxyOptions *opts, MoxyResult *out);
+void moxy_result_free(MoxyResult *r);
+
+#endif
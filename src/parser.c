@@ -1,84 +1,106 @@
 #include "parser.h"
 #include "diag.h"
 #include "flags.h"
+#include "intern.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-static Token *toks;
-static int pos;
-
-static char user_types[256][64];
-static int nuser_types;
+static _Thread_local const char *src;
+static _Thread_local Token *toks;
+static _Thread_local int pos;
+static _Thread_local Arena *arena;
 
 void parser_register_type(const char *name) {
-    if (nuser_types >= 256) return;
-    strncpy(user_types[nuser_types], name, 63);
-    user_types[nuser_types][63] = '\0';
-    nuser_types++;
+    intern_info(intern_cstr(name))->flags |= ATOM_USER_TYPE;
+}
+
+/* tokens are spans into src, not NUL-terminated strings */
+static int tok_is(const Token *t, const char *s) {
+    return (int)strlen(s) == t->len && memcmp(src + t->off, s, t->len) == 0;
+}
+
+static void tok_copy(char *dst, int size, const Token *t) {
+    int n = t->len < size - 1 ? t->len : size - 1;
+    memcpy(dst, src + t->off, n);
+    dst[n] = '\0';
+}
+
+/* identifiers are interned by the lexer; anything else is interned here */
+static int tok_atom(const Token *t) {
+    return t->atom ? t->atom : intern(src + t->off, t->len);
+}
+
+static void tok_cat(char *dst, int size, const Token *t) {
+    int dlen = (int)strlen(dst);
+    tok_copy(dst + dlen, size - dlen, t);
+}
+
+static void push_node(Node ***items, int *count, Node *n) {
+    *items = ast_grow(arena, *items, *count, sizeof(Node *));
+    (*items)[(*count)++] = n;
 }
 
-static int is_user_type(const char *name) {
-    for (int i = 0; i < nuser_types; i++)
-        if (strcmp(user_types[i], name) == 0) return 1;
-    return 0;
+static int is_user_type(const Token *t) {
+    return t->atom && (intern_info(t->atom)->flags & ATOM_USER_TYPE);
 }
 
-static Token peek(void) { return toks[pos]; }
+/* cursor: tokens are handed out by pointer into toks, never copied */
+static const Token *peek(void) { return &toks[pos]; }
 
-static Token eat(TokenKind kind) {
-    Token t = toks[pos];
-    if (t.kind != kind) {
-        diag_error_expected(t.line, t.col, kind, t.kind, t.text);
+static const Token *eat(TokenKind kind) {
+    const Token *t = &toks[pos];
+    if (t->kind != kind) {
+        diag_error_expected(t->line, t->col, kind, t->kind, t->len);
         diag_bail();
     }
     pos++;
     return t;
 }
 
-static Token advance(void) { return toks[pos++]; }
-
-static int is_known_type(Token t) {
-    return t.kind == TOK_STRING_KW || t.kind == TOK_INT_KW ||
-           t.kind == TOK_FLOAT_KW || t.kind == TOK_DOUBLE_KW ||
-           t.kind == TOK_CHAR_KW || t.kind == TOK_BOOL_KW ||
-           t.kind == TOK_LONG_KW || t.kind == TOK_SHORT_KW ||
-           t.kind == TOK_VOID_KW || t.kind == TOK_RESULT_KW ||
-           t.kind == TOK_FUTURE_KW ||
-           t.kind == TOK_MAP_KW ||
-           t.kind == TOK_STRUCT_KW || t.kind == TOK_UNION_KW ||
-           t.kind == TOK_UNSIGNED_KW || t.kind == TOK_SIGNED_KW ||
-           t.kind == TOK_CONST_KW || t.kind == TOK_STATIC_KW ||
-           t.kind == TOK_EXTERN_KW || t.kind == TOK_VOLATILE_KW ||
-           t.kind == TOK_REGISTER_KW || t.kind == TOK_INLINE_KW ||
-           t.kind == TOK_ENUM_KW ||
-           (t.kind == TOK_IDENT && is_user_type(t.text));
+static const Token *advance(void) { return &toks[pos++]; }
+
+static int is_known_type(const Token *t) {
+    return t->kind == TOK_STRING_KW || t->kind == TOK_INT_KW ||
+           t->kind == TOK_FLOAT_KW || t->kind == TOK_DOUBLE_KW ||
+           t->kind == TOK_CHAR_KW || t->kind == TOK_BOOL_KW ||
+           t->kind == TOK_LONG_KW || t->kind == TOK_SHORT_KW ||
+           t->kind == TOK_VOID_KW || t->kind == TOK_RESULT_KW ||
+           t->kind == TOK_FUTURE_KW ||
+           t->kind == TOK_MAP_KW ||
+           t->kind == TOK_STRUCT_KW || t->kind == TOK_UNION_KW ||
+           t->kind == TOK_UNSIGNED_KW || t->kind == TOK_SIGNED_KW ||
+           t->kind == TOK_CONST_KW || t->kind == TOK_STATIC_KW ||
+           t->kind == TOK_EXTERN_KW || t->kind == TOK_VOLATILE_KW ||
+           t->kind == TOK_REGISTER_KW || t->kind == TOK_INLINE_KW ||
+           t->kind == TOK_ENUM_KW ||
+           (t->kind == TOK_IDENT && is_user_type(t));
 }
 
-static int is_type_start(Token t) {
-    return is_known_type(t) || t.kind == TOK_IDENT;
+static int is_type_start(const Token *t) {
+    return is_known_type(t) || t->kind == TOK_IDENT;
 }
 
 static void parse_type(char *buf) {
     buf[0] = '\0';
 
     for (;;) {
-        Token t = peek();
-        if (t.kind == TOK_CONST_KW || t.kind == TOK_VOLATILE_KW ||
-            t.kind == TOK_STATIC_KW || t.kind == TOK_EXTERN_KW ||
-            t.kind == TOK_REGISTER_KW || t.kind == TOK_INLINE_KW) {
+        const Token *t = peek();
+        if (t->kind == TOK_CONST_KW || t->kind == TOK_VOLATILE_KW ||
+            t->kind == TOK_STATIC_KW || t->kind == TOK_EXTERN_KW ||
+            t->kind == TOK_REGISTER_KW || t->kind == TOK_INLINE_KW) {
             if (buf[0]) strcat(buf, " ");
-            strcat(buf, t.text);
+            tok_cat(buf, 64, t);
             advance();
         } else {
             break;
         }
     }
 
-    Token t = peek();
+    const Token *t = peek();
 
     /* Result<T> */
-    if (t.kind == TOK_RESULT_KW) {
+    if (t->kind == TOK_RESULT_KW) {
         advance();
         eat(TOK_LT);
         char inner[64];
@@ -92,9 +114,9 @@ static void parse_type(char *buf) {
     }
 
     /* Future<T> */
-    if (t.kind == TOK_FUTURE_KW) {
+    if (t->kind == TOK_FUTURE_KW) {
         if (!moxy_async_enabled) {
-            diag_error(t.line, t.col, "Future<T> requires --enable-async flag");
+            diag_error(t->line, t->col, "Future<T> requires --enable-async flag");
             diag_hint("run with: moxy --enable-async ...");
             diag_bail();
         }
@@ -111,7 +133,7 @@ static void parse_type(char *buf) {
     }
 
     /* map[K,V] */
-    if (t.kind == TOK_MAP_KW) {
+    if (t->kind == TOK_MAP_KW) {
         advance();
         eat(TOK_LBRACKET);
         char key[64];
@@ -127,57 +149,57 @@ static void parse_type(char *buf) {
         return;
     }
 
-    if (t.kind == TOK_STRUCT_KW || t.kind == TOK_UNION_KW || t.kind == TOK_ENUM_KW) {
+    if (t->kind == TOK_STRUCT_KW || t->kind == TOK_UNION_KW || t->kind == TOK_ENUM_KW) {
         advance();
         if (buf[0]) strcat(buf, " ");
-        strcat(buf, t.text);
-        if (peek().kind == TOK_IDENT) {
-            Token name = advance();
+        tok_cat(buf, 64, t);
+        if (peek()->kind == TOK_IDENT) {
+            const Token *name = advance();
             strcat(buf, " ");
-            strcat(buf, name.text);
+            tok_cat(buf, 64, name);
         }
-        while (peek().kind == TOK_STAR) {
+        while (peek()->kind == TOK_STAR) {
             advance();
             strcat(buf, "*");
         }
         return;
     }
 
-    if (t.kind == TOK_UNSIGNED_KW || t.kind == TOK_SIGNED_KW) {
+    if (t->kind == TOK_UNSIGNED_KW || t->kind == TOK_SIGNED_KW) {
         advance();
         if (buf[0]) strcat(buf, " ");
-        strcat(buf, t.text);
-        Token next = peek();
-        if (next.kind == TOK_INT_KW || next.kind == TOK_LONG_KW ||
-            next.kind == TOK_SHORT_KW || next.kind == TOK_CHAR_KW) {
+        tok_cat(buf, 64, t);
+        const Token *next = peek();
+        if (next->kind == TOK_INT_KW || next->kind == TOK_LONG_KW ||
+            next->kind == TOK_SHORT_KW || next->kind == TOK_CHAR_KW) {
             advance();
             strcat(buf, " ");
-            strcat(buf, next.text);
-            if ((next.kind == TOK_LONG_KW) && peek().kind == TOK_LONG_KW) {
-                Token ll = advance();
+            tok_cat(buf, 64, next);
+            if ((next->kind == TOK_LONG_KW) && peek()->kind == TOK_LONG_KW) {
+                const Token *ll = advance();
                 strcat(buf, " ");
-                strcat(buf, ll.text);
+                tok_cat(buf, 64, ll);
             }
         }
-        while (peek().kind == TOK_STAR) {
+        while (peek()->kind == TOK_STAR) {
             advance();
             strcat(buf, "*");
         }
         return;
     }
 
-    if (t.kind == TOK_LONG_KW) {
+    if (t->kind == TOK_LONG_KW) {
         advance();
         if (buf[0]) strcat(buf, " ");
-        strcat(buf, t.text);
-        Token next = peek();
-        if (next.kind == TOK_LONG_KW || next.kind == TOK_DOUBLE_KW ||
-            next.kind == TOK_INT_KW) {
+        tok_cat(buf, 64, t);
+        const Token *next = peek();
+        if (next->kind == TOK_LONG_KW || next->kind == TOK_DOUBLE_KW ||
+            next->kind == TOK_INT_KW) {
             advance();
             strcat(buf, " ");
-            strcat(buf, next.text);
+            tok_cat(buf, 64, next);
         }
-        while (peek().kind == TOK_STAR) {
+        while (peek()->kind == TOK_STAR) {
             advance();
             strcat(buf, "*");
         }
@@ -186,9 +208,9 @@ static void parse_type(char *buf) {
 
     advance();
     if (buf[0]) strcat(buf, " ");
-    strcat(buf, t.text);
+    tok_cat(buf, 64, t);
 
-    if (peek().kind == TOK_LBRACKET &&
+    if (peek()->kind == TOK_LBRACKET &&
         toks[pos + 1].kind == TOK_RBRACKET) {
         eat(TOK_LBRACKET);
         eat(TOK_RBRACKET);
@@ -198,7 +220,19 @@ static void parse_type(char *buf) {
         return;
     }
 
-    while (peek().kind == TOK_STAR) {
+    /* T[..], a slice */
+    if (peek()->kind == TOK_LBRACKET && toks[pos + 1].kind == TOK_DOTDOT &&
+        toks[pos + 2].kind == TOK_RBRACKET) {
+        eat(TOK_LBRACKET);
+        eat(TOK_DOTDOT);
+        eat(TOK_RBRACKET);
+        char base[64];
+        strcpy(base, buf);
+        snprintf(buf, 64, "%.59s[..]", base);
+        return;
+    }
+
+    while (peek()->kind == TOK_STAR) {
         advance();
         strcat(buf, "*");
     }
@@ -225,10 +259,10 @@ static int no_space_before(TokenKind k) {
 static Node *raw_from_range(int start, int end) {
     int sz = 0;
     for (int i = start; i < end; i++)
-        sz += (int)strlen(toks[i].text) + 2;
+        sz += toks[i].len + 3;
     sz += 1;
 
-    char *buf = malloc(sz);
+    char *buf = arena_alloc(arena, sz);
     int bpos = 0;
     for (int i = start; i < end; i++) {
         if (i > start) {
@@ -238,25 +272,26 @@ static Node *raw_from_range(int start, int end) {
                 buf[bpos++] = ' ';
             }
         }
-        int tlen = (int)strlen(toks[i].text);
+        int tlen = toks[i].len;
+        const char *text = src + toks[i].off;
         if (toks[i].kind == TOK_STRLIT) {
             buf[bpos++] = '"';
-            memcpy(buf + bpos, toks[i].text, tlen);
+            memcpy(buf + bpos, text, tlen);
             bpos += tlen;
             buf[bpos++] = '"';
         } else if (toks[i].kind == TOK_CHARLIT) {
             buf[bpos++] = '\'';
-            memcpy(buf + bpos, toks[i].text, tlen);
+            memcpy(buf + bpos, text, tlen);
             bpos += tlen;
             buf[bpos++] = '\'';
         } else {
-            memcpy(buf + bpos, toks[i].text, tlen);
+            memcpy(buf + bpos, text, tlen);
             bpos += tlen;
         }
     }
     buf[bpos] = '\0';
 
-    Node *n = node_new(NODE_RAW);
+    Node *n = node_new(arena, NODE_RAW);
     n->line = toks[start].line;
     n->col = toks[start].col;
     n->raw.text = buf;
@@ -327,30 +362,30 @@ static Node *collect_raw_stmt(void) {
     return raw_from_range(start, pos);
 }
 
-static int is_expr_start(Token t) {
-    return t.kind == TOK_IDENT || t.kind == TOK_LPAREN ||
-           t.kind == TOK_INTLIT || t.kind == TOK_FLOATLIT ||
-           t.kind == TOK_STRLIT || t.kind == TOK_CHARLIT ||
-           t.kind == TOK_TRUE_KW || t.kind == TOK_FALSE_KW ||
-           t.kind == TOK_NULL_KW || t.kind == TOK_OK_KW ||
-           t.kind == TOK_ERR_KW || t.kind == TOK_BANG ||
-           t.kind == TOK_MINUS || t.kind == TOK_LBRACKET ||
-           t.kind == TOK_LBRACE || t.kind == TOK_STAR ||
-           t.kind == TOK_AMP || t.kind == TOK_PLUSPLUS ||
-           t.kind == TOK_MINUSMINUS || t.kind == TOK_SIZEOF_KW ||
-           t.kind == TOK_TILDE || t.kind == TOK_AWAIT_KW;
+static int is_expr_start(const Token *t) {
+    return t->kind == TOK_IDENT || t->kind == TOK_LPAREN ||
+           t->kind == TOK_INTLIT || t->kind == TOK_FLOATLIT ||
+           t->kind == TOK_STRLIT || t->kind == TOK_CHARLIT ||
+           t->kind == TOK_TRUE_KW || t->kind == TOK_FALSE_KW ||
+           t->kind == TOK_NULL_KW || t->kind == TOK_OK_KW ||
+           t->kind == TOK_ERR_KW || t->kind == TOK_BANG ||
+           t->kind == TOK_MINUS || t->kind == TOK_LBRACKET ||
+           t->kind == TOK_LBRACE || t->kind == TOK_STAR ||
+           t->kind == TOK_AMP || t->kind == TOK_PLUSPLUS ||
+           t->kind == TOK_MINUSMINUS || t->kind == TOK_SIZEOF_KW ||
+           t->kind == TOK_TILDE || t->kind == TOK_AWAIT_KW;
 }
 
-static int is_c_type_keyword(Token t) {
-    return t.kind == TOK_INT_KW || t.kind == TOK_CHAR_KW ||
-           t.kind == TOK_FLOAT_KW || t.kind == TOK_DOUBLE_KW ||
-           t.kind == TOK_VOID_KW || t.kind == TOK_LONG_KW ||
-           t.kind == TOK_SHORT_KW || t.kind == TOK_BOOL_KW ||
-           t.kind == TOK_STRING_KW ||
-           t.kind == TOK_STRUCT_KW || t.kind == TOK_UNION_KW ||
-           t.kind == TOK_UNSIGNED_KW || t.kind == TOK_SIGNED_KW ||
-           t.kind == TOK_CONST_KW || t.kind == TOK_VOLATILE_KW ||
-           t.kind == TOK_ENUM_KW;
+static int is_c_type_keyword(const Token *t) {
+    return t->kind == TOK_INT_KW || t->kind == TOK_CHAR_KW ||
+           t->kind == TOK_FLOAT_KW || t->kind == TOK_DOUBLE_KW ||
+           t->kind == TOK_VOID_KW || t->kind == TOK_LONG_KW ||
+           t->kind == TOK_SHORT_KW || t->kind == TOK_BOOL_KW ||
+           t->kind == TOK_STRING_KW ||
+           t->kind == TOK_STRUCT_KW || t->kind == TOK_UNION_KW ||
+           t->kind == TOK_UNSIGNED_KW || t->kind == TOK_SIGNED_KW ||
+           t->kind == TOK_CONST_KW || t->kind == TOK_VOLATILE_KW ||
+           t->kind == TOK_ENUM_KW;
 }
 
 static int binop_prec(TokenKind k) {
@@ -403,14 +438,14 @@ static const char *binop_str(TokenKind k) {
 }
 
 static Node *parse_lambda_body(Node *n) {
-    if (peek().kind == TOK_LBRACE) {
+    if (peek()->kind == TOK_LBRACE) {
         advance();
-        Node *block = node_new(NODE_BLOCK);
-        block->line = peek().line;
-        block->col = peek().col;
+        Node *block = node_new(arena, NODE_BLOCK);
+        block->line = peek()->line;
+        block->col = peek()->col;
         block->block.nstmts = 0;
-        while (peek().kind != TOK_RBRACE)
-            block->block.stmts[block->block.nstmts++] = parse_stmt();
+        while (peek()->kind != TOK_RBRACE)
+            push_node(&block->block.stmts, &block->block.nstmts, parse_stmt());
         eat(TOK_RBRACE);
         n->lambda.body = block;
         n->lambda.is_expr = 0;
@@ -423,66 +458,66 @@ static Node *parse_lambda_body(Node *n) {
 
 static Node *try_parse_lambda(void) {
     int save = pos;
-    Token t = toks[pos];
+    const Token *t = &toks[pos];
     advance(); /* skip ( */
 
     /* () => ... */
-    if (peek().kind == TOK_RPAREN && toks[pos + 1].kind == TOK_FATARROW) {
+    if (peek()->kind == TOK_RPAREN && toks[pos + 1].kind == TOK_FATARROW) {
         advance(); /* skip ) */
         advance(); /* skip => */
-        Node *n = node_new(NODE_EXPR_LAMBDA);
-        n->line = t.line;
-        n->col = t.col;
+        Node *n = node_new(arena, NODE_EXPR_LAMBDA);
+        n->line = t->line;
+        n->col = t->col;
         n->lambda.nparams = 0;
         n->lambda.id = 0;
         return parse_lambda_body(n);
     }
 
     /* Try (type name [, type name]*) => ... */
-    Param params[16];
+    Param *params = NULL;
     int nparams = 0;
 
     while (1) {
         if (!is_type_start(peek())) { pos = save; return NULL; }
         char type[64];
         parse_type(type);
-        if (peek().kind != TOK_IDENT) { pos = save; return NULL; }
-        Token name = advance();
+        if (peek()->kind != TOK_IDENT) { pos = save; return NULL; }
+        const Token *name = advance();
+        params = ast_grow(arena, params, nparams, sizeof(Param));
         strcpy(params[nparams].type, type);
-        strcpy(params[nparams].name, name.text);
+        tok_copy(params[nparams].name, sizeof(params[nparams].name), name);
         nparams++;
 
-        if (peek().kind == TOK_COMMA) {
+        if (peek()->kind == TOK_COMMA) {
             advance();
             continue;
         }
         break;
     }
 
-    if (peek().kind != TOK_RPAREN) { pos = save; return NULL; }
+    if (peek()->kind != TOK_RPAREN) { pos = save; return NULL; }
     advance(); /* skip ) */
-    if (peek().kind != TOK_FATARROW) { pos = save; return NULL; }
+    if (peek()->kind != TOK_FATARROW) { pos = save; return NULL; }
     advance(); /* skip => */
 
-    Node *n = node_new(NODE_EXPR_LAMBDA);
-    n->line = t.line;
-    n->col = t.col;
+    Node *n = node_new(arena, NODE_EXPR_LAMBDA);
+    n->line = t->line;
+    n->col = t->col;
+    n->lambda.params = params;
     n->lambda.nparams = nparams;
     n->lambda.id = 0;
-    for (int i = 0; i < nparams; i++)
-        n->lambda.params[i] = params[i];
     return parse_lambda_body(n);
 }
 
 static Node *parse_primary(void) {
-    Token t = peek();
+    const Token *t = peek();
 
-    if (t.kind == TOK_LPAREN) {
+    if (t->kind == TOK_LPAREN) {
         /* Try lambda first */
         Node *lam = try_parse_lambda();
         if (lam) return lam;
 
-        if (is_c_type_keyword(toks[pos + 1])) {
+        if (is_c_type_keyword(&toks[pos + 1])) {
             int save = pos;
             advance();
             int tstart = pos;
@@ -495,7 +530,7 @@ static Node *parse_primary(void) {
             int tend = pos;
             if (toks[pos].kind == TOK_RPAREN) pos++;
 
-            if (is_expr_start(peek()) || peek().kind == TOK_LPAREN) {
+            if (is_expr_start(peek()) || peek()->kind == TOK_LPAREN) {
                 char tbuf[128] = {0};
                 for (int i = tstart; i < tend; i++) {
                     if (i > tstart) strcat(tbuf, " ");
@@ -504,12 +539,12 @@ static Node *parse_primary(void) {
                         if (len > 0 && tbuf[len-1] == ' ') tbuf[len-1] = '\0';
                         strcat(tbuf, "*");
                     } else {
-                        strcat(tbuf, toks[i].text);
+                        tok_cat(tbuf, sizeof(tbuf), &toks[i]);
                     }
                 }
-                Node *n = node_new(NODE_EXPR_CAST);
-                n->line = t.line;
-                n->col = t.col;
+                Node *n = node_new(arena, NODE_EXPR_CAST);
+                n->line = t->line;
+                n->col = t->col;
                 strcpy(n->cast.type_text, tbuf);
                 n->cast.operand = parse_primary();
                 return n;
@@ -519,113 +554,112 @@ static Node *parse_primary(void) {
         }
 
         advance();
-        Node *n = node_new(NODE_EXPR_PAREN);
-        n->line = t.line;
-        n->col = t.col;
+        Node *n = node_new(arena, NODE_EXPR_PAREN);
+        n->line = t->line;
+        n->col = t->col;
         n->paren.inner = parse_expr();
         eat(TOK_RPAREN);
         return n;
     }
 
-    if (t.kind == TOK_STRLIT) {
+    if (t->kind == TOK_STRLIT) {
         advance();
-        Node *n = node_new(NODE_EXPR_STRLIT);
-        n->line = t.line;
-        n->col = t.col;
-        strcpy(n->strlit.value, t.text);
+        Node *n = node_new(arena, NODE_EXPR_STRLIT);
+        n->line = t->line;
+        n->col = t->col;
+        n->strlit.value = arena_strndup(arena, src + t->off, t->len);
         return n;
     }
 
-    if (t.kind == TOK_INTLIT) {
+    if (t->kind == TOK_INTLIT) {
         advance();
-        Node *n = node_new(NODE_EXPR_INTLIT);
-        n->line = t.line;
-        n->col = t.col;
-        n->intlit.value = (int)strtol(t.text, NULL, 0);
-        strcpy(n->intlit.text, t.text);
+        Node *n = node_new(arena, NODE_EXPR_INTLIT);
+        n->line = t->line;
+        n->col = t->col;
+        tok_copy(n->intlit.text, sizeof(n->intlit.text), t);
+        n->intlit.value = (int)strtol(n->intlit.text, NULL, 0);
         return n;
     }
 
-    if (t.kind == TOK_FLOATLIT) {
+    if (t->kind == TOK_FLOATLIT) {
         advance();
-        Node *n = node_new(NODE_EXPR_FLOATLIT);
-        n->line = t.line;
-        n->col = t.col;
-        strcpy(n->floatlit.value, t.text);
+        Node *n = node_new(arena, NODE_EXPR_FLOATLIT);
+        n->line = t->line;
+        n->col = t->col;
+        tok_copy(n->floatlit.value, sizeof(n->floatlit.value), t);
         return n;
     }
 
-    if (t.kind == TOK_CHARLIT) {
+    if (t->kind == TOK_CHARLIT) {
         advance();
-        Node *n = node_new(NODE_EXPR_CHARLIT);
-        n->line = t.line;
-        n->col = t.col;
-        strncpy(n->charlit.value, t.text, 7);
-        n->charlit.value[7] = '\0';
+        Node *n = node_new(arena, NODE_EXPR_CHARLIT);
+        n->line = t->line;
+        n->col = t->col;
+        tok_copy(n->charlit.value, sizeof(n->charlit.value), t);
         return n;
     }
 
-    if (t.kind == TOK_TRUE_KW || t.kind == TOK_FALSE_KW) {
+    if (t->kind == TOK_TRUE_KW || t->kind == TOK_FALSE_KW) {
         advance();
-        Node *n = node_new(NODE_EXPR_BOOLLIT);
-        n->line = t.line;
-        n->col = t.col;
-        n->boollit.value = (t.kind == TOK_TRUE_KW) ? 1 : 0;
+        Node *n = node_new(arena, NODE_EXPR_BOOLLIT);
+        n->line = t->line;
+        n->col = t->col;
+        n->boollit.value = (t->kind == TOK_TRUE_KW) ? 1 : 0;
         return n;
     }
 
-    if (t.kind == TOK_NULL_KW) {
+    if (t->kind == TOK_NULL_KW) {
         advance();
-        Node *n = node_new(NODE_EXPR_NULL);
-        n->line = t.line;
-        n->col = t.col;
+        Node *n = node_new(arena, NODE_EXPR_NULL);
+        n->line = t->line;
+        n->col = t->col;
         return n;
     }
 
-    if (t.kind == TOK_OK_KW) {
+    if (t->kind == TOK_OK_KW) {
         advance();
         eat(TOK_LPAREN);
-        Node *n = node_new(NODE_EXPR_OK);
-        n->line = t.line;
-        n->col = t.col;
+        Node *n = node_new(arena, NODE_EXPR_OK);
+        n->line = t->line;
+        n->col = t->col;
         n->ok_expr.inner = parse_expr();
         eat(TOK_RPAREN);
         return n;
     }
 
-    if (t.kind == TOK_ERR_KW) {
+    if (t->kind == TOK_ERR_KW) {
         advance();
         eat(TOK_LPAREN);
-        Node *n = node_new(NODE_EXPR_ERR);
-        n->line = t.line;
-        n->col = t.col;
+        Node *n = node_new(arena, NODE_EXPR_ERR);
+        n->line = t->line;
+        n->col = t->col;
         n->err_expr.inner = parse_expr();
         eat(TOK_RPAREN);
         return n;
     }
 
-    if (t.kind == TOK_LBRACKET) {
+    if (t->kind == TOK_LBRACKET) {
         advance();
-        Node *n = node_new(NODE_EXPR_LIST_LIT);
-        n->line = t.line;
-        n->col = t.col;
+        Node *n = node_new(arena, NODE_EXPR_LIST_LIT);
+        n->line = t->line;
+        n->col = t->col;
         n->list_lit.nitems = 0;
-        while (peek().kind != TOK_RBRACKET) {
-            n->list_lit.items[n->list_lit.nitems++] = parse_expr();
-            if (peek().kind == TOK_COMMA) eat(TOK_COMMA);
+        while (peek()->kind != TOK_RBRACKET) {
+            push_node(&n->list_lit.items, &n->list_lit.nitems, parse_expr());
+            if (peek()->kind == TOK_COMMA) eat(TOK_COMMA);
         }
         eat(TOK_RBRACKET);
         return n;
     }
 
-    if (t.kind == TOK_LBRACE) {
+    if (t->kind == TOK_LBRACE) {
         int start = pos;
         advance();
-        if (peek().kind == TOK_RBRACE) {
+        if (peek()->kind == TOK_RBRACE) {
             advance();
-            Node *ne = node_new(NODE_EXPR_EMPTY);
-            ne->line = t.line;
-            ne->col = t.col;
+            Node *ne = node_new(arena, NODE_EXPR_EMPTY);
+            ne->line = t->line;
+            ne->col = t->col;
             return ne;
         }
         int depth = 1;
@@ -638,10 +672,10 @@ static Node *parse_primary(void) {
         return raw_from_range(start, pos);
     }
 
-    if (t.kind == TOK_SIZEOF_KW) {
+    if (t->kind == TOK_SIZEOF_KW) {
         int start = pos;
         advance();
-        if (peek().kind == TOK_LPAREN) {
+        if (peek()->kind == TOK_LPAREN) {
             advance();
             int depth = 1;
             while (toks[pos].kind != TOK_EOF && depth > 0) {
@@ -654,113 +688,115 @@ static Node *parse_primary(void) {
         return raw_from_range(start, pos);
     }
 
-    if (t.kind == TOK_BANG || t.kind == TOK_MINUS || t.kind == TOK_TILDE ||
-        t.kind == TOK_AMP || t.kind == TOK_STAR) {
+    if (t->kind == TOK_BANG || t->kind == TOK_MINUS || t->kind == TOK_TILDE ||
+        t->kind == TOK_AMP || t->kind == TOK_STAR) {
         advance();
-        Node *n = node_new(NODE_EXPR_UNARY);
-        n->line = t.line;
-        n->col = t.col;
-        strcpy(n->unary.op, t.text);
-        n->unary.operand = parse_primary();
+        Node *n = node_new(arena, NODE_EXPR_UNARY);
+        n->line = t->line;
+        n->col = t->col;
+        tok_copy(n->unary.op, sizeof(n->unary.op), t);
+        n->unary.operand = parse_postfix();
         return n;
     }
 
-    if (t.kind == TOK_PLUSPLUS || t.kind == TOK_MINUSMINUS) {
+    if (t->kind == TOK_PLUSPLUS || t->kind == TOK_MINUSMINUS) {
         advance();
-        Node *n = node_new(NODE_EXPR_UNARY);
-        n->line = t.line;
-        n->col = t.col;
-        strcpy(n->unary.op, t.text);
-        n->unary.operand = parse_primary();
+        Node *n = node_new(arena, NODE_EXPR_UNARY);
+        n->line = t->line;
+        n->col = t->col;
+        tok_copy(n->unary.op, sizeof(n->unary.op), t);
+        n->unary.operand = parse_postfix();
         return n;
     }
 
-    if (t.kind == TOK_AWAIT_KW) {
+    if (t->kind == TOK_AWAIT_KW) {
         if (!moxy_async_enabled) {
-            diag_error(t.line, t.col, "'await' requires --enable-async flag");
+            diag_error(t->line, t->col, "'await' requires --enable-async flag");
             diag_hint("run with: moxy --enable-async ...");
             diag_bail();
         }
         advance();
-        Node *n = node_new(NODE_EXPR_AWAIT);
-        n->line = t.line;
-        n->col = t.col;
+        Node *n = node_new(arena, NODE_EXPR_AWAIT);
+        n->line = t->line;
+        n->col = t->col;
         n->await_expr.inner = parse_postfix();
         return n;
     }
 
-    if (t.kind == TOK_IDENT) {
-        Token name = advance();
+    if (t->kind == TOK_IDENT) {
+        const Token *name = advance();
 
-        if (peek().kind == TOK_COLONCOLON) {
+        if (peek()->kind == TOK_COLONCOLON) {
             eat(TOK_COLONCOLON);
-            Token variant = eat(TOK_IDENT);
+            const Token *variant = eat(TOK_IDENT);
 
-            Node *n = node_new(NODE_EXPR_ENUM_INIT);
-            n->line = name.line;
-            n->col = name.col;
-            strcpy(n->enum_init.ename, name.text);
-            strcpy(n->enum_init.vname, variant.text);
+            Node *n = node_new(arena, NODE_EXPR_ENUM_INIT);
+            n->line = name->line;
+            n->col = name->col;
+            tok_copy(n->enum_init.ename, sizeof(n->enum_init.ename), name);
+            tok_copy(n->enum_init.vname, sizeof(n->enum_init.vname), variant);
             n->enum_init.nargs = 0;
 
-            if (peek().kind == TOK_LPAREN) {
+            if (peek()->kind == TOK_LPAREN) {
                 eat(TOK_LPAREN);
-                while (peek().kind != TOK_RPAREN) {
-                    n->enum_init.args[n->enum_init.nargs++] = parse_expr();
-                    if (peek().kind == TOK_COMMA) eat(TOK_COMMA);
+                while (peek()->kind != TOK_RPAREN) {
+                    push_node(&n->enum_init.args, &n->enum_init.nargs, parse_expr());
+                    if (peek()->kind == TOK_COMMA) eat(TOK_COMMA);
                 }
                 eat(TOK_RPAREN);
             }
             return n;
         }
 
-        if (peek().kind == TOK_LPAREN && strcmp(name.text, "print") != 0 &&
-            strcmp(name.text, "assert") != 0) {
+        if (peek()->kind == TOK_LPAREN && !tok_is(name, "print") &&
+            !tok_is(name, "assert")) {
             eat(TOK_LPAREN);
-            Node *n = node_new(NODE_EXPR_CALL);
-            n->line = name.line;
-            n->col = name.col;
-            strcpy(n->call.name, name.text);
+            Node *n = node_new(arena, NODE_EXPR_CALL);
+            n->line = name->line;
+            n->col = name->col;
+            tok_copy(n->call.name, sizeof(n->call.name), name);
+            n->call.atom = tok_atom(name);
             n->call.nargs = 0;
-            while (peek().kind != TOK_RPAREN) {
-                n->call.args[n->call.nargs++] = parse_expr();
-                if (peek().kind == TOK_COMMA) eat(TOK_COMMA);
+            while (peek()->kind != TOK_RPAREN) {
+                push_node(&n->call.args, &n->call.nargs, parse_expr());
+                if (peek()->kind == TOK_COMMA) eat(TOK_COMMA);
             }
             eat(TOK_RPAREN);
             return n;
         }
 
-        Node *n = node_new(NODE_EXPR_IDENT);
-        n->line = name.line;
-        n->col = name.col;
-        strcpy(n->ident.name, name.text);
+        Node *n = node_new(arena, NODE_EXPR_IDENT);
+        n->line = name->line;
+        n->col = name->col;
+        tok_copy(n->ident.name, sizeof(n->ident.name), name);
+        n->ident.atom = tok_atom(name);
         return n;
     }
 
     {
         char msg[256];
-        snprintf(msg, sizeof(msg), "unexpected %s in expression", tok_name(t.kind));
-        diag_error(t.line, t.col, msg);
+        snprintf(msg, sizeof(msg), "unexpected %s in expression", tok_name(t->kind));
+        diag_error(t->line, t->col, msg);
 
         /* suggest fixes for common mistakes */
-        if (t.kind == TOK_IDENT) {
-            if (strcmp(t.text, "str") == 0)
+        if (t->kind == TOK_IDENT) {
+            if (tok_is(t, "str"))
                 diag_hint("did you mean 'string'?");
-            else if (strcmp(t.text, "boolean") == 0)
+            else if (tok_is(t, "boolean"))
                 diag_hint("did you mean 'bool'?");
-            else if (strcmp(t.text, "integer") == 0)
+            else if (tok_is(t, "integer"))
                 diag_hint("did you mean 'int'?");
-            else if (strcmp(t.text, "println") == 0)
+            else if (tok_is(t, "println"))
                 diag_hint("did you mean 'print'?");
-            else if (strcmp(t.text, "fn") == 0 || strcmp(t.text, "func") == 0 ||
-                     strcmp(t.text, "function") == 0)
+            else if (tok_is(t, "fn") || tok_is(t, "func") ||
+                     tok_is(t, "function"))
                 diag_hint("moxy uses C-style function syntax: int add(int a, int b) { ... }");
-            else if (strcmp(t.text, "let") == 0 || strcmp(t.text, "var") == 0 ||
-                     strcmp(t.text, "val") == 0)
+            else if (tok_is(t, "let") || tok_is(t, "var") ||
+                     tok_is(t, "val"))
                 diag_hint("moxy uses C-style declarations: int x = 42;");
-        } else if (t.kind == TOK_FATARROW) {
+        } else if (t->kind == TOK_FATARROW) {
             diag_hint("'=>' is used in match arms and lambda expressions");
-        } else if (t.kind == TOK_EOF) {
+        } else if (t->kind == TOK_EOF) {
             diag_hint("unexpected end of file — check for missing '}'");
         }
 
@@ -768,93 +804,110 @@ static Node *parse_primary(void) {
     }
 }
 
+/* the inside of x[...]: an index, or a range a..b where either bound
+   may be left out (NULL) to slice from the start or to the end */
+static Node *parse_slice_bounds(const Token *lbt) {
+    Node *start = NULL;
+    if (peek()->kind != TOK_DOTDOT) {
+        start = parse_expr();
+        if (peek()->kind != TOK_DOTDOT) return start;
+    }
+    eat(TOK_DOTDOT);
+    Node *range = node_new(arena, NODE_EXPR_RANGE);
+    range->line = lbt->line;
+    range->col = lbt->col;
+    range->range.start = start;
+    range->range.end = peek()->kind == TOK_RBRACKET ? NULL : parse_expr();
+    return range;
+}
+
 static Node *parse_postfix(void) {
     Node *left = parse_primary();
 
     for (;;) {
-        if (peek().kind == TOK_DOT) {
+        if (peek()->kind == TOK_DOT) {
             eat(TOK_DOT);
-            Token name = eat(TOK_IDENT);
+            const Token *name = eat(TOK_IDENT);
 
-            if (peek().kind == TOK_LPAREN) {
+            if (peek()->kind == TOK_LPAREN) {
                 eat(TOK_LPAREN);
-                Node *n = node_new(NODE_EXPR_METHOD);
-                n->line = name.line;
-                n->col = name.col;
+                Node *n = node_new(arena, NODE_EXPR_METHOD);
+                n->line = name->line;
+                n->col = name->col;
                 n->method.target = left;
-                strcpy(n->method.name, name.text);
+                tok_copy(n->method.name, sizeof(n->method.name), name);
                 n->method.nargs = 0;
                 n->method.is_arrow = 0;
-                while (peek().kind != TOK_RPAREN) {
-                    n->method.args[n->method.nargs++] = parse_expr();
-                    if (peek().kind == TOK_COMMA) eat(TOK_COMMA);
+                while (peek()->kind != TOK_RPAREN) {
+                    push_node(&n->method.args, &n->method.nargs, parse_expr());
+                    if (peek()->kind == TOK_COMMA) eat(TOK_COMMA);
                 }
                 eat(TOK_RPAREN);
                 left = n;
                 continue;
             }
 
-            Node *n = node_new(NODE_EXPR_FIELD);
-            n->line = name.line;
-            n->col = name.col;
+            Node *n = node_new(arena, NODE_EXPR_FIELD);
+            n->line = name->line;
+            n->col = name->col;
             n->field.target = left;
-            strcpy(n->field.name, name.text);
+            tok_copy(n->field.name, sizeof(n->field.name), name);
             n->field.is_arrow = 0;
             left = n;
             continue;
         }
 
-        if (peek().kind == TOK_ARROW) {
+        if (peek()->kind == TOK_ARROW) {
             eat(TOK_ARROW);
-            Token name = eat(TOK_IDENT);
+            const Token *name = eat(TOK_IDENT);
 
-            if (peek().kind == TOK_LPAREN) {
+            if (peek()->kind == TOK_LPAREN) {
                 eat(TOK_LPAREN);
-                Node *n = node_new(NODE_EXPR_METHOD);
-                n->line = name.line;
-                n->col = name.col;
+                Node *n = node_new(arena, NODE_EXPR_METHOD);
+                n->line = name->line;
+                n->col = name->col;
                 n->method.target = left;
-                strcpy(n->method.name, name.text);
+                tok_copy(n->method.name, sizeof(n->method.name), name);
                 n->method.nargs = 0;
                 n->method.is_arrow = 1;
-                while (peek().kind != TOK_RPAREN) {
-                    n->method.args[n->method.nargs++] = parse_expr();
-                    if (peek().kind == TOK_COMMA) eat(TOK_COMMA);
+                while (peek()->kind != TOK_RPAREN) {
+                    push_node(&n->method.args, &n->method.nargs, parse_expr());
+                    if (peek()->kind == TOK_COMMA) eat(TOK_COMMA);
                 }
                 eat(TOK_RPAREN);
                 left = n;
                 continue;
             }
 
-            Node *n = node_new(NODE_EXPR_FIELD);
-            n->line = name.line;
-            n->col = name.col;
+            Node *n = node_new(arena, NODE_EXPR_FIELD);
+            n->line = name->line;
+            n->col = name->col;
             n->field.target = left;
-            strcpy(n->field.name, name.text);
+            tok_copy(n->field.name, sizeof(n->field.name), name);
             n->field.is_arrow = 1;
             left = n;
             continue;
         }
 
-        if (peek().kind == TOK_LBRACKET) {
-            Token lbt = peek();
+        if (peek()->kind == TOK_LBRACKET) {
+            const Token *lbt = peek();
             eat(TOK_LBRACKET);
-            Node *n = node_new(NODE_EXPR_INDEX);
-            n->line = lbt.line;
-            n->col = lbt.col;
+            Node *n = node_new(arena, NODE_EXPR_INDEX);
+            n->line = lbt->line;
+            n->col = lbt->col;
             n->index.target = left;
-            n->index.idx = parse_expr();
+            n->index.idx = parse_slice_bounds(lbt);
             eat(TOK_RBRACKET);
             left = n;
             continue;
         }
 
-        if (peek().kind == TOK_PLUSPLUS || peek().kind == TOK_MINUSMINUS) {
-            Token op = advance();
-            Node *n = node_new(NODE_EXPR_UNARY);
-            n->line = op.line;
-            n->col = op.col;
-            strcpy(n->unary.op, op.kind == TOK_PLUSPLUS ? "p++" : "p--");
+        if (peek()->kind == TOK_PLUSPLUS || peek()->kind == TOK_MINUSMINUS) {
+            const Token *op = advance();
+            Node *n = node_new(arena, NODE_EXPR_UNARY);
+            n->line = op->line;
+            n->col = op->col;
+            strcpy(n->unary.op, op->kind == TOK_PLUSPLUS ? "p++" : "p--");
             n->unary.operand = left;
             left = n;
             continue;
@@ -870,55 +923,55 @@ static Node *parse_expr_prec(int min_prec) {
     Node *left = parse_postfix();
 
     for (;;) {
-        int prec = binop_prec(peek().kind);
+        int prec = binop_prec(peek()->kind);
         if (prec < min_prec) break;
 
-        if (peek().kind == TOK_PIPEARROW) {
-            Token pt = advance();
+        if (peek()->kind == TOK_PIPEARROW) {
+            const Token *pt = advance();
             Node *right = parse_postfix();
 
             if (right->kind == NODE_EXPR_CALL) {
-                for (int i = right->call.nargs; i > 0; i--)
-                    right->call.args[i] = right->call.args[i - 1];
+                right->call.args = ast_grow(arena, right->call.args, right->call.nargs, sizeof(Node *));
+                memmove(right->call.args + 1, right->call.args, right->call.nargs * sizeof(Node *));
                 right->call.args[0] = left;
                 right->call.nargs++;
                 left = right;
             } else if (right->kind == NODE_EXPR_METHOD) {
-                for (int i = right->method.nargs; i > 0; i--)
-                    right->method.args[i] = right->method.args[i - 1];
+                right->method.args = ast_grow(arena, right->method.args, right->method.nargs, sizeof(Node *));
+                memmove(right->method.args + 1, right->method.args, right->method.nargs * sizeof(Node *));
                 right->method.args[0] = left;
                 right->method.nargs++;
                 left = right;
             } else if (right->kind == NODE_EXPR_IDENT) {
                 if (strcmp(right->ident.name, "print") == 0) {
-                    if (peek().kind == TOK_LPAREN) {
+                    if (peek()->kind == TOK_LPAREN) {
                         eat(TOK_LPAREN);
-                        if (peek().kind != TOK_RPAREN) {
+                        if (peek()->kind != TOK_RPAREN) {
                             /* ignore extra args for print pipe */
-                            while (peek().kind != TOK_RPAREN) {
+                            while (peek()->kind != TOK_RPAREN) {
                                 parse_expr();
-                                if (peek().kind == TOK_COMMA) eat(TOK_COMMA);
+                                if (peek()->kind == TOK_COMMA) eat(TOK_COMMA);
                             }
                         }
                         eat(TOK_RPAREN);
                     }
-                    Node *n = node_new(NODE_PRINT_STMT);
-                    n->line = pt.line;
-                    n->col = pt.col;
+                    Node *n = node_new(arena, NODE_PRINT_STMT);
+                    n->line = pt->line;
+                    n->col = pt->col;
                     n->print_stmt.arg = left;
                     left = n;
                 } else {
-                    Node *n = node_new(NODE_EXPR_CALL);
-                    n->line = pt.line;
-                    n->col = pt.col;
+                    Node *n = node_new(arena, NODE_EXPR_CALL);
+                    n->line = pt->line;
+                    n->col = pt->col;
                     strcpy(n->call.name, right->ident.name);
-                    n->call.args[0] = left;
-                    n->call.nargs = 1;
-                    if (peek().kind == TOK_LPAREN) {
+                    n->call.atom = right->ident.atom;
+                    push_node(&n->call.args, &n->call.nargs, left);
+                    if (peek()->kind == TOK_LPAREN) {
                         eat(TOK_LPAREN);
-                        while (peek().kind != TOK_RPAREN) {
-                            n->call.args[n->call.nargs++] = parse_expr();
-                            if (peek().kind == TOK_COMMA) eat(TOK_COMMA);
+                        while (peek()->kind != TOK_RPAREN) {
+                            push_node(&n->call.args, &n->call.nargs, parse_expr());
+                            if (peek()->kind == TOK_COMMA) eat(TOK_COMMA);
                         }
                         eat(TOK_RPAREN);
                     }
@@ -927,35 +980,35 @@ static Node *parse_expr_prec(int min_prec) {
             } else {
                 char msg[128];
                 snprintf(msg, sizeof(msg), "expected function call after '|>'");
-                diag_error(pt.line, pt.col, msg);
+                diag_error(pt->line, pt->col, msg);
                 diag_hint("pipe operator requires a function call on the right side");
                 diag_bail();
             }
             continue;
         }
 
-        Token op = advance();
+        const Token *op = advance();
         Node *right = parse_expr_prec(prec + 1);
 
-        Node *n = node_new(NODE_EXPR_BINOP);
-        n->line = op.line;
-        n->col = op.col;
-        strcpy(n->binop.op, binop_str(op.kind));
+        Node *n = node_new(arena, NODE_EXPR_BINOP);
+        n->line = op->line;
+        n->col = op->col;
+        strcpy(n->binop.op, binop_str(op->kind));
         n->binop.left = left;
         n->binop.right = right;
         left = n;
     }
 
-    if (peek().kind == TOK_QUESTION) {
-        Token qt = peek();
+    if (peek()->kind == TOK_QUESTION) {
+        const Token *qt = peek();
         advance();
         Node *then_expr = parse_expr();
         eat(TOK_COLON);
         Node *else_expr = parse_expr_prec(1);
 
-        Node *n = node_new(NODE_EXPR_TERNARY);
-        n->line = qt.line;
-        n->col = qt.col;
+        Node *n = node_new(arena, NODE_EXPR_TERNARY);
+        n->line = qt->line;
+        n->col = qt->col;
         n->ternary.cond = left;
         n->ternary.then_expr = then_expr;
         n->ternary.else_expr = else_expr;
@@ -970,57 +1023,58 @@ static Node *parse_expr(void) {
 }
 
 static Node *parse_print(void) {
-    Token pt = peek();
+    const Token *pt = peek();
     eat(TOK_IDENT);
     eat(TOK_LPAREN);
-    Node *n = node_new(NODE_PRINT_STMT);
-    n->line = pt.line;
-    n->col = pt.col;
+    Node *n = node_new(arena, NODE_PRINT_STMT);
+    n->line = pt->line;
+    n->col = pt->col;
     n->print_stmt.arg = parse_expr();
     eat(TOK_RPAREN);
-    if (peek().kind == TOK_SEMI) eat(TOK_SEMI);
+    if (peek()->kind == TOK_SEMI) eat(TOK_SEMI);
     return n;
 }
 
 static Node *parse_match(void) {
-    Token mt = peek();
+    const Token *mt = peek();
     eat(TOK_MATCH_KW);
-    Token target = eat(TOK_IDENT);
+    const Token *target = eat(TOK_IDENT);
     eat(TOK_LBRACE);
 
-    Node *n = node_new(NODE_MATCH_STMT);
-    n->line = mt.line;
-    n->col = mt.col;
-    strcpy(n->match_stmt.target, target.text);
+    Node *n = node_new(arena, NODE_MATCH_STMT);
+    n->line = mt->line;
+    n->col = mt->col;
+    tok_copy(n->match_stmt.target, sizeof(n->match_stmt.target), target);
     n->match_stmt.narms = 0;
 
-    while (peek().kind != TOK_RBRACE) {
+    while (peek()->kind != TOK_RBRACE) {
+        n->match_stmt.arms = ast_grow(arena, n->match_stmt.arms, n->match_stmt.narms, sizeof(MatchArm));
         MatchArm *arm = &n->match_stmt.arms[n->match_stmt.narms++];
         arm->pattern.binding[0] = '\0';
 
-        if (peek().kind == TOK_OK_KW || peek().kind == TOK_ERR_KW) {
-            Token kw = advance();
+        if (peek()->kind == TOK_OK_KW || peek()->kind == TOK_ERR_KW) {
+            const Token *kw = advance();
             arm->pattern.enum_name[0] = '\0';
-            strcpy(arm->pattern.variant, kw.text);
+            tok_copy(arm->pattern.variant, sizeof(arm->pattern.variant), kw);
 
-            if (peek().kind == TOK_LPAREN) {
+            if (peek()->kind == TOK_LPAREN) {
                 eat(TOK_LPAREN);
-                Token binding = eat(TOK_IDENT);
-                strcpy(arm->pattern.binding, binding.text);
+                const Token *binding = eat(TOK_IDENT);
+                tok_copy(arm->pattern.binding, sizeof(arm->pattern.binding), binding);
                 eat(TOK_RPAREN);
             }
         } else {
-            Token ename = eat(TOK_IDENT);
+            const Token *ename = eat(TOK_IDENT);
             eat(TOK_COLONCOLON);
-            Token vname = eat(TOK_IDENT);
+            const Token *vname = eat(TOK_IDENT);
 
-            strcpy(arm->pattern.enum_name, ename.text);
-            strcpy(arm->pattern.variant, vname.text);
+            tok_copy(arm->pattern.enum_name, sizeof(arm->pattern.enum_name), ename);
+            tok_copy(arm->pattern.variant, sizeof(arm->pattern.variant), vname);
 
-            if (peek().kind == TOK_LPAREN) {
+            if (peek()->kind == TOK_LPAREN) {
                 eat(TOK_LPAREN);
-                Token binding = eat(TOK_IDENT);
-                strcpy(arm->pattern.binding, binding.text);
+                const Token *binding = eat(TOK_IDENT);
+                tok_copy(arm->pattern.binding, sizeof(arm->pattern.binding), binding);
                 eat(TOK_RPAREN);
             }
         }
@@ -1028,7 +1082,7 @@ static Node *parse_match(void) {
         eat(TOK_FATARROW);
         arm->body = parse_stmt();
 
-        if (peek().kind == TOK_COMMA) eat(TOK_COMMA);
+        if (peek()->kind == TOK_COMMA) eat(TOK_COMMA);
     }
 
     eat(TOK_RBRACE);
@@ -1036,27 +1090,26 @@ static Node *parse_match(void) {
 }
 
 static Node *parse_if_stmt(void) {
-    Token ift = peek();
+    const Token *ift = peek();
     eat(TOK_IF_KW);
     eat(TOK_LPAREN);
-    Node *n = node_new(NODE_IF_STMT);
-    n->line = ift.line;
-    n->col = ift.col;
+    Node *n = node_new(arena, NODE_IF_STMT);
+    n->line = ift->line;
+    n->col = ift->col;
     n->if_stmt.cond = parse_expr();
     eat(TOK_RPAREN);
 
-    Node *then_block = node_new(NODE_BLOCK);
-    then_block->line = ift.line;
-    then_block->col = ift.col;
-    if (peek().kind == TOK_LBRACE) {
+    Node *then_block = node_new(arena, NODE_BLOCK);
+    then_block->line = ift->line;
+    then_block->col = ift->col;
+    if (peek()->kind == TOK_LBRACE) {
         eat(TOK_LBRACE);
         then_block->block.nstmts = 0;
-        while (peek().kind != TOK_RBRACE)
-            then_block->block.stmts[then_block->block.nstmts++] = parse_stmt();
+        while (peek()->kind != TOK_RBRACE)
+            push_node(&then_block->block.stmts, &then_block->block.nstmts, parse_stmt());
         eat(TOK_RBRACE);
     } else {
-        then_block->block.nstmts = 1;
-        then_block->block.stmts[0] = parse_stmt();
+        push_node(&then_block->block.stmts, &then_block->block.nstmts, parse_stmt());
     }
     n->if_stmt.then_body = then_block;
     n->if_stmt.nthen = then_block->block.nstmts;
@@ -1064,33 +1117,31 @@ static Node *parse_if_stmt(void) {
     n->if_stmt.else_body = NULL;
     n->if_stmt.nelse = 0;
 
-    if (peek().kind == TOK_ELSE_KW) {
+    if (peek()->kind == TOK_ELSE_KW) {
         eat(TOK_ELSE_KW);
-        if (peek().kind == TOK_IF_KW) {
-            Node *else_block = node_new(NODE_BLOCK);
-            else_block->line = peek().line;
-            else_block->col = peek().col;
-            else_block->block.nstmts = 1;
-            else_block->block.stmts[0] = parse_if_stmt();
+        if (peek()->kind == TOK_IF_KW) {
+            Node *else_block = node_new(arena, NODE_BLOCK);
+            else_block->line = peek()->line;
+            else_block->col = peek()->col;
+            push_node(&else_block->block.stmts, &else_block->block.nstmts, parse_if_stmt());
             n->if_stmt.else_body = else_block;
             n->if_stmt.nelse = 1;
-        } else if (peek().kind == TOK_LBRACE) {
-            Node *else_block = node_new(NODE_BLOCK);
-            else_block->line = peek().line;
-            else_block->col = peek().col;
+        } else if (peek()->kind == TOK_LBRACE) {
+            Node *else_block = node_new(arena, NODE_BLOCK);
+            else_block->line = peek()->line;
+            else_block->col = peek()->col;
             eat(TOK_LBRACE);
             else_block->block.nstmts = 0;
-            while (peek().kind != TOK_RBRACE)
-                else_block->block.stmts[else_block->block.nstmts++] = parse_stmt();
+            while (peek()->kind != TOK_RBRACE)
+                push_node(&else_block->block.stmts, &else_block->block.nstmts, parse_stmt());
             eat(TOK_RBRACE);
             n->if_stmt.else_body = else_block;
             n->if_stmt.nelse = else_block->block.nstmts;
         } else {
-            Node *else_block = node_new(NODE_BLOCK);
-            else_block->line = peek().line;
-            else_block->col = peek().col;
-            else_block->block.nstmts = 1;
-            else_block->block.stmts[0] = parse_stmt();
+            Node *else_block = node_new(arena, NODE_BLOCK);
+            else_block->line = peek()->line;
+            else_block->col = peek()->col;
+            push_node(&else_block->block.stmts, &else_block->block.nstmts, parse_stmt());
             n->if_stmt.else_body = else_block;
             n->if_stmt.nelse = 1;
         }
@@ -1100,18 +1151,18 @@ static Node *parse_if_stmt(void) {
 }
 
 static Node *parse_while_stmt(void) {
-    Token wt = peek();
+    const Token *wt = peek();
     eat(TOK_WHILE_KW);
     eat(TOK_LPAREN);
-    Node *n = node_new(NODE_WHILE_STMT);
-    n->line = wt.line;
-    n->col = wt.col;
+    Node *n = node_new(arena, NODE_WHILE_STMT);
+    n->line = wt->line;
+    n->col = wt->col;
     n->while_stmt.cond = parse_expr();
     eat(TOK_RPAREN);
     eat(TOK_LBRACE);
     n->while_stmt.nbody = 0;
-    while (peek().kind != TOK_RBRACE)
-        n->while_stmt.body[n->while_stmt.nbody++] = parse_stmt();
+    while (peek()->kind != TOK_RBRACE)
+        push_node(&n->while_stmt.body, &n->while_stmt.nbody, parse_stmt());
     eat(TOK_RBRACE);
     return n;
 }
@@ -1141,25 +1192,25 @@ static void assign_op_str(TokenKind k, char *buf) {
 }
 
 static Node *parse_for_in_stmt(void) {
-    Token var1 = eat(TOK_IDENT);
-    Node *n = node_new(NODE_FOR_IN_STMT);
-    n->line = var1.line;
-    n->col = var1.col;
-    strcpy(n->for_in_stmt.var1, var1.text);
+    const Token *var1 = eat(TOK_IDENT);
+    Node *n = node_new(arena, NODE_FOR_IN_STMT);
+    n->line = var1->line;
+    n->col = var1->col;
+    tok_copy(n->for_in_stmt.var1, sizeof(n->for_in_stmt.var1), var1);
     n->for_in_stmt.var2[0] = '\0';
 
-    if (peek().kind == TOK_COMMA) {
+    if (peek()->kind == TOK_COMMA) {
         eat(TOK_COMMA);
-        Token var2 = eat(TOK_IDENT);
-        strcpy(n->for_in_stmt.var2, var2.text);
+        const Token *var2 = eat(TOK_IDENT);
+        tok_copy(n->for_in_stmt.var2, sizeof(n->for_in_stmt.var2), var2);
     }
 
     eat(TOK_IN_KW);
 
     Node *expr = parse_expr();
-    if (peek().kind == TOK_DOTDOT) {
+    if (peek()->kind == TOK_DOTDOT) {
         eat(TOK_DOTDOT);
-        Node *range = node_new(NODE_EXPR_RANGE);
+        Node *range = node_new(arena, NODE_EXPR_RANGE);
         range->line = expr->line;
         range->col = expr->col;
         range->range.start = expr;
@@ -1171,36 +1222,36 @@ static Node *parse_for_in_stmt(void) {
 
     eat(TOK_LBRACE);
     n->for_in_stmt.nbody = 0;
-    while (peek().kind != TOK_RBRACE)
-        n->for_in_stmt.body[n->for_in_stmt.nbody++] = parse_stmt();
+    while (peek()->kind != TOK_RBRACE)
+        push_node(&n->for_in_stmt.body, &n->for_in_stmt.nbody, parse_stmt());
     eat(TOK_RBRACE);
     return n;
 }
 
 static Node *parse_for_stmt(void) {
-    Token ft = peek();
+    const Token *ft = peek();
     eat(TOK_FOR_KW);
 
-    if (peek().kind != TOK_LPAREN)
+    if (peek()->kind != TOK_LPAREN)
         return parse_for_in_stmt();
 
     eat(TOK_LPAREN);
-    Node *n = node_new(NODE_FOR_STMT);
-    n->line = ft.line;
-    n->col = ft.col;
+    Node *n = node_new(arena, NODE_FOR_STMT);
+    n->line = ft->line;
+    n->col = ft->col;
 
     if (is_type_start(peek())) {
         int save = pos;
         char type[64];
         parse_type(type);
-        if (peek().kind == TOK_IDENT) {
-            Token name = eat(TOK_IDENT);
+        if (peek()->kind == TOK_IDENT) {
+            const Token *name = eat(TOK_IDENT);
             eat(TOK_EQ);
-            Node *vd = node_new(NODE_VAR_DECL);
-            vd->line = name.line;
-            vd->col = name.col;
+            Node *vd = node_new(arena, NODE_VAR_DECL);
+            vd->line = name->line;
+            vd->col = name->col;
             strcpy(vd->var_decl.type, type);
-            strcpy(vd->var_decl.name, name.text);
+            tok_copy(vd->var_decl.name, sizeof(vd->var_decl.name), name);
             vd->var_decl.value = parse_expr();
             n->for_stmt.init = vd;
         } else {
@@ -1216,17 +1267,17 @@ static Node *parse_for_stmt(void) {
     eat(TOK_SEMI);
 
     Node *step_expr = parse_expr();
-    if (is_assign_op(peek().kind)) {
-        Token op = advance();
-        Node *a = node_new(NODE_ASSIGN);
-        a->line = op.line;
-        a->col = op.col;
+    if (is_assign_op(peek()->kind)) {
+        const Token *op = advance();
+        Node *a = node_new(arena, NODE_ASSIGN);
+        a->line = op->line;
+        a->col = op->col;
         a->assign.target = step_expr;
-        assign_op_str(op.kind, a->assign.op);
+        assign_op_str(op->kind, a->assign.op);
         a->assign.value = parse_expr();
         n->for_stmt.step = a;
     } else {
-        Node *es = node_new(NODE_EXPR_STMT);
+        Node *es = node_new(arena, NODE_EXPR_STMT);
         es->line = step_expr->line;
         es->col = step_expr->col;
         es->expr_stmt.expr = step_expr;
@@ -1236,19 +1287,19 @@ static Node *parse_for_stmt(void) {
     eat(TOK_RPAREN);
     eat(TOK_LBRACE);
     n->for_stmt.nbody = 0;
-    while (peek().kind != TOK_RBRACE)
-        n->for_stmt.body[n->for_stmt.nbody++] = parse_stmt();
+    while (peek()->kind != TOK_RBRACE)
+        push_node(&n->for_stmt.body, &n->for_stmt.nbody, parse_stmt());
     eat(TOK_RBRACE);
     return n;
 }
 
 static Node *parse_return_stmt(void) {
-    Token rt = peek();
+    const Token *rt = peek();
     eat(TOK_RETURN_KW);
-    Node *n = node_new(NODE_RETURN_STMT);
-    n->line = rt.line;
-    n->col = rt.col;
-    if (peek().kind != TOK_SEMI)
+    Node *n = node_new(arena, NODE_RETURN_STMT);
+    n->line = rt->line;
+    n->col = rt->col;
+    if (peek()->kind != TOK_SEMI)
         n->return_stmt.value = parse_expr();
     else
         n->return_stmt.value = NULL;
@@ -1256,92 +1307,92 @@ static Node *parse_return_stmt(void) {
     return n;
 }
 
-static void check_wrong_keyword(Token t) {
-    if (t.kind != TOK_IDENT || toks[pos + 1].kind != TOK_IDENT)
+static void check_wrong_keyword(const Token *t) {
+    if (t->kind != TOK_IDENT || toks[pos + 1].kind != TOK_IDENT)
         return;
 
-    int span = (int)strlen(t.text);
+    int span = t->len;
 
-    if (strcmp(t.text, "str") == 0) {
-        diag_error_span(t.line, t.col, span, "unknown type 'str'");
+    if (tok_is(t, "str")) {
+        diag_error_span(t->line, t->col, span, "unknown type 'str'");
         diag_hint("did you mean 'string'?");
         diag_bail();
     }
-    if (strcmp(t.text, "boolean") == 0) {
-        diag_error_span(t.line, t.col, span, "unknown type 'boolean'");
+    if (tok_is(t, "boolean")) {
+        diag_error_span(t->line, t->col, span, "unknown type 'boolean'");
         diag_hint("did you mean 'bool'?");
         diag_bail();
     }
-    if (strcmp(t.text, "integer") == 0) {
-        diag_error_span(t.line, t.col, span, "unknown type 'integer'");
+    if (tok_is(t, "integer")) {
+        diag_error_span(t->line, t->col, span, "unknown type 'integer'");
         diag_hint("did you mean 'int'?");
         diag_bail();
     }
-    if (strcmp(t.text, "let") == 0 || strcmp(t.text, "var") == 0 ||
-        strcmp(t.text, "val") == 0) {
+    if (tok_is(t, "let") || tok_is(t, "var") ||
+        tok_is(t, "val")) {
         char msg[128];
-        snprintf(msg, sizeof(msg), "'%s' is not a moxy keyword", t.text);
-        diag_error_span(t.line, t.col, span, msg);
+        snprintf(msg, sizeof(msg), "'%.*s' is not a moxy keyword", t->len, src + t->off);
+        diag_error_span(t->line, t->col, span, msg);
         diag_hint("moxy uses C-style declarations: int x = 42;");
         diag_bail();
     }
-    if (strcmp(t.text, "fn") == 0 || strcmp(t.text, "func") == 0 ||
-        strcmp(t.text, "function") == 0 || strcmp(t.text, "def") == 0) {
+    if (tok_is(t, "fn") || tok_is(t, "func") ||
+        tok_is(t, "function") || tok_is(t, "def")) {
         char msg[128];
-        snprintf(msg, sizeof(msg), "'%s' is not a moxy keyword", t.text);
-        diag_error_span(t.line, t.col, span, msg);
+        snprintf(msg, sizeof(msg), "'%.*s' is not a moxy keyword", t->len, src + t->off);
+        diag_error_span(t->line, t->col, span, msg);
         diag_hint("moxy uses C-style function syntax: int add(int a, int b) { ... }");
         diag_bail();
     }
 }
 
 static Node *parse_stmt(void) {
-    Token t = peek();
+    const Token *t = peek();
 
-    if (t.kind == TOK_IDENT && strcmp(t.text, "print") == 0)
+    if (t->kind == TOK_IDENT && tok_is(t, "print"))
         return parse_print();
 
-    if (t.kind == TOK_IDENT && strcmp(t.text, "assert") == 0) {
-        int line = t.line;
+    if (t->kind == TOK_IDENT && tok_is(t, "assert")) {
+        int line = t->line;
         eat(TOK_IDENT);
         eat(TOK_LPAREN);
-        Node *n = node_new(NODE_ASSERT_STMT);
-        n->line = t.line;
-        n->col = t.col;
+        Node *n = node_new(arena, NODE_ASSERT_STMT);
+        n->line = t->line;
+        n->col = t->col;
         n->assert_stmt.arg = parse_expr();
         n->assert_stmt.line = line;
         eat(TOK_RPAREN);
-        if (peek().kind == TOK_SEMI) eat(TOK_SEMI);
+        if (peek()->kind == TOK_SEMI) eat(TOK_SEMI);
         return n;
     }
 
-    if (t.kind == TOK_MATCH_KW)
+    if (t->kind == TOK_MATCH_KW)
         return parse_match();
 
-    if (t.kind == TOK_IF_KW)
+    if (t->kind == TOK_IF_KW)
         return parse_if_stmt();
 
-    if (t.kind == TOK_WHILE_KW)
+    if (t->kind == TOK_WHILE_KW)
         return parse_while_stmt();
 
-    if (t.kind == TOK_FOR_KW)
+    if (t->kind == TOK_FOR_KW)
         return parse_for_stmt();
 
-    if (t.kind == TOK_RETURN_KW)
+    if (t->kind == TOK_RETURN_KW)
         return parse_return_stmt();
 
-    if (t.kind == TOK_IDENT && toks[pos + 1].kind == TOK_COLON)
+    if (t->kind == TOK_IDENT && toks[pos + 1].kind == TOK_COLON)
         return collect_raw_stmt();
 
-    if (t.kind == TOK_SWITCH_KW || t.kind == TOK_DO_KW ||
-        t.kind == TOK_GOTO_KW || t.kind == TOK_TYPEDEF_KW ||
-        t.kind == TOK_STRUCT_KW || t.kind == TOK_UNION_KW ||
-        t.kind == TOK_EXTERN_KW || t.kind == TOK_REGISTER_KW ||
-        t.kind == TOK_VOLATILE_KW || t.kind == TOK_INLINE_KW)
+    if (t->kind == TOK_SWITCH_KW || t->kind == TOK_DO_KW ||
+        t->kind == TOK_GOTO_KW || t->kind == TOK_TYPEDEF_KW ||
+        t->kind == TOK_STRUCT_KW || t->kind == TOK_UNION_KW ||
+        t->kind == TOK_EXTERN_KW || t->kind == TOK_REGISTER_KW ||
+        t->kind == TOK_VOLATILE_KW || t->kind == TOK_INLINE_KW)
         return collect_raw_stmt();
 
-    if (t.kind == TOK_BREAK_KW || t.kind == TOK_CONTINUE_KW ||
-        t.kind == TOK_CASE_KW || t.kind == TOK_DEFAULT_KW)
+    if (t->kind == TOK_BREAK_KW || t->kind == TOK_CONTINUE_KW ||
+        t->kind == TOK_CASE_KW || t->kind == TOK_DEFAULT_KW)
         return collect_raw_stmt();
 
     check_wrong_keyword(t);
@@ -1351,18 +1402,18 @@ static Node *parse_stmt(void) {
         char type[64];
         parse_type(type);
 
-        if (peek().kind == TOK_IDENT) {
-            Token name_tok = toks[pos];
+        if (peek()->kind == TOK_IDENT) {
+            const Token *name_tok = &toks[pos];
             TokenKind after = toks[pos + 1].kind;
 
             if (after == TOK_EQ) {
                 eat(TOK_IDENT);
                 eat(TOK_EQ);
-                Node *n = node_new(NODE_VAR_DECL);
-                n->line = name_tok.line;
-                n->col = name_tok.col;
+                Node *n = node_new(arena, NODE_VAR_DECL);
+                n->line = name_tok->line;
+                n->col = name_tok->col;
                 strcpy(n->var_decl.type, type);
-                strcpy(n->var_decl.name, name_tok.text);
+                tok_copy(n->var_decl.name, sizeof(n->var_decl.name), name_tok);
                 n->var_decl.value = parse_expr();
                 eat(TOK_SEMI);
                 return n;
@@ -1401,63 +1452,65 @@ static Node *parse_stmt(void) {
     {
         Node *expr = parse_expr();
 
-        if (is_assign_op(peek().kind)) {
-            Token op = advance();
-            Node *n = node_new(NODE_ASSIGN);
-            n->line = op.line;
-            n->col = op.col;
+        if (is_assign_op(peek()->kind)) {
+            const Token *op = advance();
+            Node *n = node_new(arena, NODE_ASSIGN);
+            n->line = op->line;
+            n->col = op->col;
             n->assign.target = expr;
-            assign_op_str(op.kind, n->assign.op);
+            assign_op_str(op->kind, n->assign.op);
             n->assign.value = parse_expr();
             eat(TOK_SEMI);
             return n;
         }
 
         if (expr->kind == NODE_PRINT_STMT) {
-            if (peek().kind == TOK_SEMI) eat(TOK_SEMI);
+            if (peek()->kind == TOK_SEMI) eat(TOK_SEMI);
             return expr;
         }
-        Node *n = node_new(NODE_EXPR_STMT);
+        Node *n = node_new(arena, NODE_EXPR_STMT);
         n->line = expr->line;
         n->col = expr->col;
         n->expr_stmt.expr = expr;
-        if (peek().kind == TOK_SEMI) eat(TOK_SEMI);
+        if (peek()->kind == TOK_SEMI) eat(TOK_SEMI);
         return n;
     }
 }
 
 static Node *parse_enum(void) {
-    Token et = peek();
+    const Token *et = peek();
     eat(TOK_ENUM_KW);
-    Token name = eat(TOK_IDENT);
+    const Token *name = eat(TOK_IDENT);
     eat(TOK_LBRACE);
 
-    Node *n = node_new(NODE_ENUM_DECL);
-    n->line = et.line;
-    n->col = et.col;
-    strcpy(n->enum_decl.name, name.text);
+    Node *n = node_new(arena, NODE_ENUM_DECL);
+    n->line = et->line;
+    n->col = et->col;
+    tok_copy(n->enum_decl.name, sizeof(n->enum_decl.name), name);
     n->enum_decl.nvariants = 0;
 
-    while (peek().kind != TOK_RBRACE) {
+    while (peek()->kind != TOK_RBRACE) {
+        n->enum_decl.variants = ast_grow(arena, n->enum_decl.variants, n->enum_decl.nvariants, sizeof(Variant));
         Variant *v = &n->enum_decl.variants[n->enum_decl.nvariants++];
-        Token vname = eat(TOK_IDENT);
-        strcpy(v->name, vname.text);
+        const Token *vname = eat(TOK_IDENT);
+        tok_copy(v->name, sizeof(v->name), vname);
         v->nfields = 0;
 
-        if (peek().kind == TOK_LPAREN) {
+        if (peek()->kind == TOK_LPAREN) {
             eat(TOK_LPAREN);
-            while (peek().kind != TOK_RPAREN) {
+            while (peek()->kind != TOK_RPAREN) {
+                v->fields = ast_grow(arena, v->fields, v->nfields, sizeof(Field));
                 Field *f = &v->fields[v->nfields++];
-                Token ftype = advance();
-                Token fname = eat(TOK_IDENT);
-                strcpy(f->type, ftype.text);
-                strcpy(f->name, fname.text);
-                if (peek().kind == TOK_COMMA) eat(TOK_COMMA);
+                const Token *ftype = advance();
+                const Token *fname = eat(TOK_IDENT);
+                tok_copy(f->type, sizeof(f->type), ftype);
+                tok_copy(f->name, sizeof(f->name), fname);
+                if (peek()->kind == TOK_COMMA) eat(TOK_COMMA);
             }
             eat(TOK_RPAREN);
         }
 
-        if (peek().kind == TOK_COMMA) eat(TOK_COMMA);
+        if (peek()->kind == TOK_COMMA) eat(TOK_COMMA);
     }
 
     eat(TOK_RBRACE);
@@ -1465,43 +1518,45 @@ static Node *parse_enum(void) {
 }
 
 static Node *parse_func(const char *ret, const char *fname) {
-    Token fnt = peek();
+    const Token *fnt = peek();
     eat(TOK_LPAREN);
 
-    Node *n = node_new(NODE_FUNC_DECL);
-    n->line = fnt.line;
-    n->col = fnt.col;
+    Node *n = node_new(arena, NODE_FUNC_DECL);
+    n->line = fnt->line;
+    n->col = fnt->col;
     strcpy(n->func_decl.ret, ret);
     strcpy(n->func_decl.name, fname);
     n->func_decl.nparams = 0;
     n->func_decl.nbody = 0;
 
-    while (peek().kind != TOK_RPAREN) {
-        if (peek().kind == TOK_ELLIPSIS) {
+    while (peek()->kind != TOK_RPAREN) {
+        if (peek()->kind == TOK_ELLIPSIS) {
+            n->func_decl.params = ast_grow(arena, n->func_decl.params, n->func_decl.nparams, sizeof(Param));
             Param *p = &n->func_decl.params[n->func_decl.nparams++];
             strcpy(p->type, "...");
             strcpy(p->name, "");
             advance();
         } else {
+            n->func_decl.params = ast_grow(arena, n->func_decl.params, n->func_decl.nparams, sizeof(Param));
             Param *p = &n->func_decl.params[n->func_decl.nparams++];
             char ptype[64];
             parse_type(ptype);
-            Token pname = eat(TOK_IDENT);
+            const Token *pname = eat(TOK_IDENT);
 
-            if (peek().kind == TOK_LPAREN) {
+            if (peek()->kind == TOK_LPAREN) {
                 /* function pointer param: int fn(int) -> store as "int(*)(int)" */
                 advance(); /* skip ( */
                 char fptype[64];
                 int fp = 0;
                 fp += snprintf(fptype + fp, 64 - fp, "%s(*)(", ptype);
                 int first = 1;
-                while (peek().kind != TOK_RPAREN) {
+                while (peek()->kind != TOK_RPAREN) {
                     if (!first) fp += snprintf(fptype + fp, 64 - fp, ", ");
                     char atype[64];
                     parse_type(atype);
                     fp += snprintf(fptype + fp, 64 - fp, "%s", atype);
                     first = 0;
-                    if (peek().kind == TOK_COMMA) advance();
+                    if (peek()->kind == TOK_COMMA) advance();
                 }
                 eat(TOK_RPAREN);
                 fp += snprintf(fptype + fp, 64 - fp, ")");
@@ -1509,16 +1564,16 @@ static Node *parse_func(const char *ret, const char *fname) {
             } else {
                 strcpy(p->type, ptype);
             }
-            strcpy(p->name, pname.text);
+            tok_copy(p->name, sizeof(p->name), pname);
         }
-        if (peek().kind == TOK_COMMA) eat(TOK_COMMA);
+        if (peek()->kind == TOK_COMMA) eat(TOK_COMMA);
     }
 
     eat(TOK_RPAREN);
     eat(TOK_LBRACE);
 
-    while (peek().kind != TOK_RBRACE) {
-        n->func_decl.body[n->func_decl.nbody++] = parse_stmt();
+    while (peek()->kind != TOK_RBRACE) {
+        push_node(&n->func_decl.body, &n->func_decl.nbody, parse_stmt());
     }
 
     eat(TOK_RBRACE);
@@ -1546,18 +1601,20 @@ static int is_c_enum(void) {
     return result;
 }
 
-Node *parse(Token *tokens, int ntokens) {
+Node *parse(Arena *a, const char *source, Token *tokens, int ntokens) {
+    arena = a;
+    src = source;
     toks = tokens;
     pos = 0;
     (void)ntokens;
 
-    Node *prog = node_new(NODE_PROGRAM);
+    Node *prog = node_new(arena, NODE_PROGRAM);
     prog->line = 1;
     prog->col = 1;
     prog->program.ndecls = 0;
 
-    while (peek().kind != TOK_EOF) {
-        if (peek().kind == TOK_ENUM_KW) {
+    while (peek()->kind != TOK_EOF) {
+        if (peek()->kind == TOK_ENUM_KW) {
             if (toks[pos + 1].kind == TOK_IDENT &&
                 toks[pos + 2].kind == TOK_LBRACE) {
                 int save = pos;
@@ -1566,41 +1623,41 @@ Node *parse(Token *tokens, int ntokens) {
                 pos = save;
 
                 if (c_style) {
-                    prog->program.decls[prog->program.ndecls++] = collect_raw_toplevel();
+                    push_node(&prog->program.decls, &prog->program.ndecls, collect_raw_toplevel());
                 } else {
-                    prog->program.decls[prog->program.ndecls++] = parse_enum();
+                    push_node(&prog->program.decls, &prog->program.ndecls, parse_enum());
                 }
             } else {
-                prog->program.decls[prog->program.ndecls++] = collect_raw_toplevel();
+                push_node(&prog->program.decls, &prog->program.ndecls, collect_raw_toplevel());
             }
             continue;
         }
 
-        if (peek().kind == TOK_TYPEDEF_KW ||
-            peek().kind == TOK_EXTERN_KW) {
-            prog->program.decls[prog->program.ndecls++] = collect_raw_toplevel();
+        if (peek()->kind == TOK_TYPEDEF_KW ||
+            peek()->kind == TOK_EXTERN_KW) {
+            push_node(&prog->program.decls, &prog->program.ndecls, collect_raw_toplevel());
             continue;
         }
 
-        if (peek().kind == TOK_STRUCT_KW || peek().kind == TOK_UNION_KW) {
+        if (peek()->kind == TOK_STRUCT_KW || peek()->kind == TOK_UNION_KW) {
             int save = pos;
             advance();
-            if (peek().kind == TOK_IDENT) {
+            if (peek()->kind == TOK_IDENT) {
                 advance(); /* Name */
-                if (peek().kind == TOK_LBRACE) {
+                if (peek()->kind == TOK_LBRACE) {
                     /* struct Name { ... } — could be definition or var */
                     pos = save;
-                    prog->program.decls[prog->program.ndecls++] = collect_raw_toplevel();
+                    push_node(&prog->program.decls, &prog->program.ndecls, collect_raw_toplevel());
                     continue;
                 }
                 pos = save;
-            } else if (peek().kind == TOK_LBRACE) {
+            } else if (peek()->kind == TOK_LBRACE) {
                 pos = save;
-                prog->program.decls[prog->program.ndecls++] = collect_raw_toplevel();
+                push_node(&prog->program.decls, &prog->program.ndecls, collect_raw_toplevel());
                 continue;
             } else {
                 pos = save;
-                prog->program.decls[prog->program.ndecls++] = collect_raw_toplevel();
+                push_node(&prog->program.decls, &prog->program.ndecls, collect_raw_toplevel());
                 continue;
             }
         }
@@ -1612,11 +1669,11 @@ Node *parse(Token *tokens, int ntokens) {
             char type[64];
             parse_type(type);
 
-            if (peek().kind == TOK_IDENT) {
-                Token name_tok = toks[pos];
+            if (peek()->kind == TOK_IDENT) {
+                const Token *name_tok = &toks[pos];
                 pos++;
 
-                if (peek().kind == TOK_LPAREN) {
+                if (peek()->kind == TOK_LPAREN) {
                     /* lookahead past params to check for forward decl */
                     int lk = pos;
                     int d = 0;
@@ -1629,35 +1686,37 @@ Node *parse(Token *tokens, int ntokens) {
                     if (toks[lk].kind == TOK_SEMI) {
                         /* forward declaration — collect as raw */
                         pos = save;
-                        prog->program.decls[prog->program.ndecls++] = collect_raw_toplevel();
+                        push_node(&prog->program.decls, &prog->program.ndecls, collect_raw_toplevel());
                     } else {
                         pos--; /* unconsume ident — parse_func will re-read */
-                        Token nm = eat(TOK_IDENT);
-                        prog->program.decls[prog->program.ndecls++] =
-                            parse_func(type, nm.text);
+                        const Token *nm = eat(TOK_IDENT);
+                        char fname[64];
+                        tok_copy(fname, sizeof(fname), nm);
+                        push_node(&prog->program.decls, &prog->program.ndecls,
+                            parse_func(type, fname));
                     }
-                } else if (peek().kind == TOK_EQ) {
+                } else if (peek()->kind == TOK_EQ) {
                     eat(TOK_EQ);
-                    Node *n = node_new(NODE_VAR_DECL);
-                    n->line = name_tok.line;
-                    n->col = name_tok.col;
+                    Node *n = node_new(arena, NODE_VAR_DECL);
+                    n->line = name_tok->line;
+                    n->col = name_tok->col;
                     strcpy(n->var_decl.type, type);
-                    strcpy(n->var_decl.name, name_tok.text);
+                    tok_copy(n->var_decl.name, sizeof(n->var_decl.name), name_tok);
                     n->var_decl.value = parse_expr();
                     eat(TOK_SEMI);
-                    prog->program.decls[prog->program.ndecls++] = n;
+                    push_node(&prog->program.decls, &prog->program.ndecls, n);
                 } else {
                     pos = save;
-                    prog->program.decls[prog->program.ndecls++] = collect_raw_toplevel();
+                    push_node(&prog->program.decls, &prog->program.ndecls, collect_raw_toplevel());
                 }
             } else {
                 pos = save;
-                prog->program.decls[prog->program.ndecls++] = collect_raw_toplevel();
+                push_node(&prog->program.decls, &prog->program.ndecls, collect_raw_toplevel());
             }
             continue;
         }
 
-        prog->program.decls[prog->program.ndecls++] = collect_raw_toplevel();
+        push_node(&prog->program.decls, &prog->program.ndecls, collect_raw_toplevel());
     }
 
     return prog;
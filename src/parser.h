@@ -4,7 +4,7 @@
 #include "token.h"
 #include "ast.h"
 
-Node *parse(Token *tokens, int ntokens);
+Node *parse(Arena *arena, const char *src, Token *tokens, int ntokens);
 void parser_register_type(const char *name);
 
 #endif
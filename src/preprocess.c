@@ -0,0 +1,503 @@
+#define _DEFAULT_SOURCE
+#include "preprocess.h"
+#include "codegen.h"
+#include "parser.h"
+#include "diag.h"
+#include "flags.h"
+#include "mxystdlib.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <pthread.h>
+
+/* A scan keeps a file's plain lines as text and its .mxy includes as
+   references to other scanned files, so splicing can apply include-once
+   per compilation and a file shared by several compilations is read and
+   scanned only once per cache. */
+enum { PP_TEXT, PP_MXY, PP_DIRECTIVE, PP_C_INCLUDE, PP_TYPE };
+
+typedef struct PPFile PPFile;
+
+typedef struct {
+    int kind;
+    int off, len;   /* PP_TEXT: span of the file's text */
+    PPFile *file;   /* PP_MXY */
+    char *line;     /* PP_DIRECTIVE, PP_C_INCLUDE, PP_TYPE */
+} PPItem;
+
+/* never changed once in the cache, except walked, which is under the lock */
+struct PPFile {
+    char *key;      /* realpath on disk, or the stdlib path for embedded files */
+    char *raw;      /* source while it is being scanned */
+    char *text;
+    int textlen, textcap;
+    PPItem *items;
+    int nitems, itemcap;
+    int id;         /* index in the cache */
+    unsigned long long hash;    /* of the raw source */
+    unsigned features;          /* PP_USES_* seen in the raw source */
+    int walked;
+};
+
+/* The lock covers the file table, not scanning or splicing: a root is
+   scanned outside it, with its new includes, and they are added together
+   once all are complete, so other threads only ever see finished files. */
+struct PPCache {
+    pthread_mutex_t lock;
+    PPFile **files;
+    int nfiles, files_cap;
+    int walk;
+};
+
+/* one root scan: the files it has read that are not in the cache yet */
+typedef struct {
+    PPCache *c;
+    PPFile **files;
+    int nfiles, files_cap;
+    int depth;      /* of the include being scanned */
+} PPScan;
+
+/* one compilation's output, and which files it has spliced in */
+typedef struct {
+    char *out;
+    int outlen, outcap;
+    unsigned char *spliced;     /* by file id */
+} PPRun;
+
+unsigned long long pp_hash(unsigned long long h, const void *data, size_t len) {
+    const unsigned char *p = data;
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+PPCache *pp_cache_new(void) {
+    PPCache *c = calloc(1, sizeof(PPCache));
+    if (!c) abort();
+    pthread_mutex_init(&c->lock, NULL);
+    return c;
+}
+
+static void pp_file_free(PPFile *pf) {
+    for (int j = 0; j < pf->nitems; j++) free(pf->items[j].line);
+    free(pf->items);
+    free(pf->raw);
+    free(pf->text);
+    free(pf->key);
+    free(pf);
+}
+
+void pp_cache_free(PPCache *c) {
+    if (!c) return;
+    for (int i = 0; i < c->nfiles; i++) pp_file_free(c->files[i]);
+    free(c->files);
+    pthread_mutex_destroy(&c->lock);
+    free(c);
+}
+
+/* errors leave through diag_fatal, which may unwind instead of exiting.
+   The failed scan's files never reach the cache, so a later compilation
+   including them scans them again and reports the error itself. */
+static _Noreturn void pp_fail(PPScan *s, const char *msg) {
+    for (int i = 0; i < s->nfiles; i++) pp_file_free(s->files[i]);
+    free(s->files);
+    s->files = NULL;
+    s->nfiles = 0;
+    diag_fatal(msg);
+}
+
+static char *try_read_file(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) return NULL;
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *buf = malloc(len + 1);
+    moxy_alloc_bytes += len + 1;
+    size_t n = fread(buf, 1, len, f);
+    buf[n] = '\0';
+    fclose(f);
+    return buf;
+}
+
+static void dir_of(const char *path, char *buf, int bufsz) {
+    const char *last = strrchr(path, '/');
+    if (!last) {
+        buf[0] = '.';
+        buf[1] = '\0';
+    } else {
+        int len = (int)(last - path);
+        if (len >= bufsz) len = bufsz - 1;
+        memcpy(buf, path, len);
+        buf[len] = '\0';
+    }
+}
+
+static int ends_with(const char *s, const char *suffix) {
+    int slen = (int)strlen(s);
+    int suflen = (int)strlen(suffix);
+    if (suflen > slen) return 0;
+    return strcmp(s + slen - suflen, suffix) == 0;
+}
+
+/* called locked */
+static PPFile *pp_cached(PPCache *c, const char *key) {
+    for (int i = 0; i < c->nfiles; i++)
+        if (strcmp(c->files[i]->key, key) == 0) return c->files[i];
+    return NULL;
+}
+
+/* a file this scan has read, or one in the cache */
+static PPFile *pp_find(PPScan *s, const char *key) {
+    for (int i = 0; i < s->nfiles; i++)
+        if (strcmp(s->files[i]->key, key) == 0) return s->files[i];
+    pthread_mutex_lock(&s->c->lock);
+    PPFile *found = pp_cached(s->c, key);
+    pthread_mutex_unlock(&s->c->lock);
+    return found;
+}
+
+/* adds the scan's files to the cache and returns its root's entry. Another
+   thread may have added some of the same files since this scan looked;
+   those copies are dropped for the cached ones, so a key keeps one id and
+   include-once holds. keep_root adds the root even so, for a source that
+   stands in for the file on disk. */
+static PPFile *pp_commit(PPScan *s, int keep_root) {
+    PPCache *c = s->c;
+    pthread_mutex_lock(&c->lock);
+    for (int i = 0; i < s->nfiles; i++) {
+        PPFile *have = i == 0 && keep_root ? NULL : pp_cached(c, s->files[i]->key);
+        if (have) {
+            s->files[i]->id = have->id;
+            continue;
+        }
+        if (c->nfiles >= c->files_cap) {
+            c->files_cap = c->files_cap ? c->files_cap * 2 : 16;
+            c->files = realloc(c->files, c->files_cap * sizeof(PPFile *));
+        }
+        s->files[i]->id = c->nfiles;
+        c->files[c->nfiles++] = s->files[i];
+    }
+    /* every file of the scan now has the id of its cached copy */
+    for (int i = 0; i < s->nfiles; i++) {
+        PPFile *pf = s->files[i];
+        if (c->files[pf->id] != pf) continue;
+        for (int j = 0; j < pf->nitems; j++)
+            if (pf->items[j].kind == PP_MXY)
+                pf->items[j].file = c->files[pf->items[j].file->id];
+    }
+    PPFile *root = c->files[s->files[0]->id];
+    int ndropped = 0;
+    for (int i = 0; i < s->nfiles; i++)
+        if (c->files[s->files[i]->id] != s->files[i])
+            s->files[ndropped++] = s->files[i];
+    pthread_mutex_unlock(&c->lock);
+    for (int i = 0; i < ndropped; i++) pp_file_free(s->files[i]);
+    free(s->files);
+    s->files = NULL;
+    s->nfiles = 0;
+    return root;
+}
+
+static PPItem *pp_item(PPFile *pf, int kind) {
+    if (pf->nitems >= pf->itemcap) {
+        pf->itemcap = pf->itemcap ? pf->itemcap * 2 : 16;
+        moxy_alloc_bytes += pf->itemcap * sizeof(PPItem);
+        pf->items = realloc(pf->items, pf->itemcap * sizeof(PPItem));
+    }
+    PPItem *it = &pf->items[pf->nitems++];
+    memset(it, 0, sizeof(*it));
+    it->kind = kind;
+    return it;
+}
+
+static void pp_text(PPFile *pf, const char *p, int len, int newline) {
+    if (pf->textlen + len + 1 > pf->textcap) {
+        while (pf->textlen + len + 1 > pf->textcap)
+            pf->textcap = pf->textcap ? pf->textcap * 2 : 4096;
+        moxy_alloc_bytes += pf->textcap;
+        pf->text = realloc(pf->text, pf->textcap);
+    }
+    memcpy(pf->text + pf->textlen, p, len);
+    if (newline) pf->text[pf->textlen + len++] = '\n';
+    PPItem *last = pf->nitems ? &pf->items[pf->nitems - 1] : NULL;
+    if (last && last->kind == PP_TEXT && last->off + last->len == pf->textlen)
+        last->len += len;
+    else {
+        PPItem *it = pp_item(pf, PP_TEXT);
+        it->off = pf->textlen;
+        it->len = len;
+    }
+    pf->textlen += len;
+}
+
+static PPFile *pp_include(PPScan *s, const char *basedir, const char *filename);
+
+/* scans src (taking ownership) into a new file of the scan; the file is
+   listed before its includes are scanned, so cycles terminate */
+static PPFile *pp_scan(PPScan *s, const char *key, char *src, const char *srcpath) {
+    char basedir[512];
+    dir_of(srcpath, basedir, sizeof(basedir));
+
+    if (s->nfiles >= s->files_cap) {
+        s->files_cap = s->files_cap ? s->files_cap * 2 : 16;
+        s->files = realloc(s->files, s->files_cap * sizeof(PPFile *));
+    }
+    PPFile *pf = calloc(1, sizeof(PPFile));
+    if (!pf) abort();
+    s->files[s->nfiles++] = pf;
+    pf->key = strdup(key);
+    pf->raw = src;
+    pf->hash = pp_hash(PP_HASH_INIT, src, strlen(src));
+    /* the same sniffing the CLI has always used to turn features on */
+    if (strstr(src, "Future<") || strstr(src, "await "))
+        pf->features |= PP_USES_ASYNC;
+    if (strstr(src, "[]") || strstr(src, "map["))
+        pf->features |= PP_USES_ARC;
+
+    const char *p = src;
+    while (*p) {
+        const char *eol = strchr(p, '\n');
+        int linelen = eol ? (int)(eol - p) : (int)strlen(p);
+
+        const char *lp = p;
+        while (*lp == ' ' || *lp == '\t') lp++;
+
+        if (*lp == '@' && strncmp(lp, "@type", 5) == 0) {
+            const char *cur = lp + 5;
+            while (cur < p + linelen) {
+                while (cur < p + linelen && (*cur == ' ' || *cur == '\t' || *cur == ',')) cur++;
+                if (cur >= p + linelen || *cur == ';') break;
+                const char *start = cur;
+                while (cur < p + linelen && *cur != ',' && *cur != ';' && *cur != ' ' && *cur != '\t') cur++;
+                if (cur > start) {
+                    char tname[64];
+                    int tlen = (int)(cur - start);
+                    if (tlen > 63) tlen = 63;
+                    memcpy(tname, start, tlen);
+                    tname[tlen] = '\0';
+                    pp_item(pf, PP_TYPE)->line = strdup(tname);
+                }
+            }
+            p += linelen;
+            if (eol) p++;
+            continue;
+        }
+
+        if (*lp == '#' && strncmp(lp, "#include", 8) != 0) {
+            char directive[512];
+            int dlen = linelen < 511 ? linelen : 511;
+            memcpy(directive, p, dlen);
+            directive[dlen] = '\0';
+            pp_item(pf, PP_DIRECTIVE)->line = strdup(directive);
+
+            p += linelen;
+            if (eol) p++;
+            continue;
+        }
+
+        if (strncmp(lp, "#include", 8) == 0 && (lp[8] == ' ' || lp[8] == '\t' || lp[8] == '"' || lp[8] == '<')) {
+            const char *after = lp + 8;
+            while (*after == ' ' || *after == '\t') after++;
+
+            char filename[256];
+            int is_angle = 0;
+
+            if (*after == '"' || *after == '<') {
+                is_angle = *after == '<';
+                after++;
+                const char *end = strchr(after, is_angle ? '>' : '"');
+                int flen = end ? (int)(end - after) : 0;
+                if (flen > 255) flen = 255;
+                memcpy(filename, after, flen);
+                filename[flen] = '\0';
+            } else {
+                filename[0] = '\0';
+            }
+
+            if (filename[0] && ends_with(filename, ".mxy")) {
+                PPFile *inc = pp_include(s, basedir, filename);
+                pp_item(pf, PP_MXY)->file = inc;
+            } else if (filename[0]) {
+                char directive[300];
+                if (is_angle)
+                    snprintf(directive, sizeof(directive), "#include <%s>", filename);
+                else
+                    snprintf(directive, sizeof(directive), "#include \"%s\"", filename);
+                pp_item(pf, PP_C_INCLUDE)->line = strdup(directive);
+            }
+        } else {
+            pp_text(pf, p, linelen, eol != NULL);
+        }
+
+        p += linelen;
+        if (eol) p++;
+    }
+
+    free(src);
+    pf->raw = NULL;
+    return pf;
+}
+
+/* scans are recursive and each level takes a few KB of stack, so include
+   chains are capped like a C compiler's */
+#define PP_MAX_DEPTH 200
+
+static PPFile *pp_scan_nested(PPScan *s, const char *key, char *src, const char *srcpath) {
+    if (s->depth >= PP_MAX_DEPTH) {
+        free(src);
+        char msg[600];
+        snprintf(msg, sizeof(msg), "'%s' is nested more than %d includes deep",
+                 srcpath, PP_MAX_DEPTH);
+        pp_fail(s, msg);
+    }
+    s->depth++;
+    PPFile *pf = pp_scan(s, key, src, srcpath);
+    s->depth--;
+    return pf;
+}
+
+/* resolves an included .mxy against the including file's directory, then
+   the embedded stdlib, scanning it on first use */
+static PPFile *pp_include(PPScan *s, const char *basedir, const char *filename) {
+    char fullpath[768];
+    snprintf(fullpath, sizeof(fullpath), "%s/%s", basedir, filename);
+
+    char real[PATH_MAX];
+    if (realpath(fullpath, real)) {
+        PPFile *pf = pp_find(s, real);
+        if (pf) return pf;
+        char *inc_src = try_read_file(fullpath);
+        if (inc_src) return pp_scan_nested(s, real, inc_src, fullpath);
+    }
+
+    PPFile *pf = pp_find(s, filename);
+    if (pf) return pf;
+    const char *embedded = stdlib_lookup(filename);
+    if (embedded) return pp_scan_nested(s, filename, strdup(embedded), filename);
+
+    char msg[320];
+    snprintf(msg, sizeof(msg), "cannot find '%s' (checked disk and stdlib)", filename);
+    pp_fail(s, msg);
+}
+
+static void pp_put(PPRun *r, const char *s, int len) {
+    if (r->outlen + len + 1 > r->outcap) {
+        while (r->outlen + len + 1 > r->outcap)
+            r->outcap = r->outcap ? r->outcap * 2 : 4096;
+        moxy_alloc_bytes += r->outcap;
+        r->out = realloc(r->out, r->outcap);
+    }
+    memcpy(r->out + r->outlen, s, len);
+    r->outlen += len;
+}
+
+/* replays a scanned file into r->out, skipping .mxy files this
+   compilation has already spliced in */
+static void pp_splice(PPRun *r, PPFile *pf) {
+    r->spliced[pf->id] = 1;
+    for (int i = 0; i < pf->nitems; i++) {
+        PPItem *it = &pf->items[i];
+        switch (it->kind) {
+            case PP_TEXT:
+                pp_put(r, pf->text + it->off, it->len);
+                break;
+            case PP_MXY: {
+                if (r->spliced[it->file->id]) break;
+                int start = r->outlen;
+                pp_splice(r, it->file);
+                if (r->outlen > start && r->out[r->outlen - 1] != '\n')
+                    pp_put(r, "\n", 1);
+                break;
+            }
+            case PP_DIRECTIVE:
+                codegen_add_directive(it->line);
+                break;
+            case PP_C_INCLUDE:
+                codegen_add_include(it->line);
+                break;
+            case PP_TYPE:
+                parser_register_type(it->line);
+                break;
+        }
+    }
+}
+
+/* a root file, scanning it on first use */
+static PPFile *pp_load_file(PPCache *c, const char *path) {
+    char real[PATH_MAX];
+    const char *key = realpath(path, real) ? real : path;
+    PPScan s = { .c = c };
+    PPFile *pf = pp_find(&s, key);
+    if (pf) return pf;
+    char *src = try_read_file(path);
+    if (!src) {
+        char msg[600];
+        snprintf(msg, sizeof(msg), "cannot open '%s'", path);
+        pp_fail(&s, msg);
+    }
+    pp_scan(&s, key, src, path);
+    return pp_commit(&s, 0);
+}
+
+static char *pp_run(PPCache *c, PPFile *pf) {
+    pthread_mutex_lock(&c->lock);
+    int nfiles = c->nfiles;
+    pthread_mutex_unlock(&c->lock);
+    PPRun r = {0};
+    r.spliced = calloc(nfiles, 1);
+    if (!r.spliced) abort();
+    pp_splice(&r, pf);
+    pp_put(&r, "", 0);  /* an empty file still gets a buffer */
+    r.out[r.outlen] = '\0';
+    free(r.spliced);
+    return r.out;
+}
+
+char *preprocess_file(PPCache *c, const char *path) {
+    return pp_run(c, pp_load_file(c, path));
+}
+
+/* src is scanned under path's key, so a cycle back to path finds it rather
+   than the copy on disk */
+char *preprocess_source(PPCache *c, const char *src, const char *path) {
+    char real[PATH_MAX];
+    const char *key = !path ? "<source>" : realpath(path, real) ? real : path;
+    PPScan s = { .c = c };
+    pp_scan(&s, key, strdup(src), path ? path : "<source>");
+    return pp_run(c, pp_commit(&s, 1));
+}
+
+int pp_load(PPCache *c, const char *path) {
+    return pp_load_file(c, path)->id;
+}
+
+unsigned pp_features(PPCache *c, int file) {
+    pthread_mutex_lock(&c->lock);
+    unsigned features = c->files[file]->features;
+    pthread_mutex_unlock(&c->lock);
+    return features;
+}
+
+static unsigned long long pp_walk_hash(PPCache *c, PPFile *pf, unsigned long long h) {
+    pf->walked = c->walk;
+    h = pp_hash(h, pf->key, strlen(pf->key) + 1);
+    h = pp_hash(h, &pf->hash, sizeof(pf->hash));
+    for (int i = 0; i < pf->nitems; i++) {
+        PPItem *it = &pf->items[i];
+        if (it->kind == PP_MXY && it->file->walked != c->walk)
+            h = pp_walk_hash(c, it->file, h);
+    }
+    return h;
+}
+
+unsigned long long pp_deps_hash(PPCache *c, int file, unsigned long long h) {
+    pthread_mutex_lock(&c->lock);
+    c->walk++;
+    h = pp_walk_hash(c, c->files[file], h);
+    pthread_mutex_unlock(&c->lock);
+    return h;
+}
@@ -0,0 +1,34 @@
+#ifndef MOXY_PREPROCESS_H
+#define MOXY_PREPROCESS_H
+
+/* the .mxy preprocessor: splices #include "x.mxy" (once per compilation),
+   hands C includes and directives to codegen and @type names to the parser.
+   Scans are cached, per cache object, by canonical path or stdlib path. */
+
+#include <stddef.h>
+
+typedef struct PPCache PPCache;
+
+enum { PP_USES_ASYNC = 1, PP_USES_ARC = 2 };
+
+#define PP_HASH_INIT 0xcbf29ce484222325ULL
+
+PPCache *pp_cache_new(void);
+void pp_cache_free(PPCache *c);
+
+/* preprocessed source of a file, or of src standing in for path (which
+   may be NULL); the caller frees the result. Missing files are reported
+   through diag_fatal. Safe to call from several threads on one cache. */
+char *preprocess_file(PPCache *c, const char *path);
+char *preprocess_source(PPCache *c, const char *src, const char *path);
+
+/* for incremental builds: a file's cache index, the PP_USES_* features
+   seen in its raw source, and a hash of it and everything it includes */
+int pp_load(PPCache *c, const char *path);
+unsigned pp_features(PPCache *c, int file);
+unsigned long long pp_deps_hash(PPCache *c, int file, unsigned long long h);
+
+/* 64-bit FNV-1a, continuing from h */
+unsigned long long pp_hash(unsigned long long h, const void *data, size_t len);
+
+#endif
@@ -114,11 +114,16 @@ typedef enum {
     TOK_EOF,
 } TokenKind;
 
+/* a token is a span into the lexer's source; string and char literal
+   spans exclude the surrounding quotes. identifiers also carry their
+   interned id (see intern.h), 0 for every other kind */
 typedef struct {
     TokenKind kind;
-    char text[256];
+    int off;
+    int len;
     int line;
     int col;
+    int atom;
 } Token;
 
 #endif
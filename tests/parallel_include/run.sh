@@ -0,0 +1,26 @@
+#!/bin/bash
+# Tests sharing an include must splice it once each, however their scans
+# interleave: x.mxy includes y.mxy, then a long pad.mxy, then w.mxy, which
+# also includes y.mxy. While x is in the pad, the z files' scans add w.mxy
+# and y.mxy to the cache, so x meets y once through its own scan and once
+# through the cached w.
+# Usage: tests/parallel_include/run.sh [path/to/moxy]
+
+MOXY="$(realpath "${1:-./build/debug/moxy}")"
+DIR="$(dirname "$0")"
+TMP="$(mktemp -d)"
+trap 'rm -rf "$TMP"' EXIT
+
+cp "$DIR"/*.mxy "$TMP"
+for i in $(seq 50000); do echo "// padding line $i"; done > "$TMP/pad.mxy"
+
+cd "$TMP"
+for run in 1 2 3 4 5; do
+    out=$("$MOXY" test -j 4 x.mxy z*.mxy 2>&1)
+    if ! echo "$out" | grep -q "8 passed, 0 failed"; then
+        echo "  FAIL parallel_include"
+        echo "$out" | tail -20
+        exit 1
+    fi
+done
+echo "  ok   parallel_include"
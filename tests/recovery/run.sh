@@ -0,0 +1,19 @@
+#!/bin/bash
+# A test that fails to transpile must not break the next test on the same
+# worker: runs broken.mxy 100 times, then ok.mxy, on one thread. The low
+# file limit catches a failed test leaking its output file.
+# Usage: tests/recovery/run.sh [path/to/moxy]
+
+MOXY="${1:-./build/debug/moxy}"
+DIR="$(dirname "$0")"
+
+files=()
+for i in $(seq 100); do files+=("$DIR/broken.mxy"); done
+out=$(ulimit -n 64; "$MOXY" test -j 1 "${files[@]}" "$DIR/ok.mxy" 2>&1)
+if echo "$out" | grep -q "1 passed, 100 failed"; then
+    echo "  ok   recovery"
+else
+    echo "  FAIL recovery"
+    echo "$out" | tail -20
+    exit 1
+fi